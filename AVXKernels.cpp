@@ -0,0 +1,180 @@
+#include "AVXKernels.hpp"
+
+// Built with /arch:AVX (or target("avx") functions) - nothing here may be shared with the other files, so the
+// kernels stick to raw arrays and intrinsics and never instantiate a glm or standard library inline function
+
+#if defined(GPS_HAS_AVX_KERNELS)
+
+#include <immintrin.h>
+
+#if defined(__GNUC__)
+    #define GPS_AVX_FUNCTION __attribute__((target("avx")))
+#else
+    #define GPS_AVX_FUNCTION
+#endif
+
+namespace gps {
+
+    // Row k of the result is column k of the input: 8 components of 8 transforms become 8 floats per transform
+    GPS_AVX_FUNCTION static inline void Transpose8x8(__m256 r[8]) {
+
+        __m256 t0 = _mm256_unpacklo_ps(r[0], r[1]);
+        __m256 t1 = _mm256_unpackhi_ps(r[0], r[1]);
+        __m256 t2 = _mm256_unpacklo_ps(r[2], r[3]);
+        __m256 t3 = _mm256_unpackhi_ps(r[2], r[3]);
+        __m256 t4 = _mm256_unpacklo_ps(r[4], r[5]);
+        __m256 t5 = _mm256_unpackhi_ps(r[4], r[5]);
+        __m256 t6 = _mm256_unpacklo_ps(r[6], r[7]);
+        __m256 t7 = _mm256_unpackhi_ps(r[6], r[7]);
+
+        __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+
+        r[0] = _mm256_permute2f128_ps(s0, s4, 0x20);
+        r[1] = _mm256_permute2f128_ps(s1, s5, 0x20);
+        r[2] = _mm256_permute2f128_ps(s2, s6, 0x20);
+        r[3] = _mm256_permute2f128_ps(s3, s7, 0x20);
+        r[4] = _mm256_permute2f128_ps(s0, s4, 0x31);
+        r[5] = _mm256_permute2f128_ps(s1, s5, 0x31);
+        r[6] = _mm256_permute2f128_ps(s2, s6, 0x31);
+        r[7] = _mm256_permute2f128_ps(s3, s7, 0x31);
+    }
+
+    // 1 / s, or 0 for a zero scale
+    GPS_AVX_FUNCTION static inline __m256 SafeReciprocal(__m256 s) {
+
+        __m256 nonZero = _mm256_cmp_ps(s, _mm256_setzero_ps(), _CMP_NEQ_OQ);
+        return _mm256_and_ps(_mm256_div_ps(_mm256_set1_ps(1.0f), s), nonZero);
+    }
+
+    GPS_AVX_FUNCTION size_t CullBoxesAVX(const float* const boxes[6], const float planes[6][4], unsigned char* visible,
+                                         size_t first, size_t end, size_t& visibleCount) {
+
+        // a box is outside when it lies entirely behind one plane:
+        // dot(normal, center) + distance < -(|normal.x| * extent.x + |normal.y| * extent.y + |normal.z| * extent.z)
+        __m256 signBits = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+
+        for (; first + 8 <= end; first += 8) {
+
+            __m256 cx = _mm256_loadu_ps(boxes[0] + first);
+            __m256 cy = _mm256_loadu_ps(boxes[1] + first);
+            __m256 cz = _mm256_loadu_ps(boxes[2] + first);
+            __m256 ex = _mm256_loadu_ps(boxes[3] + first);
+            __m256 ey = _mm256_loadu_ps(boxes[4] + first);
+            __m256 ez = _mm256_loadu_ps(boxes[5] + first);
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+            for (int p = 0; p < 6; p++) {
+
+                __m256 nx = _mm256_set1_ps(planes[p][0]);
+                __m256 ny = _mm256_set1_ps(planes[p][1]);
+                __m256 nz = _mm256_set1_ps(planes[p][2]);
+                __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(cx, nx), _mm256_mul_ps(cy, ny)),
+                    _mm256_add_ps(_mm256_mul_ps(cz, nz), _mm256_set1_ps(planes[p][3])));
+                __m256 radius = _mm256_add_ps(_mm256_add_ps(
+                    _mm256_mul_ps(ex, _mm256_and_ps(nx, signBits)),
+                    _mm256_mul_ps(ey, _mm256_and_ps(ny, signBits))),
+                    _mm256_mul_ps(ez, _mm256_and_ps(nz, signBits)));
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), _mm256_setzero_ps(), _CMP_GE_OQ));
+
+                // all 8 outside already
+                if (_mm256_movemask_ps(inside) == 0) {
+                    break;
+                }
+            }
+
+            int mask = _mm256_movemask_ps(inside);
+            for (int k = 0; k < 8; k++) {
+                visible[first + k] = (unsigned char)((mask >> k) & 1);
+                visibleCount += (mask >> k) & 1;
+            }
+        }
+        return first;
+    }
+
+    GPS_AVX_FUNCTION size_t ComposeTransformsAVX(const float* const transforms[10], float* world, float* normal, size_t first, size_t end) {
+
+        // rotation columns of a unit quaternion (x, y, z, w):
+        // c0 = (1 - 2(yy + zz), 2(xy + wz), 2(xz - wy))
+        // c1 = (2(xy - wz), 1 - 2(xx + zz), 2(yz + wx))
+        // c2 = (2(xz + wy), 2(yz - wx), 1 - 2(xx + yy))
+        // world = [c0 sx, c1 sy, c2 sz, position], normal = [c0 / sx, c1 / sy, c2 / sz]
+        __m256 one = _mm256_set1_ps(1.0f);
+        __m256 two = _mm256_set1_ps(2.0f);
+        __m256 zero = _mm256_setzero_ps();
+
+        for (; first + 8 <= end; first += 8) {
+
+            __m256 x = _mm256_loadu_ps(transforms[3] + first);
+            __m256 y = _mm256_loadu_ps(transforms[4] + first);
+            __m256 z = _mm256_loadu_ps(transforms[5] + first);
+            __m256 w = _mm256_loadu_ps(transforms[6] + first);
+            __m256 sx = _mm256_loadu_ps(transforms[7] + first);
+            __m256 sy = _mm256_loadu_ps(transforms[8] + first);
+            __m256 sz = _mm256_loadu_ps(transforms[9] + first);
+
+            __m256 x2 = _mm256_mul_ps(x, two);
+            __m256 y2 = _mm256_mul_ps(y, two);
+            __m256 z2 = _mm256_mul_ps(z, two);
+            __m256 xx = _mm256_mul_ps(x, x2);
+            __m256 yy = _mm256_mul_ps(y, y2);
+            __m256 zz = _mm256_mul_ps(z, z2);
+            __m256 xy = _mm256_mul_ps(x, y2);
+            __m256 xz = _mm256_mul_ps(x, z2);
+            __m256 yz = _mm256_mul_ps(y, z2);
+            __m256 wx = _mm256_mul_ps(w, x2);
+            __m256 wy = _mm256_mul_ps(w, y2);
+            __m256 wz = _mm256_mul_ps(w, z2);
+
+            __m256 r[9] = {
+                _mm256_sub_ps(one, _mm256_add_ps(yy, zz)), _mm256_add_ps(xy, wz), _mm256_sub_ps(xz, wy),
+                _mm256_sub_ps(xy, wz), _mm256_sub_ps(one, _mm256_add_ps(xx, zz)), _mm256_add_ps(yz, wx),
+                _mm256_add_ps(xz, wy), _mm256_sub_ps(yz, wx), _mm256_sub_ps(one, _mm256_add_ps(xx, yy))
+            };
+
+            // columns 0 and 1, then columns 2 and 3 of the world matrices
+            __m256 lower[8] = {
+                _mm256_mul_ps(r[0], sx), _mm256_mul_ps(r[1], sx), _mm256_mul_ps(r[2], sx), zero,
+                _mm256_mul_ps(r[3], sy), _mm256_mul_ps(r[4], sy), _mm256_mul_ps(r[5], sy), zero
+            };
+            __m256 upper[8] = {
+                _mm256_mul_ps(r[6], sz), _mm256_mul_ps(r[7], sz), _mm256_mul_ps(r[8], sz), zero,
+                _mm256_loadu_ps(transforms[0] + first), _mm256_loadu_ps(transforms[1] + first), _mm256_loadu_ps(transforms[2] + first), one
+            };
+            Transpose8x8(lower);
+            Transpose8x8(upper);
+            for (int k = 0; k < 8; k++) {
+                float* matrix = world + (first + k) * 16;
+                _mm256_storeu_ps(matrix, lower[k]);
+                _mm256_storeu_ps(matrix + 8, upper[k]);
+            }
+
+            // the 9 normal matrix entries: the first 8 through the transpose, the last one per transform
+            __m256 ix = SafeReciprocal(sx);
+            __m256 iy = SafeReciprocal(sy);
+            __m256 iz = SafeReciprocal(sz);
+            __m256 normals[8] = {
+                _mm256_mul_ps(r[0], ix), _mm256_mul_ps(r[1], ix), _mm256_mul_ps(r[2], ix),
+                _mm256_mul_ps(r[3], iy), _mm256_mul_ps(r[4], iy), _mm256_mul_ps(r[5], iy),
+                _mm256_mul_ps(r[6], iz), _mm256_mul_ps(r[7], iz)
+            };
+            float last[8];
+            _mm256_storeu_ps(last, _mm256_mul_ps(r[8], iz));
+            Transpose8x8(normals);
+            for (int k = 0; k < 8; k++) {
+                float* matrix = normal + (first + k) * 9;
+                _mm256_storeu_ps(matrix, normals[k]);
+                matrix[8] = last[k];
+            }
+        }
+        return first;
+    }
+}
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef AVXKernels_hpp
+#define AVXKernels_hpp
+
+#include <cstddef>
+
+// The 8-wide loops of FrustumCuller and TransformArray live in AVXKernels.cpp, the only file built for AVX: the
+// project compiles it alone with /arch:AVX, GCC and Clang compile its functions with a target attribute. The
+// rest of the executable stays on the baseline instruction set, so it still runs on CPUs without AVX - the
+// callers only take the AVX paths when CpuHasAVX says so
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+    #define GPS_HAS_AVX_KERNELS 1
+#endif
+
+#if defined(GPS_HAS_AVX_KERNELS) && defined(_MSC_VER)
+    #include <intrin.h>
+#endif
+
+namespace gps {
+
+    // The CPU has AVX and the OS saves the YMM registers (CPUID, then XGETBV), checked once per caller
+    static inline bool CpuHasAVX() {
+
+#if defined(GPS_HAS_AVX_KERNELS) && defined(_MSC_VER)
+        static const bool hasAVX = []() {
+            int info[4];
+            __cpuid(info, 1);
+            bool osxsave = (info[2] & (1 << 27)) != 0;
+            bool avx = (info[2] & (1 << 28)) != 0;
+            return osxsave && avx && (_xgetbv(0) & 0x6) == 0x6;
+        }();
+        return hasAVX;
+#elif defined(GPS_HAS_AVX_KERNELS) && defined(__GNUC__)
+        static const bool hasAVX = []() {
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx") != 0;
+        }();
+        return hasAVX;
+#else
+        return false;
+#endif
+    }
+
+    // Tests boxes [first, end) 8 at a time against the 6 planes (normal, distance) and writes visible[i].
+    // boxes holds the centerX, centerY, centerZ, extentX, extentY and extentZ arrays. Adds the visible boxes to
+    // visibleCount and returns where it stopped - the last end - first mod 8 boxes are left to the caller
+    size_t CullBoxesAVX(const float* const boxes[6], const float planes[6][4], unsigned char* visible,
+                        size_t first, size_t end, size_t& visibleCount);
+
+    // Composes the transforms [first, end) 8 at a time into column-major mat4 world and mat3 normal arrays.
+    // transforms holds the positionX, Y, Z, rotationX, Y, Z, W and scaleX, Y, Z arrays. Returns where it stopped
+    size_t ComposeTransformsAVX(const float* const transforms[10], float* world, float* normal, size_t first, size_t end);
+}
+
+#endif /* AVXKernels_hpp */
@@ -0,0 +1,302 @@
+#include "CookedModel.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <utility>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+namespace gps {
+
+    static const char COOKED_FILE_MAGIC[4] = { 'G', 'C', 'M', 'D' };
+    static const GLuint COOKED_FILE_VERSION = 3;
+    static const GLuint UNASSIGNED = 0xFFFFFFFFu;
+
+    static unsigned long long FileSize(const std::string& path) {
+
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        return file ? (unsigned long long)file.tellg() : 0;
+    }
+
+    // Last write time of the file, 0 when it cannot be found - an edit that keeps the size still changes it,
+    // and unlike a content hash it costs one stat call rather than a read of the whole source on every start
+    static unsigned long long FileModifiedTime(const std::string& path) {
+
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0) {
+            return 0;
+        }
+        return (unsigned long long)info.st_mtime;
+    }
+
+    static void WriteString(std::ofstream& file, const std::string& text) {
+
+        GLuint length = (GLuint)text.size();
+        file.write((const char*)&length, sizeof(length));
+        file.write(text.data(), length);
+    }
+
+    static bool ReadString(std::ifstream& file, std::string& text) {
+
+        GLuint length = 0;
+        file.read((char*)&length, sizeof(length));
+        if (!file || length > 4096) {
+            return false;
+        }
+        text.resize(length);
+        file.read(&text[0], length);
+        return (bool)file;
+    }
+
+    // (mesh, level) of every chunk in file order: step s holds level (levelCount - 1 - s) of every mesh that has it
+    static std::vector<std::pair<GLuint, GLuint>> ChunkOrder(const std::vector<GLuint>& levelCounts) {
+
+        std::vector<std::pair<GLuint, GLuint>> order;
+        GLuint maxLevels = levelCounts.empty() ? 0 : *std::max_element(levelCounts.begin(), levelCounts.end());
+        for (GLuint step = 0; step < maxLevels; step++) {
+            for (GLuint mesh = 0; mesh < levelCounts.size(); mesh++) {
+                if (levelCounts[mesh] > step) {
+                    order.push_back(std::make_pair(mesh, levelCounts[mesh] - 1 - step));
+                }
+            }
+        }
+        return order;
+    }
+
+    CookedModel::~CookedModel() {
+
+        cancelled = true;
+        if (reader.valid()) {
+            reader.wait();
+        }
+    }
+
+    bool CookedModel::Write(const std::string& path, const std::string& sourcePath, const std::vector<Mesh>& meshes) {
+
+        std::ofstream file(path, std::ios::binary);
+        if (!file) {
+            return false;
+        }
+
+        // new position of every vertex, in the order the levels first use them, coarsest level first
+        std::vector<std::vector<GLuint>> remaps(meshes.size());
+        std::vector<std::vector<GLuint>> orders(meshes.size());
+        std::vector<std::vector<GLuint>> levelVertexCounts(meshes.size());
+        std::vector<GLuint> levelCounts(meshes.size());
+        for (size_t m = 0; m < meshes.size(); m++) {
+
+            const Mesh& mesh = meshes[m];
+            std::vector<GLuint>& remap = remaps[m];
+            std::vector<GLuint>& order = orders[m];
+            remap.assign(mesh.vertices.size(), UNASSIGNED);
+            levelVertexCounts[m].resize(mesh.lods.size());
+            levelCounts[m] = (GLuint)mesh.lods.size();
+
+            for (size_t level = mesh.lods.size(); level-- > 0;) {
+
+                const MeshLOD& lod = mesh.lods[level];
+                for (GLuint i = lod.firstIndex; i < lod.firstIndex + lod.indexCount; i++) {
+
+                    GLuint vertex = i < mesh.indices.size() ? mesh.indices[i] : mesh.lodIndices[i - mesh.indices.size()];
+                    if (remap[vertex] == UNASSIGNED) {
+                        remap[vertex] = (GLuint)order.size();
+                        order.push_back(vertex);
+                    }
+                }
+                levelVertexCounts[m][level] = (GLuint)order.size();
+            }
+
+            // vertices no triangle uses still go out, with the full detail level
+            for (GLuint vertex = 0; vertex < mesh.vertices.size(); vertex++) {
+                if (remap[vertex] == UNASSIGNED) {
+                    remap[vertex] = (GLuint)order.size();
+                    order.push_back(vertex);
+                }
+            }
+            if (!levelVertexCounts[m].empty()) {
+                levelVertexCounts[m][0] = (GLuint)order.size();
+            }
+        }
+
+        unsigned long long sourceSize = FileSize(sourcePath);
+        unsigned long long sourceTime = FileModifiedTime(sourcePath);
+        GLuint meshCount = (GLuint)meshes.size();
+        file.write(COOKED_FILE_MAGIC, sizeof(COOKED_FILE_MAGIC));
+        file.write((const char*)&COOKED_FILE_VERSION, sizeof(COOKED_FILE_VERSION));
+        file.write((const char*)&sourceSize, sizeof(sourceSize));
+        file.write((const char*)&sourceTime, sizeof(sourceTime));
+        file.write((const char*)&meshCount, sizeof(meshCount));
+
+        for (size_t m = 0; m < meshes.size(); m++) {
+
+            const Mesh& mesh = meshes[m];
+            GLuint counts[5] = { (GLuint)mesh.vertices.size(), (GLuint)mesh.indices.size(), (GLuint)mesh.lodIndices.size(),
+                (GLuint)mesh.lods.size(), (GLuint)mesh.textures.size() };
+            file.write((const char*)&mesh.bounds, sizeof(mesh.bounds));
+            file.write((const char*)counts, sizeof(counts));
+            file.write((const char*)mesh.lods.data(), mesh.lods.size() * sizeof(MeshLOD));
+            file.write((const char*)levelVertexCounts[m].data(), levelVertexCounts[m].size() * sizeof(GLuint));
+            for (size_t t = 0; t < mesh.textures.size(); t++) {
+                WriteString(file, mesh.textures[t].type);
+                WriteString(file, mesh.textures[t].path);
+            }
+        }
+
+        std::vector<std::pair<GLuint, GLuint>> chunks = ChunkOrder(levelCounts);
+        std::vector<Vertex> vertices;
+        std::vector<GLuint> indices;
+        for (size_t c = 0; c < chunks.size(); c++) {
+
+            GLuint m = chunks[c].first;
+            GLuint level = chunks[c].second;
+            const Mesh& mesh = meshes[m];
+            GLuint firstVertex = level + 1 < mesh.lods.size() ? levelVertexCounts[m][level + 1] : 0;
+
+            vertices.clear();
+            for (GLuint v = firstVertex; v < levelVertexCounts[m][level]; v++) {
+                vertices.push_back(mesh.vertices[orders[m][v]]);
+            }
+            indices.clear();
+            const MeshLOD& lod = mesh.lods[level];
+            for (GLuint i = lod.firstIndex; i < lod.firstIndex + lod.indexCount; i++) {
+                indices.push_back(remaps[m][i < mesh.indices.size() ? mesh.indices[i] : mesh.lodIndices[i - mesh.indices.size()]]);
+            }
+
+            file.write((const char*)vertices.data(), vertices.size() * sizeof(Vertex));
+            file.write((const char*)indices.data(), indices.size() * sizeof(GLuint));
+        }
+        return (bool)file;
+    }
+
+    bool CookedModel::open(const std::string& path, const std::string& sourcePath, std::vector<CookedMesh>& meshes) {
+
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            return false;
+        }
+
+        char magic[4];
+        GLuint version = 0;
+        unsigned long long sourceSize = 0;
+        unsigned long long sourceTime = 0;
+        GLuint meshCount = 0;
+        file.read(magic, sizeof(magic));
+        file.read((char*)&version, sizeof(version));
+        file.read((char*)&sourceSize, sizeof(sourceSize));
+        file.read((char*)&sourceTime, sizeof(sourceTime));
+        file.read((char*)&meshCount, sizeof(meshCount));
+        if (!file || memcmp(magic, COOKED_FILE_MAGIC, sizeof(magic)) != 0 || version != COOKED_FILE_VERSION
+            || sourceSize != FileSize(sourcePath) || sourceTime != FileModifiedTime(sourcePath) || meshCount > (1u << 20)) {
+            return false;
+        }
+
+        meshes.resize(meshCount);
+        for (size_t m = 0; m < meshes.size(); m++) {
+
+            CookedMesh& mesh = meshes[m];
+            GLuint counts[5];
+            file.read((char*)&mesh.bounds, sizeof(mesh.bounds));
+            file.read((char*)counts, sizeof(counts));
+            if (!file || counts[3] == 0 || counts[3] > Mesh::MAX_LODS || counts[4] > 16) {
+                return false;
+            }
+
+            mesh.vertexCount = counts[0];
+            mesh.indexCount = counts[1];
+            mesh.lodIndexCount = counts[2];
+            mesh.lods.resize(counts[3]);
+            mesh.levelVertexCounts.resize(counts[3]);
+            mesh.textures.resize(counts[4]);
+            file.read((char*)mesh.lods.data(), mesh.lods.size() * sizeof(MeshLOD));
+            file.read((char*)mesh.levelVertexCounts.data(), mesh.levelVertexCounts.size() * sizeof(GLuint));
+            for (size_t t = 0; t < mesh.textures.size(); t++) {
+                if (!ReadString(file, mesh.textures[t].type) || !ReadString(file, mesh.textures[t].path)) {
+                    return false;
+                }
+            }
+
+            for (size_t level = 0; level < mesh.lods.size(); level++) {
+                if (mesh.lods[level].firstIndex + mesh.lods[level].indexCount > mesh.indexCount + mesh.lodIndexCount
+                    || mesh.levelVertexCounts[level] > mesh.vertexCount) {
+                    return false;
+                }
+            }
+        }
+        if (!file) {
+            return false;
+        }
+
+        this->path = path;
+        this->meshes = meshes;
+        chunksOffset = file.tellg();
+        return true;
+    }
+
+    void CookedModel::startStreaming() {
+
+        readerDone = false;
+        cancelled = false;
+        reader = std::async(std::launch::async, &CookedModel::readAll, this);
+    }
+
+    void CookedModel::readAll() {
+
+        std::ifstream file(path, std::ios::binary);
+        file.seekg(chunksOffset);
+
+        std::vector<GLuint> levelCounts(meshes.size());
+        for (size_t m = 0; m < meshes.size(); m++) {
+            levelCounts[m] = (GLuint)meshes[m].lods.size();
+        }
+
+        std::vector<std::pair<GLuint, GLuint>> chunks = ChunkOrder(levelCounts);
+        for (size_t c = 0; c < chunks.size() && file && !cancelled; c++) {
+
+            const CookedMesh& mesh = meshes[chunks[c].first];
+            CookedChunk chunk;
+            chunk.mesh = chunks[c].first;
+            chunk.level = chunks[c].second;
+            chunk.firstVertex = chunk.level + 1 < mesh.lods.size() ? mesh.levelVertexCounts[chunk.level + 1] : 0;
+            chunk.vertices.resize(mesh.levelVertexCounts[chunk.level] - std::min(chunk.firstVertex, mesh.levelVertexCounts[chunk.level]));
+            chunk.indices.resize(mesh.lods[chunk.level].indexCount);
+            file.read((char*)chunk.vertices.data(), chunk.vertices.size() * sizeof(Vertex));
+            file.read((char*)chunk.indices.data(), chunk.indices.size() * sizeof(GLuint));
+            if (!file) {
+                break;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            readChunks.push_back(std::move(chunk));
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        readerDone = true;
+    }
+
+    void CookedModel::takeChunks(std::vector<CookedChunk>& chunks, size_t maxBytes) {
+
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t bytes = 0;
+        while (!readChunks.empty() && bytes < maxBytes) {
+
+            bytes += readChunks.front().vertices.size() * sizeof(Vertex) + readChunks.front().indices.size() * sizeof(GLuint);
+            chunks.push_back(std::move(readChunks.front()));
+            readChunks.pop_front();
+        }
+    }
+
+    bool CookedModel::finished() {
+
+        std::lock_guard<std::mutex> lock(mutex);
+        return readerDone && readChunks.empty();
+    }
+
+    void CookedModel::wait() {
+
+        if (reader.valid()) {
+            reader.wait();
+        }
+    }
+}
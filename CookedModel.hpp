@@ -0,0 +1,85 @@
+#ifndef CookedModel_hpp
+#define CookedModel_hpp
+
+#include "Mesh.hpp"
+
+#include <atomic>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Texture of a cooked mesh, loaded again through the model's texture cache
+    struct CookedTexture {
+        std::string type;
+        std::string path;
+    };
+
+    // Everything about a cooked mesh except its geometry
+    struct CookedMesh {
+        Bounds bounds;
+        GLuint vertexCount;
+        GLuint indexCount;                      // full detail indices; the coarser levels follow them
+        GLuint lodIndexCount;
+        std::vector<MeshLOD> lods;
+        // Vertices used by the levels from the coarsest down to each level - the vertices are stored in the order
+        // the levels first use them, so a level only needs a prefix of the vertex array
+        std::vector<GLuint> levelVertexCounts;
+        std::vector<CookedTexture> textures;
+    };
+
+    // Geometry of one level of one mesh: the vertices it adds to the coarser levels' prefix, and its indices
+    struct CookedChunk {
+        GLuint mesh;
+        GLuint level;
+        GLuint firstVertex;
+        std::vector<Vertex> vertices;
+        std::vector<GLuint> indices;
+    };
+
+    // Binary cache of a parsed model, laid out for progressive loading: a table of the meshes, their levels of
+    // detail and textures, then the geometry chunks ordered by level - every mesh's coarsest level first, the full
+    // detail levels last. A reader thread streams the chunks in that order while the model is already drawn
+    class CookedModel {
+
+    public:
+        ~CookedModel();
+
+        // Writes the meshes with their vertices reordered level by level, tagged with the size and last write time of the source file
+        static bool Write(const std::string& path, const std::string& sourcePath, const std::vector<Mesh>& meshes);
+
+        // Reads the mesh table, false when the file is missing, from another version or the source changed
+        bool open(const std::string& path, const std::string& sourcePath, std::vector<CookedMesh>& meshes);
+
+        // Starts reading the chunks on a worker thread
+        void startStreaming();
+
+        // Moves the chunks read so far into chunks, in file order, stopping once maxBytes of geometry were taken
+        void takeChunks(std::vector<CookedChunk>& chunks, size_t maxBytes);
+
+        // Every chunk was read and taken
+        bool finished();
+
+        // Blocks until the reader has read every chunk (or failed)
+        void wait();
+
+    private:
+        std::string path;
+        std::streamoff chunksOffset = 0;
+        std::vector<CookedMesh> meshes;
+
+        std::future<void> reader;
+        std::mutex mutex;
+        std::deque<CookedChunk> readChunks;
+        bool readerDone = true;
+        std::atomic<bool> cancelled{false};
+
+        // Body of the reader thread
+        void readAll();
+    };
+}
+
+#endif /* CookedModel_hpp */
@@ -0,0 +1,122 @@
+#include "DrawDataRing.hpp"
+
+#include <chrono>
+#include <iostream>
+
+namespace gps {
+
+    RingStats DrawDataRing::stats = {};
+    bool DrawDataRing::usePersistentMapping = false;
+    GLuint DrawDataRing::buffer = 0;
+    DrawData* DrawDataRing::mapped = NULL;
+    GLsync DrawDataRing::fences[DrawDataRing::SEGMENTS] = {};
+    int DrawDataRing::segment = 0;
+    size_t DrawDataRing::segmentOffset = 0;
+    std::vector<DrawData> DrawDataRing::staging;
+
+    void DrawDataRing::SetUsePersistentMapping(bool enabled) {
+
+#if defined (__APPLE__)
+        usePersistentMapping = false;
+#else
+        usePersistentMapping = enabled && GLEW_ARB_buffer_storage && GLEW_ARB_base_instance;
+#endif
+        if (enabled && !usePersistentMapping) {
+            std::cout << "ARB_buffer_storage not supported, draw data is uploaded by orphaning the buffer" << std::endl;
+        }
+    }
+
+    bool DrawDataRing::GetUsePersistentMapping() {
+
+        return usePersistentMapping;
+    }
+
+    GLuint DrawDataRing::GetBuffer() {
+
+        if (buffer != 0) {
+            return buffer;
+        }
+
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+#if not defined (__APPLE__)
+        if (usePersistentMapping) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            GLsizeiptr size = SEGMENTS * SEGMENT_RECORDS * sizeof(DrawData);
+            glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+            mapped = (DrawData*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+            return buffer;
+        }
+#endif
+
+        // one zeroed record, so vertex arrays set up before the first frame never read an empty buffer - its
+        // layers defer to the uniforms, like those of any record written without them
+        DrawData empty = {};
+        empty.textureLayers = glm::ivec2(-1, -1);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(DrawData), &empty, GL_STREAM_DRAW);
+        return buffer;
+    }
+
+    DrawData* DrawDataRing::Map(size_t count, GLuint& firstRecord) {
+
+        stats.records += (unsigned int)count;
+
+        if (!usePersistentMapping) {
+            staging.resize(count);
+            firstRecord = 0;
+            return staging.data();
+        }
+
+        GetBuffer();
+        if (segmentOffset + count > SEGMENT_RECORDS) {
+            advanceSegment();
+        }
+
+        firstRecord = (GLuint)(segment * SEGMENT_RECORDS + segmentOffset);
+        segmentOffset += count;
+        return mapped + firstRecord;
+    }
+
+    void DrawDataRing::Unmap(size_t count) {
+
+        if (usePersistentMapping) {
+            // coherent mapping - the writes are visible to every draw issued from now on
+            return;
+        }
+
+        // orphan and refill - the vertex arrays keep pointing at the same buffer name
+        glBindBuffer(GL_ARRAY_BUFFER, GetBuffer());
+        glBufferData(GL_ARRAY_BUFFER, count * sizeof(DrawData), staging.data(), GL_STREAM_DRAW);
+    }
+
+    void DrawDataRing::EndFrame() {
+
+        if (usePersistentMapping && segmentOffset > 0) {
+            advanceSegment();
+        }
+    }
+
+    void DrawDataRing::advanceSegment() {
+
+        fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        segment = (segment + 1) % SEGMENTS;
+        segmentOffset = 0;
+
+        if (fences[segment] == NULL) {
+            return;
+        }
+
+        // the GPU may still be reading what was written here SEGMENTS segments ago
+        if (glClientWaitSync(fences[segment], 0, 0) == GL_TIMEOUT_EXPIRED) {
+            auto waitStart = std::chrono::high_resolution_clock::now();
+            while (glClientWaitSync(fences[segment], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {
+            }
+            stats.stallMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - waitStart).count();
+            stats.waits++;
+        }
+
+        glDeleteSync(fences[segment]);
+        fences[segment] = NULL;
+    }
+}
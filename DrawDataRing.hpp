@@ -0,0 +1,63 @@
+#ifndef DrawDataRing_hpp
+#define DrawDataRing_hpp
+
+#include "Mesh.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // Counters of the draw data ring, reset by the render loop every frame
+    struct RingStats {
+        unsigned int records;       // DrawData records written
+        unsigned int waits;         // fences that were still pending when their segment was reused
+        double stallMs;             // CPU time spent waiting on them
+    };
+
+    // Buffer the DrawData attributes of every vertex array read from.
+    // With persistent mapping it is a ring of SEGMENTS fenced segments, written in place by the CPU in one
+    // linear pass and never reallocated; the GPU reads a segment while the CPU fills the next ones. Without it
+    // the records are staged on the CPU and the buffer is orphaned on every upload
+    class DrawDataRing {
+
+    public:
+        // Maps the ring persistently when ARB_buffer_storage and ARB_base_instance are available.
+        // Needs a current GL context and has to be called before any vertex array is created
+        static void SetUsePersistentMapping(bool enabled);
+
+        static bool GetUsePersistentMapping();
+
+        // Buffer name the vertex arrays point at, created on first use
+        static GLuint GetBuffer();
+
+        // Returns space for count (at most SEGMENT_RECORDS) records and the index of the first one, to be passed
+        // as the draws' baseInstance. Moving into a segment the GPU may still read waits for its fence
+        static DrawData* Map(size_t count, GLuint& firstRecord);
+
+        // Makes the records of the last Map visible to the draws that follow
+        static void Unmap(size_t count);
+
+        // Fences the segment written this frame; the next frame starts in the following one
+        static void EndFrame();
+
+        static const int SEGMENTS = 3;
+        static const size_t SEGMENT_RECORDS = 16384;
+
+        static RingStats stats;
+
+    private:
+        static bool usePersistentMapping;
+        static GLuint buffer;
+        static DrawData* mapped;
+        static GLsync fences[SEGMENTS];
+        static int segment;
+        static size_t segmentOffset;
+        // records staged on the CPU when the buffer is not persistently mapped
+        static std::vector<DrawData> staging;
+
+        // Fences the current segment and waits until the GPU is done with the next one
+        static void advanceSegment();
+    };
+}
+
+#endif /* DrawDataRing_hpp */
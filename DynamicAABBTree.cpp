@@ -0,0 +1,348 @@
+#include "DynamicAABBTree.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+namespace gps {
+
+    static float SurfaceArea(const glm::vec3& min, const glm::vec3& max) {
+
+        glm::vec3 size = max - min;
+        return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+
+    static bool Contains(const glm::vec3& outerMin, const glm::vec3& outerMax, const glm::vec3& min, const glm::vec3& max) {
+
+        return outerMin.x <= min.x && outerMin.y <= min.y && outerMin.z <= min.z
+            && max.x <= outerMax.x && max.y <= outerMax.y && max.z <= outerMax.z;
+    }
+
+    static bool Overlaps(const glm::vec3& minA, const glm::vec3& maxA, const glm::vec3& minB, const glm::vec3& maxB) {
+
+        return minA.x <= maxB.x && minA.y <= maxB.y && minA.z <= maxB.z
+            && minB.x <= maxA.x && minB.y <= maxA.y && minB.z <= maxA.z;
+    }
+
+    DynamicAABBTree::DynamicAABBTree(float margin) {
+
+        this->margin = margin;
+        root = NULL_NODE;
+        freeList = NULL_NODE;
+        stats = {};
+    }
+
+    bool DynamicAABBTree::isLeaf(int node) {
+
+        return nodes[node].child1 == NULL_NODE;
+    }
+
+    int DynamicAABBTree::allocateNode() {
+
+        if (freeList == NULL_NODE) {
+            Node node = {};
+            node.height = -1;
+            node.parent = NULL_NODE;
+            nodes.push_back(node);
+            freeList = (int)nodes.size() - 1;
+        }
+
+        int node = freeList;
+        freeList = nodes[node].parent;
+        nodes[node].parent = NULL_NODE;
+        nodes[node].child1 = NULL_NODE;
+        nodes[node].child2 = NULL_NODE;
+        nodes[node].height = 0;
+        nodes[node].userData = -1;
+        return node;
+    }
+
+    void DynamicAABBTree::freeNode(int node) {
+
+        nodes[node].parent = freeList;
+        nodes[node].height = -1;
+        freeList = node;
+    }
+
+    int DynamicAABBTree::createProxy(const glm::vec3& min, const glm::vec3& max, int userData) {
+
+        int proxy = allocateNode();
+        nodes[proxy].min = min - glm::vec3(margin);
+        nodes[proxy].max = max + glm::vec3(margin);
+        nodes[proxy].userData = userData;
+        insertLeaf(proxy);
+        return proxy;
+    }
+
+    void DynamicAABBTree::destroyProxy(int proxyId) {
+
+        removeLeaf(proxyId);
+        freeNode(proxyId);
+    }
+
+    bool DynamicAABBTree::moveProxy(int proxyId, const glm::vec3& min, const glm::vec3& max) {
+
+        auto start = std::chrono::high_resolution_clock::now();
+        stats.moves++;
+
+        if (Contains(nodes[proxyId].min, nodes[proxyId].max, min, max)) {
+            stats.updateMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+            return false;
+        }
+
+        removeLeaf(proxyId);
+        nodes[proxyId].min = min - glm::vec3(margin);
+        nodes[proxyId].max = max + glm::vec3(margin);
+        insertLeaf(proxyId);
+        stats.reinserts++;
+
+        stats.updateMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        return true;
+    }
+
+    void DynamicAABBTree::insertLeaf(int leaf) {
+
+        if (root == NULL_NODE) {
+            root = leaf;
+            nodes[root].parent = NULL_NODE;
+            return;
+        }
+
+        // walk down to the sibling whose box grows the least, counting the growth inherited by the ancestors
+        glm::vec3 leafMin = nodes[leaf].min;
+        glm::vec3 leafMax = nodes[leaf].max;
+        int index = root;
+        while (!isLeaf(index)) {
+
+            int child1 = nodes[index].child1;
+            int child2 = nodes[index].child2;
+
+            float area = SurfaceArea(nodes[index].min, nodes[index].max);
+            float combinedArea = SurfaceArea(glm::min(nodes[index].min, leafMin), glm::max(nodes[index].max, leafMax));
+
+            // cost of making a new parent for this node and the leaf
+            float cost = 2.0f * combinedArea;
+            // cost of pushing the leaf further down
+            float inheritanceCost = 2.0f * (combinedArea - area);
+
+            float childCost[2];
+            int children[2] = { child1, child2 };
+            for (int c = 0; c < 2; c++) {
+                float grown = SurfaceArea(glm::min(nodes[children[c]].min, leafMin), glm::max(nodes[children[c]].max, leafMax));
+                if (isLeaf(children[c])) {
+                    childCost[c] = grown + inheritanceCost;
+                } else {
+                    childCost[c] = grown - SurfaceArea(nodes[children[c]].min, nodes[children[c]].max) + inheritanceCost;
+                }
+            }
+
+            if (cost < childCost[0] && cost < childCost[1]) {
+                break;
+            }
+            index = childCost[0] < childCost[1] ? child1 : child2;
+        }
+
+        int sibling = index;
+        int oldParent = nodes[sibling].parent;
+        int newParent = allocateNode();
+        nodes[newParent].parent = oldParent;
+        nodes[newParent].min = glm::min(nodes[sibling].min, leafMin);
+        nodes[newParent].max = glm::max(nodes[sibling].max, leafMax);
+        nodes[newParent].height = nodes[sibling].height + 1;
+        nodes[newParent].child1 = sibling;
+        nodes[newParent].child2 = leaf;
+        nodes[sibling].parent = newParent;
+        nodes[leaf].parent = newParent;
+
+        if (oldParent == NULL_NODE) {
+            root = newParent;
+        } else if (nodes[oldParent].child1 == sibling) {
+            nodes[oldParent].child1 = newParent;
+        } else {
+            nodes[oldParent].child2 = newParent;
+        }
+
+        // refit and rebalance the ancestors
+        index = nodes[leaf].parent;
+        while (index != NULL_NODE) {
+            index = balance(index);
+
+            int child1 = nodes[index].child1;
+            int child2 = nodes[index].child2;
+            nodes[index].height = 1 + std::max(nodes[child1].height, nodes[child2].height);
+            nodes[index].min = glm::min(nodes[child1].min, nodes[child2].min);
+            nodes[index].max = glm::max(nodes[child1].max, nodes[child2].max);
+
+            index = nodes[index].parent;
+        }
+    }
+
+    void DynamicAABBTree::removeLeaf(int leaf) {
+
+        if (leaf == root) {
+            root = NULL_NODE;
+            return;
+        }
+
+        int parent = nodes[leaf].parent;
+        int grandParent = nodes[parent].parent;
+        int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+        if (grandParent == NULL_NODE) {
+            root = sibling;
+            nodes[sibling].parent = NULL_NODE;
+            freeNode(parent);
+            return;
+        }
+
+        // the sibling takes the parent's place
+        if (nodes[grandParent].child1 == parent) {
+            nodes[grandParent].child1 = sibling;
+        } else {
+            nodes[grandParent].child2 = sibling;
+        }
+        nodes[sibling].parent = grandParent;
+        freeNode(parent);
+
+        int index = grandParent;
+        while (index != NULL_NODE) {
+            index = balance(index);
+
+            int child1 = nodes[index].child1;
+            int child2 = nodes[index].child2;
+            nodes[index].min = glm::min(nodes[child1].min, nodes[child2].min);
+            nodes[index].max = glm::max(nodes[child1].max, nodes[child2].max);
+            nodes[index].height = 1 + std::max(nodes[child1].height, nodes[child2].height);
+
+            index = nodes[index].parent;
+        }
+    }
+
+    int DynamicAABBTree::balance(int a) {
+
+        if (isLeaf(a) || nodes[a].height < 2) {
+            return a;
+        }
+
+        int b = nodes[a].child1;
+        int c = nodes[a].child2;
+        int heightDifference = nodes[c].height - nodes[b].height;
+        if (heightDifference >= -1 && heightDifference <= 1) {
+            return a;
+        }
+
+        // the taller child moves up into a's place; a keeps the shorter child and one of the taller one's children
+        bool rotateC = heightDifference > 1;
+        int up = rotateC ? c : b;
+        int stay = rotateC ? b : c;
+        int f = nodes[up].child1;
+        int g = nodes[up].child2;
+
+        nodes[up].child1 = a;
+        nodes[up].parent = nodes[a].parent;
+        nodes[a].parent = up;
+
+        if (nodes[up].parent == NULL_NODE) {
+            root = up;
+        } else if (nodes[nodes[up].parent].child1 == a) {
+            nodes[nodes[up].parent].child1 = up;
+        } else {
+            nodes[nodes[up].parent].child2 = up;
+        }
+
+        // the taller grandchild stays under up, the other one goes down to a
+        int keep = nodes[f].height > nodes[g].height ? f : g;
+        int move = keep == f ? g : f;
+        nodes[up].child2 = keep;
+        if (rotateC) {
+            nodes[a].child2 = move;
+        } else {
+            nodes[a].child1 = move;
+        }
+        nodes[move].parent = a;
+
+        nodes[a].min = glm::min(nodes[stay].min, nodes[move].min);
+        nodes[a].max = glm::max(nodes[stay].max, nodes[move].max);
+        nodes[a].height = 1 + std::max(nodes[stay].height, nodes[move].height);
+        nodes[up].min = glm::min(nodes[a].min, nodes[keep].min);
+        nodes[up].max = glm::max(nodes[a].max, nodes[keep].max);
+        nodes[up].height = 1 + std::max(nodes[a].height, nodes[keep].height);
+
+        stats.rotations++;
+        return up;
+    }
+
+    void DynamicAABBTree::queryFrustum(const Frustum& frustum, std::vector<int>& userData) {
+
+        if (root == NULL_NODE) {
+            return;
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        stack.clear();
+        stack.push_back(root);
+
+        while (!stack.empty()) {
+
+            int node = stack.back();
+            stack.pop_back();
+            stats.nodesVisited++;
+
+            glm::vec3 center = (nodes[node].min + nodes[node].max) * 0.5f;
+            glm::vec3 extent = (nodes[node].max - nodes[node].min) * 0.5f;
+            bool outside = false;
+            for (int p = 0; p < 6 && !outside; p++) {
+                float distance = glm::dot(glm::vec3(frustum.planes[p]), center) + frustum.planes[p].w;
+                outside = distance + glm::dot(glm::abs(glm::vec3(frustum.planes[p])), extent) < 0.0f;
+            }
+
+            if (outside) {
+                continue;
+            }
+
+            if (isLeaf(node)) {
+                userData.push_back(nodes[node].userData);
+            } else {
+                stack.push_back(nodes[node].child1);
+                stack.push_back(nodes[node].child2);
+            }
+        }
+
+        stats.queryMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    void DynamicAABBTree::queryOverlap(const glm::vec3& min, const glm::vec3& max, std::vector<int>& userData) {
+
+        if (root == NULL_NODE) {
+            return;
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        stack.clear();
+        stack.push_back(root);
+
+        while (!stack.empty()) {
+
+            int node = stack.back();
+            stack.pop_back();
+            stats.nodesVisited++;
+
+            if (!Overlaps(nodes[node].min, nodes[node].max, min, max)) {
+                continue;
+            }
+
+            if (isLeaf(node)) {
+                userData.push_back(nodes[node].userData);
+            } else {
+                stack.push_back(nodes[node].child1);
+                stack.push_back(nodes[node].child2);
+            }
+        }
+
+        stats.queryMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    int DynamicAABBTree::getHeight() {
+
+        return root == NULL_NODE ? 0 : nodes[root].height;
+    }
+}
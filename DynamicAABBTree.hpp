@@ -0,0 +1,79 @@
+#ifndef DynamicAABBTree_hpp
+#define DynamicAABBTree_hpp
+
+#include "FrustumCuller.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+namespace gps {
+
+    // Counters of the tree, reset by the render loop every frame
+    struct DynamicTreeStats {
+        unsigned int moves;             // moveProxy calls
+        unsigned int reinserts;         // moves that left the fat box and had to remove and insert the leaf
+        unsigned int rotations;         // balancing rotations done by those insertions
+        unsigned int nodesVisited;      // by the queries
+        double updateMs;
+        double queryMs;
+    };
+
+    // Incremental bounding volume tree for objects that move every frame. Leaves hold fat boxes - the object box
+    // grown by a margin - so small moves do not touch the tree; a leaf is only removed and reinserted once its
+    // object leaves the fat box. Insertion picks the sibling with the least surface area increase and AVL style
+    // rotations keep the tree balanced
+    class DynamicAABBTree {
+
+    public:
+        explicit DynamicAABBTree(float margin = 0.5f);
+
+        // Adds an object box and returns its proxy id; userData is reported back by the queries
+        int createProxy(const glm::vec3& min, const glm::vec3& max, int userData);
+
+        void destroyProxy(int proxyId);
+
+        // Updates the object box - returns true when the leaf had to be reinserted
+        bool moveProxy(int proxyId, const glm::vec3& min, const glm::vec3& max);
+
+        // Appends the userData of the proxies whose fat box intersects the frustum
+        void queryFrustum(const Frustum& frustum, std::vector<int>& userData);
+
+        // Appends the userData of the proxies whose fat box overlaps the box
+        void queryOverlap(const glm::vec3& min, const glm::vec3& max, std::vector<int>& userData);
+
+        int getHeight();
+
+        DynamicTreeStats stats;
+
+        static const int NULL_NODE = -1;
+
+    private:
+        struct Node {
+            glm::vec3 min;
+            glm::vec3 max;
+            int parent;         // next free node while on the free list
+            int child1;
+            int child2;
+            int height;         // 0 for leaves, -1 for free nodes
+            int userData;
+        };
+
+        std::vector<Node> nodes;
+        int root;
+        int freeList;
+        float margin;
+        // traversal stack shared by the queries
+        std::vector<int> stack;
+
+        int allocateNode();
+        void freeNode(int node);
+        void insertLeaf(int leaf);
+        void removeLeaf(int leaf);
+        // Rotates the subtree at node when its children heights differ by more than one, returns its new root
+        int balance(int node);
+        bool isLeaf(int node);
+    };
+}
+
+#endif /* DynamicAABBTree_hpp */
@@ -0,0 +1,29 @@
+#include "FrameData.hpp"
+
+#include <cstring>
+
+namespace gps {
+
+    FrameUniformBuffer::~FrameUniformBuffer() {
+
+        if (buffer != 0) {
+            glDeleteBuffers(1, &buffer);
+        }
+    }
+
+    void FrameUniformBuffer::update(const FrameData& data) {
+
+        if (buffer == 0) {
+            glGenBuffers(1, &buffer);
+            glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+            glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), &data, GL_DYNAMIC_DRAW);
+            uploaded = data;
+        } else if (memcmp(&uploaded, &data, sizeof(FrameData)) != 0) {
+            glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+            glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &data);
+            uploaded = data;
+        }
+
+        glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, buffer);
+    }
+}
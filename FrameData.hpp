@@ -0,0 +1,52 @@
+#ifndef FrameData_hpp
+#define FrameData_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+
+namespace gps {
+
+    // Camera and lighting data of one frame, in the std140 layout of the FrameData block
+    // declared by basic.vert, basic.frag and skyboxShader.vert
+    struct FrameData {
+        glm::mat4 view;
+        glm::mat4 projection;
+        glm::mat4 skyboxView;       // view without the translation
+        glm::vec3 lightDir;
+        float padding0;
+        glm::vec3 lightColor;
+        float padding1;
+        glm::vec3 lightPos;
+        GLint isLightActive;        // std140 packs a scalar right after a vec3
+        GLint isFogActive;
+        GLint useTextureArrays;
+        GLint padding2[2];          // the block size is rounded up to 16 bytes
+    };
+
+    // Uniform buffer holding the FrameData, bound once per frame and shared by every program
+    class FrameUniformBuffer {
+
+    public:
+        ~FrameUniformBuffer();
+
+        // Uploads the data when it differs from the last upload and binds the buffer to FRAME_DATA_BINDING,
+        // creating it on first use
+        void update(const FrameData& data);
+
+        // Uniform buffer binding point of the FrameData block
+        static const GLuint FRAME_DATA_BINDING = 0;
+
+    private:
+        GLuint buffer = 0;
+        FrameData uploaded;
+    };
+}
+
+#endif /* FrameData_hpp */
@@ -0,0 +1,80 @@
+#include "FrameSnapshot.hpp"
+
+namespace gps {
+
+    void FrameSnapshotQueue::init(size_t depth) {
+
+        std::lock_guard<std::mutex> lock(mutex);
+        slots.assign(depth < 2 ? 2 : depth, FrameSnapshot());
+        written = 0;
+        read = 0;
+        closed = false;
+        stats = {};
+    }
+
+    FrameSnapshot& FrameSnapshotQueue::beginWrite() {
+
+        std::unique_lock<std::mutex> lock(mutex);
+        if (written - read >= slots.size()) {
+
+            auto waitStart = std::chrono::high_resolution_clock::now();
+            changed.wait(lock, [this]() { return written - read < slots.size(); });
+            stats.writerWaitMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - waitStart).count();
+        }
+        return slots[written % slots.size()];
+    }
+
+    void FrameSnapshotQueue::endWrite() {
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            written++;
+        }
+        changed.notify_all();
+    }
+
+    FrameSnapshot* FrameSnapshotQueue::beginRead() {
+
+        std::unique_lock<std::mutex> lock(mutex);
+        if (read == written && !closed) {
+
+            auto waitStart = std::chrono::high_resolution_clock::now();
+            changed.wait(lock, [this]() { return read < written || closed; });
+            stats.readerWaitMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - waitStart).count();
+        }
+        if (read == written) {
+            return NULL;
+        }
+        return &slots[read % slots.size()];
+    }
+
+    void FrameSnapshotQueue::endRead() {
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            read++;
+        }
+        changed.notify_all();
+    }
+
+    void FrameSnapshotQueue::close() {
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        changed.notify_all();
+    }
+
+    FrameQueueStats FrameSnapshotQueue::getStats() {
+
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+
+    void FrameSnapshotQueue::resetStats() {
+
+        std::lock_guard<std::mutex> lock(mutex);
+        stats = {};
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef FrameSnapshot_hpp
+#define FrameSnapshot_hpp
+
+#include "FrameData.hpp"
+#include "SceneGraph.hpp"
+
+#include <glm/glm.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+namespace gps {
+
+    // Everything drawing a frame reads from the simulation, copied out once the frame is simulated, so the
+    // simulation can go on with the next frame while this one is drawn
+    struct FrameSnapshot {
+        unsigned long long frame;
+        // when the input this frame was simulated from was polled - the start of its latency
+        std::chrono::high_resolution_clock::time_point inputTime;
+        gps::FrameData frameData;
+        // world and world space normal matrices of every scene graph node, by node index
+        std::vector<glm::mat4> worldMatrices;
+        std::vector<glm::mat3> normalMatrices;
+        gps::SceneGraphStats sceneGraphStats;
+        int framebufferWidth;
+        int framebufferHeight;
+        GLenum polygonMode;
+        bool isSmoothShadingActive;
+        bool isFrameStatsActive;
+    };
+
+    // Time the two sides of a FrameSnapshotQueue spent blocked on each other, reset by the render loop
+    struct FrameQueueStats {
+        double writerWaitMs;    // simulation waiting for a free slot - drawing is the bottleneck
+        double readerWaitMs;    // render thread waiting for a frame - simulation is the bottleneck
+    };
+
+    // Ring of depth snapshots handed from the simulation thread to the render thread in order. The slot being drawn
+    // counts as taken, so with 2 slots (double buffering) the simulation runs at most one frame ahead of the frame
+    // on screen and with 3 (triple buffering) two - more slack for uneven frames, one more frame of latency
+    class FrameSnapshotQueue {
+
+    public:
+        void init(size_t depth);
+
+        // Slot for the next frame, waits while every slot is queued or being drawn
+        FrameSnapshot& beginWrite();
+
+        // Hands the slot from beginWrite to the render thread
+        void endWrite();
+
+        // Oldest frame not drawn yet, waits for one. NULL once the queue is closed and every frame is drawn
+        FrameSnapshot* beginRead();
+
+        // Frees the slot from beginRead
+        void endRead();
+
+        // No more frames are coming
+        void close();
+
+        FrameQueueStats getStats();
+
+        void resetStats();
+
+    private:
+        std::vector<FrameSnapshot> slots;
+        unsigned long long written = 0;
+        unsigned long long read = 0;
+        bool closed = false;
+        FrameQueueStats stats = {};
+        std::mutex mutex;
+        std::condition_variable changed;
+    };
+}
+
+#endif /* FrameSnapshot_hpp */
@@ -0,0 +1,210 @@
+#include "FrustumCuller.hpp"
+#include "AVXKernels.hpp"
+#include "JobSystem.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define GPS_HAS_SSE2 1
+#endif
+
+namespace gps {
+
+    Frustum Frustum::FromMatrix(const glm::mat4& viewProjection) {
+
+        // rows of the matrix - glm is column major
+        glm::vec4 row[4];
+        for (int i = 0; i < 4; i++) {
+            row[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+        }
+
+        Frustum frustum;
+        frustum.planes[0] = row[3] + row[0];    // left
+        frustum.planes[1] = row[3] - row[0];    // right
+        frustum.planes[2] = row[3] + row[1];    // bottom
+        frustum.planes[3] = row[3] - row[1];    // top
+        frustum.planes[4] = row[3] + row[2];    // near
+        frustum.planes[5] = row[3] - row[2];    // far
+
+        for (int i = 0; i < 6; i++) {
+            frustum.planes[i] /= glm::length(glm::vec3(frustum.planes[i]));
+        }
+        return frustum;
+    }
+
+    void TransformBounds(const Bounds& local, const glm::mat4& model, glm::vec3& worldCenter, glm::vec3& worldExtent) {
+
+        glm::vec3 center = (local.min + local.max) * 0.5f;
+        glm::vec3 extent = (local.max - local.min) * 0.5f;
+
+        worldCenter = glm::vec3(model * glm::vec4(center, 1.0f));
+        // the extent along each world axis is the sum of the absolute projections of the local axes
+        glm::mat3 linear = glm::mat3(model);
+        worldExtent = glm::abs(linear[0]) * extent.x + glm::abs(linear[1]) * extent.y + glm::abs(linear[2]) * extent.z;
+    }
+
+    void FrustumCuller::clear() {
+
+        centerX.clear();
+        centerY.clear();
+        centerZ.clear();
+        extentX.clear();
+        extentY.clear();
+        extentZ.clear();
+    }
+
+    void FrustumCuller::add(const glm::vec3& center, const glm::vec3& extent) {
+
+        centerX.push_back(center.x);
+        centerY.push_back(center.y);
+        centerZ.push_back(center.z);
+        extentX.push_back(extent.x);
+        extentY.push_back(extent.y);
+        extentZ.push_back(extent.z);
+    }
+
+    void FrustumCuller::getBox(size_t i, glm::vec3& center, glm::vec3& extent) {
+
+        center = glm::vec3(centerX[i], centerY[i], centerZ[i]);
+        extent = glm::vec3(extentX[i], extentY[i], extentZ[i]);
+    }
+
+    size_t FrustumCuller::size() {
+
+        return centerX.size();
+    }
+
+    CULL_PATH FrustumCuller::GetBestPath() {
+
+#if defined(GPS_HAS_AVX_KERNELS)
+        if (CpuHasAVX()) {
+            return CULL_AVX;
+        }
+#endif
+#if defined(GPS_HAS_SSE2)
+        return CULL_SSE;
+#else
+        return CULL_SCALAR;
+#endif
+    }
+
+    const char* FrustumCuller::GetPathName(CULL_PATH path) {
+
+        switch (path) {
+            case CULL_AVX:
+                return "AVX";
+            case CULL_SSE:
+                return "SSE";
+            default:
+                return "scalar";
+        }
+    }
+
+    size_t FrustumCuller::cull(const Frustum& frustum, std::vector<unsigned char>& visible) {
+
+        return cull(frustum, visible, GetBestPath());
+    }
+
+    size_t FrustumCuller::cull(const Frustum& frustum, std::vector<unsigned char>& visible, CULL_PATH path) {
+
+        size_t count = size();
+        visible.resize(count);
+
+        // split in whole batches of 8, so only the very last piece has a scalar tail
+        std::atomic<size_t> visibleCount(0);
+        JobSystem::ParallelFor(0, (count + 7) / 8, CULL_GRAIN / 8, [&](size_t first, size_t end) {
+            visibleCount += cullRange(frustum, visible.data(), path, first * 8, std::min(count, end * 8));
+        });
+        return visibleCount;
+    }
+
+    size_t FrustumCuller::cullRange(const Frustum& frustum, unsigned char* visible, CULL_PATH path, size_t first, size_t end) {
+
+        size_t visibleCount = 0;
+
+        // a box is outside when it lies entirely behind one plane:
+        // dot(normal, center) + distance < -(|normal.x| * extent.x + |normal.y| * extent.y + |normal.z| * extent.z)
+
+#if defined(GPS_HAS_AVX_KERNELS)
+        if (path == CULL_AVX) {
+
+            const float* boxes[6] = { centerX.data(), centerY.data(), centerZ.data(), extentX.data(), extentY.data(), extentZ.data() };
+            float planes[6][4];
+            for (int p = 0; p < 6; p++) {
+                for (int k = 0; k < 4; k++) {
+                    planes[p][k] = frustum.planes[p][k];
+                }
+            }
+            first = CullBoxesAVX(boxes, planes, visible, first, end, visibleCount);
+        }
+#endif
+
+#if defined(GPS_HAS_SSE2)
+        if (path == CULL_SSE || path == CULL_AVX) {
+
+            for (; first + 4 <= end; first += 4) {
+
+                __m128 cx = _mm_loadu_ps(&centerX[first]);
+                __m128 cy = _mm_loadu_ps(&centerY[first]);
+                __m128 cz = _mm_loadu_ps(&centerZ[first]);
+                __m128 ex = _mm_loadu_ps(&extentX[first]);
+                __m128 ey = _mm_loadu_ps(&extentY[first]);
+                __m128 ez = _mm_loadu_ps(&extentZ[first]);
+                __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+                for (int p = 0; p < 6; p++) {
+
+                    const glm::vec4& plane = frustum.planes[p];
+                    __m128 distance = _mm_add_ps(_mm_add_ps(
+                        _mm_mul_ps(cx, _mm_set1_ps(plane.x)),
+                        _mm_mul_ps(cy, _mm_set1_ps(plane.y))),
+                        _mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+                    __m128 radius = _mm_add_ps(_mm_add_ps(
+                        _mm_mul_ps(ex, _mm_set1_ps(std::fabs(plane.x))),
+                        _mm_mul_ps(ey, _mm_set1_ps(std::fabs(plane.y)))),
+                        _mm_mul_ps(ez, _mm_set1_ps(std::fabs(plane.z))));
+                    inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+
+                    // all 4 outside already
+                    if (_mm_movemask_ps(inside) == 0) {
+                        break;
+                    }
+                }
+
+                int mask = _mm_movemask_ps(inside);
+                for (int k = 0; k < 4; k++) {
+                    visible[first + k] = (unsigned char)((mask >> k) & 1);
+                    visibleCount += (mask >> k) & 1;
+                }
+            }
+        }
+#endif
+
+        // the remainder, or everything on the scalar path
+        return visibleCount + cullScalar(frustum, visible, first, end);
+    }
+
+    size_t FrustumCuller::cullScalar(const Frustum& frustum, unsigned char* visible, size_t first, size_t end) {
+
+        size_t visibleCount = 0;
+
+        for (size_t i = first; i < end; i++) {
+
+            unsigned char inside = 1;
+            for (int p = 0; p < 6 && inside; p++) {
+
+                const glm::vec4& plane = frustum.planes[p];
+                float distance = plane.x * centerX[i] + plane.y * centerY[i] + plane.z * centerZ[i] + plane.w;
+                float radius = std::fabs(plane.x) * extentX[i] + std::fabs(plane.y) * extentY[i] + std::fabs(plane.z) * extentZ[i];
+                inside = distance + radius >= 0.0f;
+            }
+
+            visible[i] = inside;
+            visibleCount += inside;
+        }
+        return visibleCount;
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef FrustumCuller_hpp
+#define FrustumCuller_hpp
+
+#include "Mesh.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+namespace gps {
+
+    // Instruction sets the culler can test boxes with - 1, 4 or 8 boxes per step
+    enum CULL_PATH {CULL_SCALAR, CULL_SSE, CULL_AVX};
+
+    // Six normalized planes (xyz - normal pointing inside, w - distance) of a view volume
+    struct Frustum {
+        glm::vec4 planes[6];
+
+        // Extracts the planes of the clip volume of projection * view
+        static Frustum FromMatrix(const glm::mat4& viewProjection);
+    };
+
+    // World space box of a mesh placed with the given model matrix
+    void TransformBounds(const Bounds& local, const glm::mat4& model, glm::vec3& worldCenter, glm::vec3& worldExtent);
+
+    // Axis aligned boxes stored as structure of arrays (center and half extent per axis), so the plane
+    // tests run on 4 (SSE) or 8 (AVX) boxes at once
+    class FrustumCuller {
+
+    public:
+        void clear();
+
+        void add(const glm::vec3& center, const glm::vec3& extent);
+
+        size_t size();
+
+        // Box i as it was added
+        void getBox(size_t i, glm::vec3& center, glm::vec3& extent);
+
+        // Sets visible[i] to 1 for the boxes intersecting the frustum and to 0 for the others,
+        // returns the number of visible boxes. Large sets are spread over the job system's workers
+        size_t cull(const Frustum& frustum, std::vector<unsigned char>& visible);
+
+        size_t cull(const Frustum& frustum, std::vector<unsigned char>& visible, CULL_PATH path);
+
+        // Widest path compiled in that the CPU runs - AVX is checked at run time
+        static CULL_PATH GetBestPath();
+
+        static const char* GetPathName(CULL_PATH path);
+
+    private:
+        std::vector<float> centerX, centerY, centerZ;
+        std::vector<float> extentX, extentY, extentZ;
+
+        // Boxes per job
+        static const size_t CULL_GRAIN = 16384;
+
+        // Tests the boxes [first, end), 8 or 4 at a time on the SIMD paths
+        size_t cullRange(const Frustum& frustum, unsigned char* visible, CULL_PATH path, size_t first, size_t end);
+
+        // Tests the boxes [first, end) one at a time
+        size_t cullScalar(const Frustum& frustum, unsigned char* visible, size_t first, size_t end);
+    };
+}
+
+#endif /* FrustumCuller_hpp */
@@ -0,0 +1,181 @@
+#include "GLState.hpp"
+
+namespace gps {
+
+    StateStats GLState::stats = {};
+
+    GLuint GLState::program = GLState::UNKNOWN;
+    GLuint GLState::vertexArray = GLState::UNKNOWN;
+    GLuint GLState::activeTextureUnit = GLState::UNKNOWN;
+    GLuint GLState::textures[GLState::MAX_TEXTURE_UNITS][GLState::TARGET_COUNT];
+    GLuint GLState::capabilities[GLState::CAP_COUNT];
+    GLuint GLState::blendSource = GLState::UNKNOWN;
+    GLuint GLState::blendDestination = GLState::UNKNOWN;
+    GLuint GLState::depthFunction = GLState::UNKNOWN;
+    GLuint GLState::polygonFillMode = GLState::UNKNOWN;
+
+    // the static arrays start out zeroed, which would read as "known to be 0"
+    static struct GLStateInitializer {
+        GLStateInitializer() {
+            GLState::invalidate();
+        }
+    } glStateInitializer;
+
+    bool GLState::update(GLuint& cached, GLuint value) {
+
+        if (cached == value) {
+            stats.filtered++;
+            return false;
+        }
+
+        cached = value;
+        stats.issued++;
+        return true;
+    }
+
+    void GLState::useProgram(GLuint program) {
+
+        if (update(GLState::program, program)) {
+            glUseProgram(program);
+        }
+    }
+
+    void GLState::bindVertexArray(GLuint vertexArray) {
+
+        if (update(GLState::vertexArray, vertexArray)) {
+            glBindVertexArray(vertexArray);
+        }
+    }
+
+    void GLState::bindTexture(GLuint unit, GLenum target, GLuint texture) {
+
+        int targetSlot = targetIndex(target);
+        if (unit >= MAX_TEXTURE_UNITS || targetSlot < 0) {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            glBindTexture(target, texture);
+            activeTextureUnit = unit;
+            stats.issued += 2;
+            stats.textureBinds++;
+            return;
+        }
+
+        if (textures[unit][targetSlot] == texture) {
+            stats.filtered++;
+            return;
+        }
+
+        if (update(activeTextureUnit, unit)) {
+            glActiveTexture(GL_TEXTURE0 + unit);
+        }
+        update(textures[unit][targetSlot], texture);
+        glBindTexture(target, texture);
+        stats.textureBinds++;
+    }
+
+    void GLState::enable(GLenum capability) {
+
+        setCapability(capability, true);
+    }
+
+    void GLState::disable(GLenum capability) {
+
+        setCapability(capability, false);
+    }
+
+    void GLState::setCapability(GLenum capability, bool enabled) {
+
+        int index = capabilityIndex(capability);
+        if (index >= 0 && !update(capabilities[index], enabled ? 1 : 0)) {
+            return;
+        }
+        if (index < 0) {
+            stats.issued++;
+        }
+
+        if (enabled) {
+            glEnable(capability);
+        } else {
+            glDisable(capability);
+        }
+    }
+
+    void GLState::blendFunc(GLenum sourceFactor, GLenum destinationFactor) {
+
+        if (blendSource == sourceFactor && blendDestination == destinationFactor) {
+            stats.filtered++;
+            return;
+        }
+
+        blendSource = sourceFactor;
+        blendDestination = destinationFactor;
+        stats.issued++;
+        glBlendFunc(sourceFactor, destinationFactor);
+    }
+
+    void GLState::depthFunc(GLenum function) {
+
+        if (update(depthFunction, function)) {
+            glDepthFunc(function);
+        }
+    }
+
+    void GLState::polygonMode(GLenum mode) {
+
+        if (update(polygonFillMode, mode)) {
+            glPolygonMode(GL_FRONT_AND_BACK, mode);
+        }
+    }
+
+    void GLState::invalidate() {
+
+        program = UNKNOWN;
+        vertexArray = UNKNOWN;
+        activeTextureUnit = UNKNOWN;
+        for (GLuint unit = 0; unit < MAX_TEXTURE_UNITS; unit++) {
+            for (int target = 0; target < TARGET_COUNT; target++) {
+                textures[unit][target] = UNKNOWN;
+            }
+        }
+        for (int capability = 0; capability < CAP_COUNT; capability++) {
+            capabilities[capability] = UNKNOWN;
+        }
+        blendSource = UNKNOWN;
+        blendDestination = UNKNOWN;
+        depthFunction = UNKNOWN;
+        polygonFillMode = UNKNOWN;
+    }
+
+    int GLState::capabilityIndex(GLenum capability) {
+
+        switch (capability) {
+            case GL_BLEND:
+                return CAP_BLEND;
+            case GL_DEPTH_TEST:
+                return CAP_DEPTH_TEST;
+            case GL_CULL_FACE:
+                return CAP_CULL_FACE;
+            case GL_POLYGON_SMOOTH:
+                return CAP_POLYGON_SMOOTH;
+            case GL_FRAMEBUFFER_SRGB:
+                return CAP_FRAMEBUFFER_SRGB;
+            default:
+                return -1;
+        }
+    }
+
+    int GLState::targetIndex(GLenum target) {
+
+        switch (target) {
+            case GL_TEXTURE_2D:
+                return TARGET_2D;
+            case GL_TEXTURE_2D_ARRAY:
+                return TARGET_2D_ARRAY;
+            case GL_TEXTURE_CUBE_MAP:
+                return TARGET_CUBE_MAP;
+            case GL_TEXTURE_BUFFER:
+                return TARGET_BUFFER;
+            default:
+                return -1;
+        }
+    }
+}
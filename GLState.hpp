@@ -0,0 +1,73 @@
+#ifndef GLState_hpp
+#define GLState_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+namespace gps {
+
+    // State changes sent to the driver and dropped as no-ops, reset by the render loop every frame
+    struct StateStats {
+        unsigned int issued;
+        unsigned int filtered;
+        unsigned int textureBinds;
+    };
+
+    // Shadow of the GL state touched by the renderer. Every module changes program, VAO, texture,
+    // blend, depth and polygon mode state through here, so calls that would not change anything are dropped
+    class GLState {
+
+    public:
+        static void useProgram(GLuint program);
+        static void bindVertexArray(GLuint vertexArray);
+        // Binds a texture to a unit, switching the active texture unit only when needed
+        static void bindTexture(GLuint unit, GLenum target, GLuint texture);
+
+        // GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE, GL_POLYGON_SMOOTH and GL_FRAMEBUFFER_SRGB are tracked,
+        // other capabilities are passed straight through
+        static void enable(GLenum capability);
+        static void disable(GLenum capability);
+
+        static void blendFunc(GLenum sourceFactor, GLenum destinationFactor);
+        static void depthFunc(GLenum function);
+        // Core profile only allows GL_FRONT_AND_BACK
+        static void polygonMode(GLenum mode);
+
+        // Forgets everything - for code that changed GL state without going through this class
+        static void invalidate();
+
+        static StateStats stats;
+
+        static const GLuint MAX_TEXTURE_UNITS = 16;
+
+    private:
+        enum CAPABILITY {CAP_BLEND, CAP_DEPTH_TEST, CAP_CULL_FACE, CAP_POLYGON_SMOOTH, CAP_FRAMEBUFFER_SRGB, CAP_COUNT};
+        enum TEXTURE_TARGET {TARGET_2D, TARGET_2D_ARRAY, TARGET_CUBE_MAP, TARGET_BUFFER, TARGET_COUNT};
+
+        // 0xFFFFFFFF marks a value that is not known yet and has to be sent
+        static const GLuint UNKNOWN = 0xFFFFFFFFu;
+
+        static GLuint program;
+        static GLuint vertexArray;
+        static GLuint activeTextureUnit;
+        static GLuint textures[MAX_TEXTURE_UNITS][TARGET_COUNT];
+        static GLuint capabilities[CAP_COUNT];
+        static GLuint blendSource;
+        static GLuint blendDestination;
+        static GLuint depthFunction;
+        static GLuint polygonFillMode;
+
+        static int capabilityIndex(GLenum capability);
+        static int targetIndex(GLenum target);
+        static void setCapability(GLenum capability, bool enabled);
+        // Returns true (and counts an issued call) when the cached value changes
+        static bool update(GLuint& cached, GLuint value);
+    };
+}
+
+#endif /* GLState_hpp */
@@ -0,0 +1,271 @@
+#include "GPUCuller.hpp"
+#include "GLState.hpp"
+#include "Model3D.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace gps {
+
+    bool GPUCuller::useGPUCulling = false;
+
+    // local_size_x of cull.comp, local_size_x and _y of hiz.comp
+    static const GLuint CULL_GROUP_SIZE = 64;
+    static const GLuint HIZ_GROUP_SIZE = 8;
+
+    GPUCuller::~GPUCuller() {
+
+        GLuint buffers[] = { itemBuffer, commandBuffer, countBuffer };
+        GLuint textures[] = { depthTexture, pyramidTexture };
+        if (itemBuffer != 0) {
+            glDeleteBuffers(3, buffers);
+        }
+        if (depthTexture != 0) {
+            glDeleteTextures(2, textures);
+        }
+        if (depthFramebuffer != 0) {
+            glDeleteFramebuffers(1, &depthFramebuffer);
+        }
+        for (size_t slot = 0; slot < READBACK_SLOTS; slot++) {
+            if (readbackFences[slot] != NULL) {
+                glDeleteSync(readbackFences[slot]);
+            }
+        }
+        if (readbackBuffers[0] != 0) {
+            glDeleteBuffers((GLsizei)READBACK_SLOTS, readbackBuffers);
+        }
+    }
+
+    void GPUCuller::SetUseGPUCulling(bool enabled) {
+
+#if defined (__APPLE__)
+        useGPUCulling = false;
+#else
+        useGPUCulling = enabled && GLEW_VERSION_4_3 && Model3D::GetUseMultiDrawIndirect();
+#endif
+        if (enabled && !useGPUCulling) {
+            std::cout << "OpenGL 4.3 or multi-draw-indirect not available, draws are culled on the CPU" << std::endl;
+        }
+    }
+
+    bool GPUCuller::GetUseGPUCulling() {
+
+        return useGPUCulling;
+    }
+
+    void GPUCuller::init() {
+
+        if (itemBuffer != 0) {
+            return;
+        }
+
+        cullShader.loadComputeShader("shaders/cull.comp");
+        copyDepthShader.loadComputeShader("shaders/hiz.comp", "#define HIZ_FROM_DEPTH");
+        reduceDepthShader.loadComputeShader("shaders/hiz.comp");
+
+        glGenBuffers(1, &itemBuffer);
+        glGenBuffers(1, &commandBuffer);
+        glGenBuffers(1, &countBuffer);
+
+        glGenBuffers((GLsizei)READBACK_SLOTS, readbackBuffers);
+        for (size_t slot = 0; slot < READBACK_SLOTS; slot++) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, readbackBuffers[slot]);
+            glBufferData(GL_COPY_WRITE_BUFFER, 2 * sizeof(GLuint), NULL, GL_STREAM_READ);
+        }
+    }
+
+    void GPUCuller::collectVisibleCounts() {
+
+        for (size_t slot = 0; slot < READBACK_SLOTS; slot++) {
+            if (readbackFences[slot] == NULL || glClientWaitSync(readbackFences[slot], 0, 0) == GL_TIMEOUT_EXPIRED) {
+                continue;
+            }
+
+            GLuint counts[2] = {};
+            glBindBuffer(GL_COPY_READ_BUFFER, readbackBuffers[slot]);
+            glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(counts), counts);
+            stats.visible += counts[0];
+            stats.triangles += counts[1];
+
+            glDeleteSync(readbackFences[slot]);
+            readbackFences[slot] = NULL;
+        }
+    }
+
+    void GPUCuller::cull(const std::vector<CullItem>& items, GLuint batchCount, const Frustum& frustum) {
+
+#if not defined (__APPLE__)
+        init();
+
+        collectVisibleCounts();
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, itemBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, items.size() * sizeof(CullItem), items.data(), GL_STREAM_DRAW);
+
+        // zeroed commands are skipped by the draw, so a range's unused tail costs nothing without ARB_indirect_parameters
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, items.size() * sizeof(DrawElementsIndirectCommand), NULL, GL_STREAM_DRAW);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, (2 + batchCount) * sizeof(GLuint), NULL, GL_STREAM_DRAW);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, itemBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, commandBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, countBuffer);
+
+        cullShader.useShaderProgram();
+        cullShader.setInt("itemCount", (GLint)items.size());
+        glProgramUniform4fv(cullShader.shaderProgram, cullShader.getUniformLocation("planes"), 6, &frustum.planes[0].x);
+        cullShader.setBool("useHiZ", hasPyramid);
+        if (hasPyramid) {
+            cullShader.setMat4("hizViewProjection", pyramidViewProjection);
+            cullShader.setInt("hizLevels", pyramidLevels);
+            GLint unit = cullShader.getSamplerUnit("hiz");
+            if (unit >= 0) {
+                GLState::bindTexture(unit, GL_TEXTURE_2D, pyramidTexture);
+            }
+        }
+
+        glDispatchCompute(((GLuint)items.size() + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        if (GLEW_ARB_indirect_parameters) {
+            glBindBuffer(GL_PARAMETER_BUFFER_ARB, countBuffer);
+        }
+
+        // the visible draw and triangle totals go to a small buffer of their own, read back frames later by collectVisibleCounts
+        if (readbackFences[readbackSlot] != NULL) {
+            glDeleteSync(readbackFences[readbackSlot]);
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, countBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, readbackBuffers[readbackSlot]);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, 2 * sizeof(GLuint));
+        readbackFences[readbackSlot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        readbackSlot = (readbackSlot + 1) % READBACK_SLOTS;
+
+        stats.tested += (unsigned int)items.size();
+        stats.dispatches++;
+#endif
+    }
+
+    void GPUCuller::drawBatch(GLuint batch, GLuint firstCommand, GLsizei maxCount) {
+
+#if not defined (__APPLE__)
+        const GLvoid* commands = (const GLvoid*)(firstCommand * sizeof(DrawElementsIndirectCommand));
+        if (GLEW_ARB_indirect_parameters) {
+            glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, GL_UNSIGNED_INT, commands, (GLintptr)((2 + batch) * sizeof(GLuint)), maxCount, 0);
+        } else {
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, commands, maxCount, 0);
+        }
+#endif
+    }
+
+    void GPUCuller::buildDepthPyramid(const glm::mat4& viewProjection) {
+
+#if not defined (__APPLE__)
+        init();
+
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        if (viewport[2] <= 0 || viewport[3] <= 0) {
+            return;
+        }
+        if (viewport[2] != pyramidWidth || viewport[3] != pyramidHeight) {
+            resizePyramid(viewport[2], viewport[3]);
+        }
+
+        // the window is multisampled (GLFW_SAMPLES), which glCopyTexSubImage2D cannot read - a depth blit resolves
+        // it, but only between equal rectangles and from a 24-bit depth buffer like the copy's
+        GLint readFramebuffer = 0;
+        GLint drawFramebuffer = 0;
+        GLint sampleBuffers = 0;
+        GLint depthBits = 0;
+        glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFramebuffer);
+        glGetIntegerv(GL_SAMPLE_BUFFERS, &sampleBuffers);
+        glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, readFramebuffer == 0 ? GL_DEPTH : GL_DEPTH_ATTACHMENT,
+            GL_FRAMEBUFFER_ATTACHMENT_DEPTH_SIZE, &depthBits);
+        if (depthBits != 24 || (sampleBuffers != 0 && (viewport[0] != 0 || viewport[1] != 0))) {
+            hasPyramid = false;
+            return;
+        }
+
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depthFramebuffer);
+        glBlitFramebuffer(viewport[0], viewport[1], viewport[0] + pyramidWidth, viewport[1] + pyramidHeight,
+            0, 0, pyramidWidth, pyramidHeight, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        bool resolved = glGetError() == GL_NO_ERROR;
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFramebuffer);
+        if (!resolved) {
+            hasPyramid = false;
+            return;
+        }
+
+        copyDepthShader.useShaderProgram();
+        GLint unit = copyDepthShader.getSamplerUnit("depthTexture");
+        if (unit >= 0) {
+            GLState::bindTexture(unit, GL_TEXTURE_2D, depthTexture);
+        }
+        glBindImageTexture(1, pyramidTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        glDispatchCompute((pyramidWidth + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, (pyramidHeight + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, 1);
+
+        reduceDepthShader.useShaderProgram();
+        for (GLint level = 1; level < pyramidLevels; level++) {
+
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+            GLsizei width = std::max(1, pyramidWidth >> level);
+            GLsizei height = std::max(1, pyramidHeight >> level);
+            glBindImageTexture(0, pyramidTexture, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+            glBindImageTexture(1, pyramidTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+            glDispatchCompute((width + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, (height + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, 1);
+        }
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+        pyramidViewProjection = viewProjection;
+        hasPyramid = true;
+#endif
+    }
+
+    void GPUCuller::resizePyramid(GLsizei width, GLsizei height) {
+
+#if not defined (__APPLE__)
+        if (depthTexture != 0) {
+            GLuint textures[] = { depthTexture, pyramidTexture };
+            glDeleteTextures(2, textures);
+            // deleted textures are unbound from every unit behind the state cache's back
+            GLState::invalidate();
+        }
+
+        pyramidWidth = width;
+        pyramidHeight = height;
+        pyramidLevels = 1 + (GLint)std::floor(std::log2((float)std::max(width, height)));
+
+        glGenTextures(1, &depthTexture);
+        GLState::bindTexture(0, GL_TEXTURE_2D, depthTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        // single sampled target the frame's depth is resolved into
+        if (depthFramebuffer == 0) {
+            glGenFramebuffers(1, &depthFramebuffer);
+        }
+        GLint drawFramebuffer = 0;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFramebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depthFramebuffer);
+        glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+        glDrawBuffer(GL_NONE);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFramebuffer);
+
+        glGenTextures(1, &pyramidTexture);
+        GLState::bindTexture(0, GL_TEXTURE_2D, pyramidTexture);
+        glTexStorage2D(GL_TEXTURE_2D, pyramidLevels, GL_R32F, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        hasPyramid = false;
+#endif
+    }
+}
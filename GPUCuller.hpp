@@ -0,0 +1,92 @@
+#ifndef GPUCuller_hpp
+#define GPUCuller_hpp
+
+#include "FrustumCuller.hpp"
+#include "Shader.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+namespace gps {
+
+    // Per-frame counters of the GPU culling path
+    struct GPUCullStats {
+        unsigned int tested;        // boxes dispatched to the cull shader
+        unsigned int visible;       // of those, drawn - read back once their fence passed, so the CPU never waits on the shader
+        unsigned int triangles;     // in the drawn ones, read back with them
+        unsigned int dispatches;
+    };
+
+    // One draw for the cull shader, laid out as its std430 CullItem
+    struct CullItem {
+        glm::vec3 center;
+        GLuint batch;               // multi-draw batch the draw belongs to
+        glm::vec3 extent;
+        GLuint batchStart;          // first command of that batch in the indirect buffer
+        DrawElementsIndirectCommand command;
+        GLuint padding[3];
+    };
+
+    // Frustum and hierarchical-Z culling in a compute shader. The visible draws of every batch are compacted to
+    // the front of the batch's range of the indirect buffer, and the GPU's own per-batch count decides how many
+    // are drawn (ARB_indirect_parameters). Without that extension the unused commands of a range stay zeroed and
+    // the whole range is submitted. Needs OpenGL 4.3 (Mesa llvmpipe qualifies), never available on Apple
+    class GPUCuller {
+
+    public:
+        ~GPUCuller();
+
+        // Also needs the multi-draw-indirect path on - falls back to CPU culling otherwise
+        static void SetUseGPUCulling(bool enabled);
+        static bool GetUseGPUCulling();
+
+        // Uploads the draws of batchCount batches, runs the cull shader and leaves the compacted commands in the
+        // indirect buffer bound to GL_DRAW_INDIRECT_BUFFER
+        void cull(const std::vector<CullItem>& items, GLuint batchCount, const Frustum& frustum);
+
+        // Submits the visible commands of a batch, whose range starts at firstCommand and holds at most maxCount
+        void drawBatch(GLuint batch, GLuint firstCommand, GLsizei maxCount);
+
+        // Resolves the depth buffer the frame was drawn into and reduces it to the pyramid the next frame's draws are
+        // tested against - viewProjection is the matrix the frame was rendered with. When the depth cannot be
+        // resolved the next frame is culled against the frustum only
+        void buildDepthPyramid(const glm::mat4& viewProjection);
+
+        GPUCullStats stats = {};
+
+    private:
+        static bool useGPUCulling;
+
+        gps::Shader cullShader;
+        gps::Shader copyDepthShader;
+        gps::Shader reduceDepthShader;
+        GLuint itemBuffer = 0;
+        GLuint commandBuffer = 0;
+        GLuint countBuffer = 0;
+        GLuint depthTexture = 0;
+        GLuint depthFramebuffer = 0;
+        GLuint pyramidTexture = 0;
+        GLsizei pyramidWidth = 0;
+        GLsizei pyramidHeight = 0;
+        GLint pyramidLevels = 0;
+        bool hasPyramid = false;
+        glm::mat4 pyramidViewProjection;
+        // Copies of the visible count of the last dispatches, each read once its fence has signaled. A count still
+        // in flight when its slot comes round again is dropped rather than waited on
+        static const size_t READBACK_SLOTS = 3;
+        GLuint readbackBuffers[READBACK_SLOTS] = {};
+        GLsync readbackFences[READBACK_SLOTS] = {};
+        size_t readbackSlot = 0;
+
+        // Adds the visible counts whose copies have landed to the stats, without blocking
+        void collectVisibleCounts();
+
+        // Loads the shaders and creates the buffers on first use
+        void init();
+        // (Re)creates the depth copy and the pyramid for a framebuffer of the given size
+        void resizePyramid(GLsizei width, GLsizei height);
+    };
+}
+
+#endif /* GPUCuller_hpp */
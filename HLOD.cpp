@@ -0,0 +1,288 @@
+#include "HLOD.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <tuple>
+
+namespace gps {
+
+    // Reduces the diffuse texture of a mesh to a TILE_SIZE square, by reading back the first mip level that small
+    // and resampling it. Meshes without a diffuse texture sample black, the same as on the regular path
+    static void ReadTextureTile(const Texture* texture, std::vector<unsigned char>& tile) {
+
+        const int tileSize = HLOD::TILE_SIZE;
+        tile.assign((size_t)tileSize * tileSize * 4, 0);
+        for (size_t i = 3; i < tile.size(); i += 4) {
+            tile[i] = 255;
+        }
+        if (texture == NULL || (texture->id == 0 && texture->arrayId == 0)) {
+            return;
+        }
+
+        GLenum target = texture->arrayId != 0 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+        GLState::bindTexture(0, target, texture->arrayId != 0 ? texture->arrayId : texture->id);
+
+        GLint level = 0;
+        GLint width = 0;
+        GLint height = 0;
+        GLint layers = 1;
+        for (;; level++) {
+
+            glGetTexLevelParameteriv(target, level, GL_TEXTURE_WIDTH, &width);
+            glGetTexLevelParameteriv(target, level, GL_TEXTURE_HEIGHT, &height);
+            if ((width <= tileSize && height <= tileSize) || width <= 1 || height <= 1) {
+                break;
+            }
+        }
+        if (width <= 0 || height <= 0) {
+            return;
+        }
+        if (target == GL_TEXTURE_2D_ARRAY) {
+            glGetTexLevelParameteriv(target, level, GL_TEXTURE_DEPTH, &layers);
+        }
+
+        // an array level comes back with all of its layers
+        std::vector<unsigned char> pixels((size_t)width * height * layers * 4);
+        glGetTexImage(target, level, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        size_t layerOffset = target == GL_TEXTURE_2D_ARRAY ? (size_t)texture->layer * width * height * 4 : 0;
+
+        for (int y = 0; y < tileSize; y++) {
+            for (int x = 0; x < tileSize; x++) {
+
+                size_t source = layerOffset + ((size_t)(y * height / tileSize) * width + (x * width / tileSize)) * 4;
+                std::copy(&pixels[source], &pixels[source] + 4, &tile[((size_t)y * tileSize + x) * 4]);
+            }
+        }
+    }
+
+    static const Texture* FindDiffuseTexture(const Mesh& mesh) {
+
+        for (size_t i = 0; i < mesh.textures.size(); i++) {
+            if (mesh.textures[i].type == "diffuseTexture") {
+                return &mesh.textures[i];
+            }
+        }
+        return NULL;
+    }
+
+    HLOD::~HLOD() {
+
+        release();
+    }
+
+    void HLOD::release() {
+
+        bool deleted = !proxies.empty() || atlas != 0;
+        for (size_t i = 0; i < proxies.size(); i++) {
+
+            Buffers buffers = proxies[i].getBuffers();
+            glDeleteBuffers(1, &buffers.VBO);
+            glDeleteBuffers(1, &buffers.EBO);
+            glDeleteVertexArrays(1, &buffers.VAO);
+        }
+
+        if (atlas != 0) {
+            glDeleteTextures(1, &atlas);
+            atlas = 0;
+        }
+
+        // deleted objects are unbound behind the state cache's back, and their names come back on a rebuild
+        if (deleted) {
+            GLState::invalidate();
+        }
+
+        cells.clear();
+        proxies.clear();
+        meshCells.clear();
+    }
+
+    void HLOD::build(const std::vector<Mesh>& meshes, float cellSize) {
+
+        // a rebuild replaces the proxies and atlas of the previous one
+        release();
+        meshCells.assign(meshes.size(), -1);
+
+        // small meshes by the cell of their center
+        std::map<std::tuple<int, int, int>, std::vector<GLuint>> grid;
+        for (size_t i = 0; i < meshes.size(); i++) {
+
+            const Bounds& bounds = meshes[i].bounds;
+            if (bounds.radius > cellSize * 0.5f || meshes[i].indices.empty()) {
+                continue;
+            }
+
+            glm::vec3 cell = glm::floor(bounds.center / cellSize);
+            grid[std::make_tuple((int)cell.x, (int)cell.y, (int)cell.z)].push_back((GLuint)i);
+        }
+
+        // one tile per distinct diffuse texture (name or array layer) of the cells that get a proxy
+        std::map<std::pair<GLuint, GLint>, int> tiles;
+        std::vector<int> meshTiles(meshes.size(), 0);
+        for (auto& cell : grid) {
+
+            if (cell.second.size() < MIN_CELL_MEMBERS) {
+                continue;
+            }
+
+            for (GLuint member : cell.second) {
+
+                const Texture* texture = FindDiffuseTexture(meshes[member]);
+                std::pair<GLuint, GLint> key(0, -1);
+                if (texture != NULL) {
+                    key = texture->arrayId != 0 ? std::make_pair(texture->arrayId, texture->layer) : std::make_pair(texture->id, (GLint)-1);
+                }
+                auto found = tiles.find(key);
+                if (found == tiles.end()) {
+                    found = tiles.insert(std::make_pair(key, (int)tiles.size())).first;
+                }
+                meshTiles[member] = found->second;
+            }
+        }
+        if (tiles.empty()) {
+            return;
+        }
+
+        int tilesPerRow = (int)std::ceil(std::sqrt((double)tiles.size()));
+        atlasWidth = tilesPerRow * TILE_SIZE;
+        atlasHeight = (int)((tiles.size() + tilesPerRow - 1) / tilesPerRow) * TILE_SIZE;
+        std::vector<unsigned char> atlasPixels((size_t)atlasWidth * atlasHeight * 4);
+        std::vector<bool> tileRead(tiles.size(), false);
+        std::vector<unsigned char> tile;
+
+        for (auto& cell : grid) {
+
+            if (cell.second.size() < MIN_CELL_MEMBERS) {
+                continue;
+            }
+            for (GLuint member : cell.second) {
+
+                int index = meshTiles[member];
+                if (tileRead[index]) {
+                    continue;
+                }
+                tileRead[index] = true;
+
+                ReadTextureTile(FindDiffuseTexture(meshes[member]), tile);
+                int tileX = (index % tilesPerRow) * TILE_SIZE;
+                int tileY = (index / tilesPerRow) * TILE_SIZE;
+                for (int row = 0; row < TILE_SIZE; row++) {
+                    std::copy(&tile[(size_t)row * TILE_SIZE * 4], &tile[(size_t)(row + 1) * TILE_SIZE * 4],
+                              &atlasPixels[((size_t)(tileY + row) * atlasWidth + tileX) * 4]);
+                }
+            }
+        }
+
+        glGenTextures(1, &atlas);
+        GLState::bindTexture(0, GL_TEXTURE_2D, atlas);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, atlasWidth, atlasHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, atlasPixels.data());
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        Texture atlasTexture = {};
+        atlasTexture.id = atlas;
+        atlasTexture.type = "diffuseTexture";
+        atlasTexture.path = "<hlod atlas>";
+        atlasTexture.width = atlasWidth;
+        atlasTexture.height = atlasHeight;
+
+        size_t replaced = 0;
+        for (auto& cell : grid) {
+
+            if (cell.second.size() < MIN_CELL_MEMBERS) {
+                continue;
+            }
+
+            HLODCell hlodCell = {};
+            hlodCell.members = cell.second;
+            // one atlas texel spread over the cell bounds the texture error
+            hlodCell.error = cellSize / TILE_SIZE;
+
+            std::vector<Vertex> vertices;
+            std::vector<GLuint> indices;
+            std::vector<GLuint> remap;
+            for (size_t m = 0; m < cell.second.size(); m++) {
+
+                const Mesh& mesh = meshes[cell.second[m]];
+                const MeshLOD& lod = mesh.lods.back();
+                const GLuint* lodIndices = lod.firstIndex < mesh.indices.size()
+                    ? &mesh.indices[lod.firstIndex] : &mesh.lodIndices[lod.firstIndex - mesh.indices.size()];
+                hlodCell.error = std::max(hlodCell.error, lod.error);
+
+                hlodCell.bounds.min = m == 0 ? mesh.bounds.min : glm::min(hlodCell.bounds.min, mesh.bounds.min);
+                hlodCell.bounds.max = m == 0 ? mesh.bounds.max : glm::max(hlodCell.bounds.max, mesh.bounds.max);
+
+                // texture coordinates inside [0, 1] map into the tile, repeating ones to the tile's middle texel
+                bool unitCoordinates = true;
+                for (GLuint i = 0; i < lod.indexCount; i++) {
+                    glm::vec2 uv = mesh.vertices[lodIndices[i]].TexCoords;
+                    unitCoordinates = unitCoordinates && uv.x >= -1e-3f && uv.x <= 1.001f && uv.y >= -1e-3f && uv.y <= 1.001f;
+                }
+
+                int index = meshTiles[cell.second[m]];
+                glm::vec2 tileOrigin((float)((index % tilesPerRow) * TILE_SIZE), (float)((index / tilesPerRow) * TILE_SIZE));
+                glm::vec2 atlasSize((float)atlasWidth, (float)atlasHeight);
+
+                remap.assign(mesh.vertices.size(), 0xFFFFFFFFu);
+                for (GLuint i = 0; i < lod.indexCount; i++) {
+
+                    GLuint source = lodIndices[i];
+                    if (remap[source] == 0xFFFFFFFFu) {
+
+                        Vertex vertex = mesh.vertices[source];
+                        glm::vec2 texel = unitCoordinates
+                            ? glm::clamp(vertex.TexCoords, 0.0f, 1.0f) * (float)(TILE_SIZE - 1) + glm::vec2(0.5f)
+                            : glm::vec2(TILE_SIZE * 0.5f);
+                        vertex.TexCoords = (tileOrigin + texel) / atlasSize;
+
+                        remap[source] = (GLuint)vertices.size();
+                        vertices.push_back(vertex);
+                    }
+                    indices.push_back(remap[source]);
+                }
+
+                meshCells[cell.second[m]] = (int)cells.size();
+            }
+
+            hlodCell.bounds.center = (hlodCell.bounds.min + hlodCell.bounds.max) * 0.5f;
+            hlodCell.bounds.radius = glm::length(hlodCell.bounds.max - hlodCell.bounds.center);
+
+            proxies.push_back(Mesh(vertices, indices, std::vector<Texture>(1, atlasTexture)));
+            proxies.back().bounds = hlodCell.bounds;
+            cells.push_back(hlodCell);
+            replaced += hlodCell.members.size();
+        }
+
+        std::cout << "HLOD           : " << cells.size() << " cell proxies for " << replaced << " meshes, "
+            << atlasWidth << "x" << atlasHeight << " atlas of " << tiles.size() << " textures" << std::endl;
+    }
+
+    bool HLOD::empty() {
+
+        return cells.empty();
+    }
+
+    size_t HLOD::getCellCount() {
+
+        return cells.size();
+    }
+
+    HLODCell& HLOD::getCell(size_t cell) {
+
+        return cells[cell];
+    }
+
+    Mesh& HLOD::getProxy(size_t cell) {
+
+        return proxies[cell];
+    }
+
+    int HLOD::getMeshCell(size_t mesh) {
+
+        return mesh < meshCells.size() ? meshCells[mesh] : -1;
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef HLOD_hpp
+#define HLOD_hpp
+
+#include "Mesh.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+namespace gps {
+
+    // Spatial cell of small meshes and the proxy mesh that can be drawn in their place
+    struct HLODCell {
+        std::vector<GLuint> members;    // indices of the replaced meshes
+        Bounds bounds;                  // object space, of the members
+        float error;                    // object space error of the proxy - its geometry and its atlas texels
+    };
+
+    // Hierarchical level of detail of one model: its small meshes are grouped by a grid into cells, and every
+    // cell is baked into one proxy - the members' coarsest levels of detail merged into a single mesh that samples
+    // a texture atlas shared by all the proxies of the model. A far cell then costs one draw instead of one per member
+    class HLOD {
+
+    public:
+        ~HLOD();
+
+        // Groups the meshes no larger than half a cell by the cell of their center and bakes the cells holding
+        // at least MIN_CELL_MEMBERS of them. Needs a current context, reads the members' textures back
+        void build(const std::vector<Mesh>& meshes, float cellSize);
+
+        bool empty();
+        size_t getCellCount();
+        HLODCell& getCell(size_t cell);
+        Mesh& getProxy(size_t cell);
+        // Cell replacing a mesh, -1 when the mesh is always drawn itself
+        int getMeshCell(size_t mesh);
+
+        // Side of the atlas tile one texture is reduced to
+        static const int TILE_SIZE = 32;
+        static const size_t MIN_CELL_MEMBERS = 2;
+
+    private:
+        std::vector<HLODCell> cells;
+        std::vector<Mesh> proxies;
+        std::vector<int> meshCells;
+        GLuint atlas = 0;
+        int atlasWidth = 0;
+        int atlasHeight = 0;
+
+        // Deletes the proxies' buffers and the atlas, leaving no cells
+        void release();
+    };
+}
+
+#endif /* HLOD_hpp */
@@ -0,0 +1,343 @@
+#include "Impostor.hpp"
+#include "SceneBVH.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace gps {
+
+    static const char IMPOSTOR_FILE_MAGIC[4] = { 'G', 'I', 'M', 'P' };
+    static const GLuint IMPOSTOR_FILE_VERSION = 2;
+
+    // Up vector of the frame camera looking along -direction; impostor.frag rebuilds the same basis
+    static glm::vec3 FrameUp(const glm::vec3& direction) {
+
+        return std::abs(direction.y) > 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    }
+
+    Impostor::~Impostor() {
+
+        deleteAtlases();
+    }
+
+    unsigned long long Impostor::SourceKey(const std::vector<Mesh>& meshes, int textureQuality) {
+
+        std::vector<Bounds> meshBounds(meshes.size());
+        for (size_t i = 0; i < meshes.size(); i++) {
+            meshBounds[i] = meshes[i].bounds;
+        }
+
+        // FNV-1a over the texture paths of every mesh in order, then the quality tier, on top of the boxes
+        unsigned long long key = SceneBVH::HashBounds(meshBounds);
+        for (size_t i = 0; i < meshes.size(); i++) {
+            for (size_t t = 0; t < meshes[i].textures.size(); t++) {
+                const std::string& path = meshes[i].textures[t].path;
+                for (size_t c = 0; c <= path.size(); c++) {
+                    key = (key ^ (unsigned char)path.c_str()[c]) * 0x100000001b3ULL;
+                }
+            }
+        }
+        return (key ^ (unsigned long long)textureQuality) * 0x100000001b3ULL;
+    }
+
+    glm::vec3 Impostor::DecodeDirection(const glm::vec2& uv) {
+
+        glm::vec2 p = uv * 2.0f - 1.0f;
+        glm::vec3 n(p.x, 1.0f - std::abs(p.x) - std::abs(p.y), p.y);
+        if (n.y < 0.0f) {
+            // lower half: fold the corners of the square back over the diagonals
+            float x = (1.0f - std::abs(n.z)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+            float z = (1.0f - std::abs(n.x)) * (n.z >= 0.0f ? 1.0f : -1.0f);
+            n.x = x;
+            n.z = z;
+        }
+        return glm::normalize(n);
+    }
+
+    glm::vec2 Impostor::EncodeDirection(const glm::vec3& direction) {
+
+        glm::vec3 n = direction / (std::abs(direction.x) + std::abs(direction.y) + std::abs(direction.z));
+        glm::vec2 p(n.x, n.z);
+        if (n.y < 0.0f) {
+            p = glm::vec2((1.0f - std::abs(n.z)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+                (1.0f - std::abs(n.x)) * (n.z >= 0.0f ? 1.0f : -1.0f));
+        }
+        return p * 0.5f + 0.5f;
+    }
+
+    void Impostor::createAtlases(const void* albedoPixels, const void* normalDepthPixels) {
+
+        deleteAtlases();
+
+        const int atlasSize = GRID * FRAME_SIZE;
+        GLuint* atlases[2] = { &albedoAtlas, &normalDepthAtlas };
+        const void* pixels[2] = { albedoPixels, normalDepthPixels };
+        for (int i = 0; i < 2; i++) {
+
+            glGenTextures(1, atlases[i]);
+            GLState::bindTexture(0, GL_TEXTURE_2D, *atlases[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, atlasSize, atlasSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels[i]);
+            // no mips - they would bleed neighbouring frames into each other
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+    }
+
+    void Impostor::deleteAtlases() {
+
+        if (albedoAtlas != 0 || normalDepthAtlas != 0) {
+            glDeleteTextures(1, &albedoAtlas);
+            glDeleteTextures(1, &normalDepthAtlas);
+            albedoAtlas = 0;
+            normalDepthAtlas = 0;
+            GLState::invalidate();
+        }
+    }
+
+    void Impostor::bake(std::vector<Mesh>& meshes, const Bounds& bounds, gps::Shader& bakeShader) {
+
+        center = bounds.center;
+        radius = std::max(bounds.radius, 1e-4f);
+        createAtlases(NULL, NULL);
+
+        const int atlasSize = GRID * FRAME_SIZE;
+        GLuint depthBuffer = 0;
+        glGenRenderbuffers(1, &depthBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, atlasSize, atlasSize);
+
+        GLint previousFramebuffer = 0;
+        GLint previousViewport[4];
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+        glGetIntegerv(GL_VIEWPORT, previousViewport);
+
+        GLuint framebuffer = 0;
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedoAtlas, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalDepthAtlas, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+        const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(2, drawBuffers);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+
+            std::cerr << "Impostor bake framebuffer is incomplete" << std::endl;
+            deleteAtlases();
+        }
+        else {
+
+            // empty texels stay fully transparent, the billboard discards them
+            const GLfloat clearColor[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            const GLfloat clearDepth = 1.0f;
+            glClearBufferfv(GL_COLOR, 0, clearColor);
+            glClearBufferfv(GL_COLOR, 1, clearColor);
+            glClearBufferfv(GL_DEPTH, 0, &clearDepth);
+
+            GLState::enable(GL_DEPTH_TEST);
+            GLState::polygonMode(GL_FILL);
+            bakeShader.useShaderProgram();
+            bakeShader.setVec3("impostorCenter", center);
+            bakeShader.setFloat("impostorRadius", radius);
+            // orthographic frame just around the bounding sphere, the camera two radii out
+            bakeShader.setMat4("bakeProjection", glm::ortho(-radius, radius, -radius, radius, radius, 3.0f * radius));
+
+            for (int y = 0; y < GRID; y++) {
+                for (int x = 0; x < GRID; x++) {
+
+                    glm::vec3 direction = DecodeDirection(glm::vec2((x + 0.5f) / GRID, (y + 0.5f) / GRID));
+                    glViewport(x * FRAME_SIZE, y * FRAME_SIZE, FRAME_SIZE, FRAME_SIZE);
+                    bakeShader.setVec3("bakeDirection", direction);
+                    bakeShader.setMat4("bakeView", glm::lookAt(center + direction * (2.0f * radius), center, FrameUp(direction)));
+
+                    for (size_t i = 0; i < meshes.size(); i++) {
+
+                        // packed textures select their layer through the same uniform the basic program reads
+                        bool packed = false;
+                        for (size_t t = 0; t < meshes[i].textures.size(); t++)
+                            packed = packed || meshes[i].textures[t].arrayId != 0;
+                        bakeShader.setBool("useTextureArrays", packed);
+                        meshes[i].Draw(bakeShader);
+                    }
+                }
+            }
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+        glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteRenderbuffers(1, &depthBuffer);
+    }
+
+    bool Impostor::save(const std::string& path, unsigned long long sourceKey) {
+
+        if (empty()) {
+            return false;
+        }
+
+        std::ofstream file(path, std::ios::binary);
+        if (!file) {
+            return false;
+        }
+
+        const int atlasSize = GRID * FRAME_SIZE;
+        std::vector<unsigned char> pixels((size_t)atlasSize * atlasSize * 4);
+        unsigned long long hash = sourceKey;
+        GLuint grid = GRID;
+        GLuint frameSize = FRAME_SIZE;
+
+        file.write(IMPOSTOR_FILE_MAGIC, sizeof(IMPOSTOR_FILE_MAGIC));
+        file.write((const char*)&IMPOSTOR_FILE_VERSION, sizeof(IMPOSTOR_FILE_VERSION));
+        file.write((const char*)&hash, sizeof(hash));
+        file.write((const char*)&grid, sizeof(grid));
+        file.write((const char*)&frameSize, sizeof(frameSize));
+        file.write((const char*)&center, sizeof(center));
+        file.write((const char*)&radius, sizeof(radius));
+
+        GLuint atlases[2] = { albedoAtlas, normalDepthAtlas };
+        for (int i = 0; i < 2; i++) {
+
+            GLState::bindTexture(0, GL_TEXTURE_2D, atlases[i]);
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+            file.write((const char*)pixels.data(), pixels.size());
+        }
+        return (bool)file;
+    }
+
+    bool Impostor::load(const std::string& path, unsigned long long sourceKey) {
+
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            return false;
+        }
+
+        char magic[4];
+        GLuint version = 0;
+        unsigned long long hash = 0;
+        GLuint grid = 0;
+        GLuint frameSize = 0;
+        glm::vec3 fileCenter;
+        float fileRadius = 0.0f;
+        file.read(magic, sizeof(magic));
+        file.read((char*)&version, sizeof(version));
+        file.read((char*)&hash, sizeof(hash));
+        file.read((char*)&grid, sizeof(grid));
+        file.read((char*)&frameSize, sizeof(frameSize));
+        file.read((char*)&fileCenter, sizeof(fileCenter));
+        file.read((char*)&fileRadius, sizeof(fileRadius));
+
+        if (!file || memcmp(magic, IMPOSTOR_FILE_MAGIC, sizeof(magic)) != 0 || version != IMPOSTOR_FILE_VERSION
+            || grid != GRID || frameSize != FRAME_SIZE || hash != sourceKey) {
+            return false;
+        }
+
+        const int atlasSize = GRID * FRAME_SIZE;
+        std::vector<unsigned char> albedoPixels((size_t)atlasSize * atlasSize * 4);
+        std::vector<unsigned char> normalDepthPixels(albedoPixels.size());
+        file.read((char*)albedoPixels.data(), albedoPixels.size());
+        file.read((char*)normalDepthPixels.data(), normalDepthPixels.size());
+        if (!file) {
+            return false;
+        }
+
+        center = fileCenter;
+        radius = fileRadius;
+        createAtlases(albedoPixels.data(), normalDepthPixels.data());
+        return true;
+    }
+
+    bool Impostor::empty() {
+
+        return albedoAtlas == 0;
+    }
+
+    GLuint Impostor::getAlbedoAtlas() {
+
+        return albedoAtlas;
+    }
+
+    GLuint Impostor::getNormalDepthAtlas() {
+
+        return normalDepthAtlas;
+    }
+
+    glm::vec3 Impostor::getCenter() {
+
+        return center;
+    }
+
+    float Impostor::getRadius() {
+
+        return radius;
+    }
+
+    float Impostor::getError() {
+
+        return 4.0f * (2.0f * radius / FRAME_SIZE);
+    }
+
+    ImpostorRenderer::~ImpostorRenderer() {
+
+        if (emptyVAO != 0) {
+            glDeleteVertexArrays(1, &emptyVAO);
+        }
+    }
+
+    void ImpostorRenderer::init() {
+
+        shader.loadShader("shaders/impostor.vert", "shaders/impostor.frag");
+        // core profiles refuse draws without a vertex array, even one with no attributes
+        glGenVertexArrays(1, &emptyVAO);
+    }
+
+    void ImpostorRenderer::begin() {
+
+        billboards.clear();
+    }
+
+    void ImpostorRenderer::add(Impostor* impostor, const glm::mat4& model) {
+
+        Billboard billboard = { impostor, model };
+        billboards.push_back(billboard);
+    }
+
+    void ImpostorRenderer::draw(const glm::mat4& view) {
+
+        if (billboards.empty()) {
+            return;
+        }
+
+        shader.useShaderProgram();
+        GLState::bindVertexArray(emptyVAO);
+        GLint albedoUnit = shader.getSamplerUnit("albedoAtlas");
+        GLint normalDepthUnit = shader.getSamplerUnit("normalDepthAtlas");
+        shader.setVec3("cameraPosition", glm::vec3(glm::inverse(view)[3]));
+
+        for (size_t i = 0; i < billboards.size(); i++) {
+
+            Impostor* impostor = billboards[i].impostor;
+            shader.setMat4("model", billboards[i].model);
+            shader.setMat4("inverseModel", glm::inverse(billboards[i].model));
+            shader.setVec3("impostorCenter", impostor->getCenter());
+            shader.setFloat("impostorRadius", impostor->getRadius());
+            if (albedoUnit >= 0)
+                GLState::bindTexture(albedoUnit, GL_TEXTURE_2D, impostor->getAlbedoAtlas());
+            if (normalDepthUnit >= 0)
+                GLState::bindTexture(normalDepthUnit, GL_TEXTURE_2D, impostor->getNormalDepthAtlas());
+
+            glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        }
+    }
+
+    gps::Shader& ImpostorRenderer::getShader() {
+
+        return shader;
+    }
+}
@@ -0,0 +1,98 @@
+#ifndef Impostor_hpp
+#define Impostor_hpp
+
+#include "Mesh.hpp"
+#include "Shader.hpp"
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Octahedral impostor of one model: the model rendered orthographically from GRID x GRID directions spread
+    // over the sphere by an octahedral mapping, into an albedo atlas and a normal + depth atlas. A far model is
+    // then drawn as one camera facing quad that blends the frames of the four directions nearest the view
+    class Impostor {
+
+    public:
+        ~Impostor();
+
+        // Renders the meshes into the atlases with the bake program (impostorBake.vert/.frag). Needs a current
+        // context - a hidden window is enough, the bake never touches the default framebuffer
+        void bake(std::vector<Mesh>& meshes, const Bounds& bounds, gps::Shader& bakeShader);
+
+        // Key of what a bake depends on: the mesh boxes, the paths of the textures they are drawn with and the
+        // texture quality tier those were loaded at
+        static unsigned long long SourceKey(const std::vector<Mesh>& meshes, int textureQuality);
+
+        // Writes the atlases, tagged with the SourceKey of the meshes they were baked from
+        bool save(const std::string& path, unsigned long long sourceKey);
+
+        // Reads the atlases back, failing when the file is missing or was baked from other meshes or textures
+        bool load(const std::string& path, unsigned long long sourceKey);
+
+        bool empty();
+
+        GLuint getAlbedoAtlas();
+        GLuint getNormalDepthAtlas();
+        // Object space sphere the frames were framed on
+        glm::vec3 getCenter();
+        float getRadius();
+        // Object space error of drawing the impostor instead of the model - a few frame texels, to cover the
+        // parallax the blend between neighbouring directions leaves
+        float getError();
+
+        // Directions per side of the octahedral grid, and side of one frame in texels
+        static const int GRID = 8;
+        static const int FRAME_SIZE = 128;
+
+        // Unit direction of a point of the octahedral square [0, 1]^2, and back
+        static glm::vec3 DecodeDirection(const glm::vec2& uv);
+        static glm::vec2 EncodeDirection(const glm::vec3& direction);
+
+    private:
+        GLuint albedoAtlas = 0;
+        GLuint normalDepthAtlas = 0;
+        glm::vec3 center = glm::vec3(0.0f);
+        float radius = 0.0f;
+
+        // Allocates the two GRID * FRAME_SIZE square atlases, with the given pixels when not NULL
+        void createAtlases(const void* albedoPixels, const void* normalDepthPixels);
+        void deleteAtlases();
+    };
+
+    // Collects the impostors the scene submits during a frame and draws them as billboards after the render
+    // queue, with impostor.vert/.frag. The quads are generated from gl_VertexID, no vertex buffer is needed
+    class ImpostorRenderer {
+
+    public:
+        ~ImpostorRenderer();
+
+        // Loads the billboard program. Needs a current context
+        void init();
+
+        // Drops the billboards of the last frame
+        void begin();
+
+        void add(Impostor* impostor, const glm::mat4& model);
+
+        // Draws every queued billboard, with view, projection and lighting from the FrameData block
+        void draw(const glm::mat4& view);
+
+        gps::Shader& getShader();
+
+    private:
+        struct Billboard {
+            Impostor* impostor;
+            glm::mat4 model;
+        };
+
+        gps::Shader shader;
+        std::vector<Billboard> billboards;
+        GLuint emptyVAO = 0;
+    };
+}
+
+#endif /* Impostor_hpp */
@@ -0,0 +1,344 @@
+#include "JobSystem.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace gps {
+
+    struct Job {
+        std::function<void()> work;
+        std::atomic<int>* pending;      // decremented once work has returned
+    };
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+        std::atomic<unsigned int> jobsRun{0};
+        std::atomic<unsigned int> steals{0};
+        std::atomic<long long> busyNs{0};
+        std::atomic<bool> registered{false};    // slot of a registered thread in use
+    };
+
+    // slots past the workers kept for RegisterThread
+    static const unsigned int REGISTERED_THREAD_SLOTS = 4;
+
+    static std::vector<std::unique_ptr<Worker>> CreateWorkers(unsigned int count) {
+
+        std::vector<std::unique_ptr<Worker>> created;
+        for (unsigned int i = 0; i < count; i++) {
+            created.push_back(std::unique_ptr<Worker>(new Worker()));
+        }
+        return created;
+    }
+
+    static std::vector<std::unique_ptr<Worker>> workers = CreateWorkers(1 + REGISTERED_THREAD_SLOTS);
+    // workers started by Init, the rest of the slots are for registered threads
+    static unsigned int poolSize = 1;
+    // slots that ever had a thread, the ones past it have nothing to steal
+    static std::atomic<unsigned int> usedSlots(1);
+    static std::vector<std::thread> threads;
+    // jobs sitting in the deques, idle workers sleep while there are none
+    static std::atomic<int> queuedJobs(0);
+    static std::atomic<bool> stopping(false);
+    static std::mutex sleepMutex;
+    static std::condition_variable wake;
+    // slot of the current thread - threads outside the system share worker 0's deque unless registered
+    static thread_local unsigned int workerIndex = 0;
+    // jobs run inside other jobs on this thread, only the outermost one counts towards the busy time
+    static thread_local int jobDepth = 0;
+    // time this thread slept in Wait, taken off the busy time of the job it was waiting in
+    static thread_local long long sleptNs = 0;
+
+    static void Push(Job job) {
+
+        Worker& worker = *workers[workerIndex];
+        {
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            worker.jobs.push_back(std::move(job));
+        }
+        queuedJobs++;
+        {
+            // a worker between checking queuedJobs and going to sleep would miss the notification
+            std::lock_guard<std::mutex> lock(sleepMutex);
+        }
+        wake.notify_one();
+    }
+
+    // Newest job of the own deque, or else the oldest of another worker's
+    static bool TakeJob(Job& job) {
+
+        unsigned int count = usedSlots.load();
+        Worker& self = *workers[workerIndex];
+        {
+            std::lock_guard<std::mutex> lock(self.mutex);
+            if (!self.jobs.empty()) {
+                job = std::move(self.jobs.back());
+                self.jobs.pop_back();
+                queuedJobs--;
+                return true;
+            }
+        }
+
+        for (unsigned int k = 1; k < count; k++) {
+
+            Worker& victim = *workers[(workerIndex + k) % count];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.jobs.empty()) {
+                job = std::move(victim.jobs.front());
+                victim.jobs.pop_front();
+                queuedJobs--;
+                self.steals++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static bool RunOne() {
+
+        Job job;
+        if (!TakeJob(job)) {
+            return false;
+        }
+
+        Worker& self = *workers[workerIndex];
+        auto start = std::chrono::high_resolution_clock::now();
+        long long sleptBefore = sleptNs;
+        jobDepth++;
+        job.work();
+        jobDepth--;
+        if (jobDepth == 0) {
+            long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+            self.busyNs += ns - (sleptNs - sleptBefore);
+        }
+        self.jobsRun++;
+
+        if (job.pending->fetch_sub(1) == 1) {
+            // the last job of a batch - its waiter may be asleep
+            {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+            }
+            wake.notify_all();
+        }
+        return true;
+    }
+
+    // Runs queued jobs until pending drops to zero, and sleeps while the remaining ones run elsewhere
+    static void Wait(std::atomic<int>& pending) {
+
+        while (pending.load() > 0) {
+
+            if (RunOne()) {
+                continue;
+            }
+            auto start = std::chrono::high_resolution_clock::now();
+            {
+                std::unique_lock<std::mutex> lock(sleepMutex);
+                wake.wait(lock, [&pending]() { return pending.load() == 0 || queuedJobs.load() > 0; });
+            }
+            sleptNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+        }
+    }
+
+    static void WorkerLoop(unsigned int index) {
+
+        workerIndex = index;
+        while (!stopping.load()) {
+
+            if (RunOne()) {
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait(lock, []() { return queuedJobs.load() > 0 || stopping.load(); });
+        }
+    }
+
+    // Queues the upper halves and runs the lowest piece in place, so thieves take the largest ranges first
+    static void SplitRange(size_t first, size_t end, size_t grain, const std::function<void(size_t, size_t)>& body,
+        std::atomic<int>& pending) {
+
+        while (end - first > grain) {
+
+            size_t middle = first + (end - first) / 2;
+            pending++;
+            Push({ [middle, end, grain, &body, &pending]() { SplitRange(middle, end, grain, body, pending); }, &pending });
+            end = middle;
+        }
+        body(first, end);
+    }
+
+    // the threads must not outlive main
+    static struct ShutdownAtExit {
+        ~ShutdownAtExit() {
+            JobSystem::Shutdown();
+        }
+    } shutdownAtExit;
+
+    int TaskGraph::add(std::function<void()> work) {
+
+        Task task = { std::move(work), {}, 0 };
+        tasks.push_back(std::move(task));
+        return (int)tasks.size() - 1;
+    }
+
+    void TaskGraph::precede(int before, int after) {
+
+        tasks[before].successors.push_back(after);
+        tasks[after].predecessors++;
+    }
+
+    size_t TaskGraph::size() {
+
+        return tasks.size();
+    }
+
+    void TaskGraph::clear() {
+
+        tasks.clear();
+    }
+
+    void JobSystem::Init(unsigned int workerCount) {
+
+        Shutdown();
+        if (workerCount == 0) {
+            workerCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        workers = CreateWorkers(workerCount + REGISTERED_THREAD_SLOTS);
+        poolSize = workerCount;
+        usedSlots = workerCount;
+        workerIndex = 0;
+        stopping = false;
+        for (unsigned int i = 1; i < workerCount; i++) {
+            threads.push_back(std::thread(WorkerLoop, i));
+        }
+    }
+
+    void JobSystem::Shutdown() {
+
+        if (threads.empty()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (size_t i = 0; i < threads.size(); i++) {
+            threads[i].join();
+        }
+        threads.clear();
+        workers = CreateWorkers(1 + REGISTERED_THREAD_SLOTS);
+        poolSize = 1;
+        usedSlots = 1;
+    }
+
+    unsigned int JobSystem::GetWorkerCount() {
+
+        return poolSize;
+    }
+
+    void JobSystem::RegisterThread() {
+
+        for (unsigned int slot = poolSize; slot < workers.size(); slot++) {
+
+            bool expected = false;
+            if (workers[slot]->registered.compare_exchange_strong(expected, true)) {
+                unsigned int used = usedSlots.load();
+                while (used < slot + 1 && !usedSlots.compare_exchange_weak(used, slot + 1)) {
+                }
+                workerIndex = slot;
+                return;
+            }
+        }
+    }
+
+    void JobSystem::UnregisterThread() {
+
+        // every job this thread pushed was waited for, so the deque is empty and the slot can go to the next thread
+        if (workerIndex >= poolSize) {
+            workers[workerIndex]->registered = false;
+            workerIndex = 0;
+        }
+    }
+
+    unsigned int JobSystem::GetSlotCount() {
+
+        return usedSlots.load();
+    }
+
+    void JobSystem::ParallelFor(size_t first, size_t end, size_t grain, const std::function<void(size_t, size_t)>& body) {
+
+        if (first >= end) {
+            return;
+        }
+        unsigned int count = GetWorkerCount();
+        if (grain == 0) {
+            grain = std::max<size_t>(1, (end - first) / (count * 4));
+        }
+        if (count == 1 || end - first <= grain) {
+            body(first, end);
+            return;
+        }
+
+        std::atomic<int> pending(0);
+        SplitRange(first, end, grain, body, pending);
+        Wait(pending);
+    }
+
+    void JobSystem::ScheduleTask(TaskGraph& graph, int task, std::atomic<int>* remaining, std::atomic<int>* pending) {
+
+        Push({ [&graph, task, remaining, pending]() {
+            graph.tasks[task].work();
+            for (int successor : graph.tasks[task].successors) {
+                if (remaining[successor].fetch_sub(1) == 1) {
+                    ScheduleTask(graph, successor, remaining, pending);
+                }
+            }
+        }, pending });
+    }
+
+    void JobSystem::Run(TaskGraph& graph) {
+
+        size_t count = graph.tasks.size();
+        if (count == 0) {
+            return;
+        }
+
+        std::vector<std::atomic<int>> remaining(count);
+        for (size_t i = 0; i < count; i++) {
+            remaining[i] = graph.tasks[i].predecessors;
+        }
+        // every task counts until it is done, so pending only reaches zero after the last one
+        std::atomic<int> pending((int)count);
+        for (size_t i = 0; i < count; i++) {
+            if (graph.tasks[i].predecessors == 0) {
+                ScheduleTask(graph, (int)i, remaining.data(), &pending);
+            }
+        }
+        Wait(pending);
+    }
+
+    JobWorkerStats JobSystem::GetWorkerStats(unsigned int worker) {
+
+        JobWorkerStats stats = {};
+        stats.jobs = workers[worker]->jobsRun.load();
+        stats.steals = workers[worker]->steals.load();
+        stats.busyMs = workers[worker]->busyNs.load() / 1e6;
+        return stats;
+    }
+
+    void JobSystem::ResetStats() {
+
+        for (size_t i = 0; i < workers.size(); i++) {
+            workers[i]->jobsRun = 0;
+            workers[i]->steals = 0;
+            workers[i]->busyNs = 0;
+        }
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef JobSystem_hpp
+#define JobSystem_hpp
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+namespace gps {
+
+    // Counters of one worker since the last JobSystem::ResetStats
+    struct JobWorkerStats {
+        unsigned int jobs;      // jobs run
+        unsigned int steals;    // of those, taken from another worker's deque
+        double busyMs;          // time spent in them - over the wall time it is the worker's utilization
+    };
+
+    // Tasks and the order between them, run as a whole by JobSystem::Run. The dependencies must not form a cycle
+    class TaskGraph {
+
+    public:
+        // Adds a task, returns its index
+        int add(std::function<void()> work);
+
+        // after only starts once before has finished
+        void precede(int before, int after);
+
+        size_t size();
+
+        void clear();
+
+    private:
+        friend class JobSystem;
+
+        struct Task {
+            std::function<void()> work;
+            std::vector<int> successors;
+            int predecessors;
+        };
+
+        std::vector<Task> tasks;
+    };
+
+    // Work-stealing job system. The thread that calls Init is worker 0 and every worker owns a deque of jobs: it pushes
+    // and pops its own jobs at the back and, once it runs dry, steals from the front of the others, where the largest
+    // pieces of a split range wait. Threads waiting for their jobs run queued jobs meanwhile, so jobs can wait on the
+    // jobs they spawn. Until Init (or with one worker) everything runs inline on the calling thread. Other threads that
+    // submit work share worker 0's deque and stats unless they register for a slot of their own
+    class JobSystem {
+
+    public:
+        // Starts workerCount - 1 threads next to the calling one; 0 takes one worker per hardware thread
+        static void Init(unsigned int workerCount = 0);
+
+        // Stops the threads, everything runs inline again
+        static void Shutdown();
+
+        static unsigned int GetWorkerCount();
+
+        // Gives the calling thread, which must not be a worker, its own deque and stats until UnregisterThread, so
+        // the jobs it submits and waits for stay apart from worker 0's. Without a free slot it keeps sharing worker 0's.
+        // Registrations do not survive Init or Shutdown
+        static void RegisterThread();
+
+        static void UnregisterThread();
+
+        // Workers plus the slots handed to registered threads so far - the range of GetWorkerStats
+        static unsigned int GetSlotCount();
+
+        // Calls body(first, end) on pieces of [first, end) no larger than grain, spread over the workers, and returns
+        // once all of them are done. A grain of 0 cuts the range into about 4 pieces per worker
+        static void ParallelFor(size_t first, size_t end, size_t grain, const std::function<void(size_t, size_t)>& body);
+
+        // Runs every task of the graph after the tasks preceding it and returns once all of them are done
+        static void Run(TaskGraph& graph);
+
+        static JobWorkerStats GetWorkerStats(unsigned int worker);
+
+        static void ResetStats();
+
+    private:
+        // Queues a task whose predecessors are done; finishing it queues the successors it was the last one to wait for
+        static void ScheduleTask(TaskGraph& graph, int task, std::atomic<int>* remaining, std::atomic<int>* pending);
+    };
+}
+
+#endif /* JobSystem_hpp */
@@ -0,0 +1,114 @@
+#include "LODSelector.hpp"
+
+#include <algorithm>
+
+namespace gps {
+
+    // Step the budget scales the threshold by per frame over budget, and back per frame well under it
+    static const float BUDGET_RAISE = 1.25f;
+    static const float BUDGET_LOWER = 0.95f;
+    static const float BUDGET_MAX_SCALE = 64.0f;
+    // Fraction of the budget a frame has to stay under before the threshold is lowered
+    static const float BUDGET_LOW_WATER = 0.8f;
+
+    void LODSelector::setEnabled(bool enabled) {
+
+        this->enabled = enabled;
+    }
+
+    bool LODSelector::isEnabled() {
+
+        return enabled;
+    }
+
+    void LODSelector::setPixelError(float pixels) {
+
+        pixelError = std::max(pixels, 0.01f);
+    }
+
+    void LODSelector::setHysteresis(float fraction) {
+
+        hysteresis = std::max(0.0f, std::min(fraction, 0.9f));
+    }
+
+    void LODSelector::setTriangleBudget(size_t triangles) {
+
+        triangleBudget = triangles;
+        budgetScale = 1.0f;
+    }
+
+    void LODSelector::begin(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, float viewportHeight) {
+
+        view = viewMatrix;
+        projectionScale = projectionMatrix[1][1] * viewportHeight * 0.5f;
+        stats = {};
+    }
+
+    GLuint LODSelector::select(const Mesh& mesh, const glm::vec3& center, float radius, float errorScale, GLuint currentLevel) {
+
+        if (!enabled || mesh.lods.size() < 2) {
+            return 0;
+        }
+
+        stats.selections++;
+
+        // inside the sphere, full detail
+        float scale = errorScale * pixelsPerUnit(center, radius);
+        GLuint level = 0;
+        if (scale > 0.0f) {
+
+            float threshold = getPixelError();
+
+            // finer while the current level is over the threshold, coarser only while the next one is well under it
+            level = std::min(currentLevel, (GLuint)mesh.lods.size() - 1);
+            while (level > 0 && mesh.lods[level].error * scale > threshold) {
+                level--;
+            }
+            while (level + 1 < mesh.lods.size() && mesh.lods[level + 1].error * scale <= threshold * (1.0f - hysteresis)) {
+                level++;
+            }
+        }
+
+        if (level > 0) {
+            stats.coarse++;
+        }
+        if (level != currentLevel) {
+            stats.switches++;
+        }
+        return level;
+    }
+
+    bool LODSelector::acceptsError(const glm::vec3& center, float radius, float error, bool wasAccepted) {
+
+        float pixels = error * pixelsPerUnit(center, radius);
+        if (pixels <= 0.0f) {
+            return false;
+        }
+        return pixels <= getPixelError() * (wasAccepted ? 1.0f : 1.0f - hysteresis);
+    }
+
+    float LODSelector::pixelsPerUnit(const glm::vec3& center, float radius) {
+
+        float distance = glm::length(glm::vec3(view * glm::vec4(center, 1.0f))) - radius;
+        return distance > 1e-3f ? projectionScale / distance : 0.0f;
+    }
+
+    void LODSelector::endFrame(size_t triangles) {
+
+        if (!enabled || triangleBudget == 0) {
+            budgetScale = 1.0f;
+            return;
+        }
+
+        if (triangles > triangleBudget) {
+            budgetScale = std::min(budgetScale * BUDGET_RAISE, BUDGET_MAX_SCALE);
+        } else if (triangles < triangleBudget * BUDGET_LOW_WATER) {
+            budgetScale = std::max(budgetScale * BUDGET_LOWER, 1.0f);
+        }
+    }
+
+    float LODSelector::getPixelError() {
+
+        return pixelError * budgetScale;
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef LODSelector_hpp
+#define LODSelector_hpp
+
+#include "Mesh.hpp"
+
+#include <glm/glm.hpp>
+
+namespace gps {
+
+    // Per-frame counters of the level of detail selection
+    struct LODStats {
+        unsigned int selections;
+        unsigned int coarse;            // selections of a level past the full detail one
+        unsigned int switches;          // selections that changed the level from the previous frame's
+        unsigned int proxies;           // HLOD cells drawn as their proxy
+        unsigned int replaced;          // meshes those proxies stood in for
+        unsigned int impostors;         // models drawn as their impostor billboard
+    };
+
+    // Picks the coarsest level of detail of a mesh whose geometric error, projected at the distance of the
+    // mesh's bounding sphere, stays under a pixel threshold. A level only gets coarser once its error is a
+    // hysteresis fraction below the threshold, so meshes sitting at a boundary do not flicker between levels.
+    // With a triangle budget, the threshold is raised while frames draw more triangles than the budget and
+    // lowered back once they draw clearly fewer
+    class LODSelector {
+
+    public:
+        void setEnabled(bool enabled);
+        bool isEnabled();
+
+        // Base threshold, in pixels of error on screen
+        void setPixelError(float pixels);
+        void setHysteresis(float fraction);
+        // Triangles per frame, 0 for no budget
+        void setTriangleBudget(size_t triangles);
+
+        // Starts a frame - the projection's vertical scale and the viewport height turn distances into pixels
+        void begin(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, float viewportHeight);
+
+        // Level to draw a mesh with at the given world space sphere. errorScale is the largest scale of the
+        // mesh's model matrix, currentLevel the level it was drawn with last frame
+        GLuint select(const Mesh& mesh, const glm::vec3& center, float radius, float errorScale, GLuint currentLevel);
+
+        // True when an approximation with the given world space error can stand in for what the sphere holds,
+        // with the same threshold and hysteresis as select - wasAccepted is last frame's answer
+        bool acceptsError(const glm::vec3& center, float radius, float error, bool wasAccepted);
+
+        // Feeds the triangles the frame drew to the budget
+        void endFrame(size_t triangles);
+
+        // Threshold in effect, after the budget scaling
+        float getPixelError();
+
+        LODStats stats = {};
+
+    private:
+        bool enabled = false;
+        float pixelError = 1.0f;
+        float hysteresis = 0.2f;
+        size_t triangleBudget = 0;
+        float budgetScale = 1.0f;
+        glm::mat4 view;
+        // pixels covered by one world unit at distance 1
+        float projectionScale = 1.0f;
+
+        // Pixels one world unit of error covers at the nearest point of the sphere, 0 from inside it
+        float pixelsPerUnit(const glm::vec3& center, float radius);
+    };
+}
+
+#endif /* LODSelector_hpp */
@@ -1,44 +1,300 @@
 #include "Mesh.hpp"
+#include "DrawDataRing.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
 namespace gps {
 
+	DrawStats Mesh::stats = {};
+
+	// Shader names of the texture array sampler and layer uniform of a texture type
+	static const char* ArraySamplerName(const std::string& type) {
+
+		if (type == "diffuseTexture")
+			return "diffuseTextureArray";
+		if (type == "specularTexture")
+			return "specularTextureArray";
+		return "ambientTextureArray";
+	}
+
+	static const char* LayerUniformName(const std::string& type) {
+
+		if (type == "diffuseTexture")
+			return "diffuseTextureLayer";
+		if (type == "specularTexture")
+			return "specularTextureLayer";
+		return "ambientTextureLayer";
+	}
+
+	// A map the mesh does not have samples black, the same as when nothing is bound to its unit
+	static void UnbindMissingTexture(gps::Shader& shader, const std::string& type) {
+
+		GLint unit = shader.getSamplerUnit(type.c_str());
+		if (unit >= 0)
+			GLState::bindTexture(unit, GL_TEXTURE_2D, 0);
+
+		unit = shader.getSamplerUnit(ArraySamplerName(type));
+		if (unit >= 0)
+			GLState::bindTexture(unit, GL_TEXTURE_2D_ARRAY, 0);
+	}
+
+	// Vertex clustering: every vertex is snapped to the first vertex found in its grid cell and the triangles
+	// that collapse are dropped, so no vertex moves further than a cell diagonal
+	static void ClusterIndices(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices,
+		const glm::vec3& origin, float cellSize, std::vector<GLuint>& clustered) {
+
+		std::unordered_map<unsigned long long, GLuint> representatives;
+		std::vector<GLuint> remap(vertices.size());
+		for (size_t i = 0; i < vertices.size(); i++) {
+
+			glm::vec3 cell = glm::floor((vertices[i].Position - origin) / cellSize);
+			unsigned long long key = ((unsigned long long)cell.x << 42) | ((unsigned long long)cell.y << 21) | (unsigned long long)cell.z;
+			remap[i] = representatives.emplace(key, (GLuint)i).first->second;
+		}
+
+		clustered.clear();
+		for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+
+			GLuint a = remap[indices[i]];
+			GLuint b = remap[indices[i + 1]];
+			GLuint c = remap[indices[i + 2]];
+			if (a == b || b == c || a == c)
+				continue;
+
+			clustered.push_back(a);
+			clustered.push_back(b);
+			clustered.push_back(c);
+		}
+	}
+
 	/* Mesh Constructor */
-	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures) {
+	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures, bool buildLevels) {
+
+		this->vertices = vertices;
+		this->indices = indices;
+		this->textures = textures;
+
+		if (buildLevels) {
+
+			this->buildLODs();
+		}
+		else {
+
+			MeshLOD full = { 0, (GLuint)this->indices.size(), 0.0f };
+			this->lods.push_back(full);
+		}
+		this->setupMesh();
+	}
+
+	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures,
+		std::vector<MeshLOD> lods, std::vector<GLuint> lodIndices) {
 
 		this->vertices = vertices;
 		this->indices = indices;
 		this->textures = textures;
+		this->lods = lods;
+		this->lodIndices = lodIndices;
+		this->residentLOD = (GLuint)lods.size();
 
 		this->setupMesh();
 	}
 
+	void Mesh::uploadLevel(GLuint level, GLuint firstVertex, const std::vector<Vertex>& levelVertices, const std::vector<GLuint>& levelIndices) {
+
+		std::copy(levelVertices.begin(), levelVertices.end(), this->vertices.begin() + firstVertex);
+		GLuint first = this->lods[level].firstIndex;
+		for (size_t i = 0; i < levelIndices.size(); i++, first++) {
+
+			if (first < this->indices.size())
+				this->indices[first] = levelIndices[i];
+			else
+				this->lodIndices[first - this->indices.size()] = levelIndices[i];
+		}
+
+		// the copy target is not vertex array state, so the bound vertex array keeps its index buffer
+		if (!levelVertices.empty()) {
+
+			glBindBuffer(GL_COPY_WRITE_BUFFER, this->buffers.VBO);
+			glBufferSubData(GL_COPY_WRITE_BUFFER, (this->baseVertex + firstVertex) * sizeof(Vertex), levelVertices.size() * sizeof(Vertex), levelVertices.data());
+		}
+		if (!levelIndices.empty()) {
+
+			glBindBuffer(GL_COPY_WRITE_BUFFER, this->buffers.EBO);
+			glBufferSubData(GL_COPY_WRITE_BUFFER, getFirstIndex(level) * sizeof(GLuint), levelIndices.size() * sizeof(GLuint), levelIndices.data());
+		}
+
+		this->residentLOD = std::min(this->residentLOD, level);
+	}
+
+	bool Mesh::isResident() {
+
+		return this->residentLOD < this->lods.size();
+	}
+
 	Buffers Mesh::getBuffers() {
 	    return this->buffers;
 	}
 
+	// Frees the mesh's own buffers and draws from a range of buffers shared with other meshes instead
+	void Mesh::shareBuffers(Buffers shared, GLuint firstIndex, GLint baseVertex) {
+
+		glDeleteBuffers(1, &this->buffers.VBO);
+		glDeleteBuffers(1, &this->buffers.EBO);
+		glDeleteVertexArrays(1, &this->buffers.VAO);
+
+		this->buffers = shared;
+		this->firstIndex = firstIndex;
+		this->baseVertex = baseVertex;
+	}
+
+	GLsizei Mesh::getIndexCount(GLuint lod) {
+
+		return (GLsizei)this->lods[lod].indexCount;
+	}
+
+	GLuint Mesh::getFirstIndex(GLuint lod) {
+
+		return this->firstIndex + this->lods[lod].firstIndex;
+	}
+
 	/* Mesh drawing function - also applies associated textures */
-	void Mesh::Draw(gps::Shader shader)	{
+	void Mesh::Draw(gps::Shader& shader, GLuint lod)	{
 
 		shader.useShaderProgram();
+		bindTextures(shader);
 
-		//set textures
+		GLState::bindVertexArray(this->buffers.VAO);
+		glDrawElementsBaseVertex(GL_TRIANGLES, getIndexCount(lod), GL_UNSIGNED_INT,
+			(GLvoid*)(getFirstIndex(lod) * sizeof(GLuint)), this->baseVertex);
+		stats.drawCalls++;
+    }
+
+	// Binds the mesh textures to the shader's sampler units, without drawing
+	void Mesh::bindTextures(gps::Shader& shader) {
+
+		//set textures - sampler units were assigned when the shader was linked, and bindings
+		//are left in place so the next mesh using the same texture does not bind it again
+		bool hasDiffuse = false;
+		bool hasSpecular = false;
 		for (GLuint i = 0; i < textures.size(); i++) {
 
-			glActiveTexture(GL_TEXTURE0 + i);
-			glUniform1i(glGetUniformLocation(shader.shaderProgram, this->textures[i].type.c_str()), i);
-			glBindTexture(GL_TEXTURE_2D, this->textures[i].id);
+			hasDiffuse = hasDiffuse || this->textures[i].type == "diffuseTexture";
+			hasSpecular = hasSpecular || this->textures[i].type == "specularTexture";
+
+			if (this->textures[i].arrayId != 0) {
+
+				// packed texture - only the layer changes per draw
+				GLint unit = shader.getSamplerUnit(ArraySamplerName(this->textures[i].type));
+				if (unit < 0)
+					continue;
+
+				shader.setInt(LayerUniformName(this->textures[i].type), this->textures[i].layer);
+				GLState::bindTexture(unit, GL_TEXTURE_2D_ARRAY, this->textures[i].arrayId);
+				continue;
+			}
+
+			// textures the shader never samples (e.g. ambientTexture) are not bound at all
+			GLint unit = shader.getSamplerUnit(this->textures[i].type.c_str());
+			if (unit < 0)
+				continue;
+
+			GLState::bindTexture(unit, GL_TEXTURE_2D, this->textures[i].id);
 		}
 
-		glBindVertexArray(this->buffers.VAO);
-		glDrawElements(GL_TRIANGLES, (GLsizei)this->indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
+		if (!hasDiffuse)
+			UnbindMissingTexture(shader, "diffuseTexture");
+		if (!hasSpecular)
+			UnbindMissingTexture(shader, "specularTexture");
+	}
 
-        for(GLuint i = 0; i < this->textures.size(); i++) {
+	glm::ivec2 Mesh::getTextureLayers() {
 
-            glActiveTexture(GL_TEXTURE0 + i);
-            glBindTexture(GL_TEXTURE_2D, 0);
-        }
+		glm::ivec2 layers(0, 0);
+		for (size_t i = 0; i < textures.size(); i++) {
 
-    }
+			if (this->textures[i].arrayId == 0)
+				continue;
+			if (this->textures[i].type == "diffuseTexture")
+				layers.x = this->textures[i].layer;
+			else if (this->textures[i].type == "specularTexture")
+				layers.y = this->textures[i].layer;
+		}
+		return layers;
+	}
+
+	/* Mesh drawing function for resident (bindless) textures - no texture binds or sampler updates */
+	void Mesh::DrawBindless(gps::Shader& shader, GLuint lod) {
+
+		shader.useShaderProgram();
+		shader.setInt("materialIndex", this->materialIndex);
+
+		GLState::bindVertexArray(this->buffers.VAO);
+		glDrawElementsBaseVertex(GL_TRIANGLES, getIndexCount(lod), GL_UNSIGNED_INT,
+			(GLvoid*)(getFirstIndex(lod) * sizeof(GLuint)), this->baseVertex);
+		stats.drawCalls++;
+	}
+
+	/* Instanced drawing function - one draw for instanceCount copies, transforms from the draw data ring */
+	void Mesh::DrawInstanced(gps::Shader& shader, GLsizei instanceCount, GLuint baseInstance) {
+
+		shader.useShaderProgram();
+		bindTextures(shader);
+		drawElements(instanceCount, baseInstance);
+	}
+
+	// Issues the draw call alone, for callers that already bound the program and the material
+	void Mesh::drawElements(GLsizei instanceCount, GLuint baseInstance, GLuint lod) {
+
+		GLState::bindVertexArray(this->buffers.VAO);
+		const GLvoid* indexOffset = (const GLvoid*)(getFirstIndex(lod) * sizeof(GLuint));
+
+#if not defined (__APPLE__)
+		// records past the first need ARB_base_instance, which the draw data ring checks for
+		if (baseInstance != 0) {
+
+			glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, getIndexCount(lod), GL_UNSIGNED_INT,
+				indexOffset, instanceCount, this->baseVertex, baseInstance);
+			stats.drawCalls++;
+			return;
+		}
+#endif
+		glDrawElementsInstancedBaseVertex(GL_TRIANGLES, getIndexCount(lod), GL_UNSIGNED_INT,
+			indexOffset, instanceCount, this->baseVertex);
+		stats.drawCalls++;
+	}
+
+	// Points the DrawData attributes of the bound vertex array at the draw data ring
+	void Mesh::SetupDrawDataAttributes() {
+
+		glBindBuffer(GL_ARRAY_BUFFER, DrawDataRing::GetBuffer());
+
+		// model matrix - one vec4 column per location
+		for (GLuint column = 0; column < 4; column++) {
+
+			glEnableVertexAttribArray(3 + column);
+			glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(DrawData),
+				(GLvoid*)(offsetof(DrawData, model) + column * sizeof(glm::vec4)));
+			glVertexAttribDivisor(3 + column, 1);
+		}
+		// normal matrix - one vec3 column per location
+		for (GLuint column = 0; column < 3; column++) {
+
+			glEnableVertexAttribArray(7 + column);
+			glVertexAttribPointer(7 + column, 3, GL_FLOAT, GL_FALSE, sizeof(DrawData),
+				(GLvoid*)(offsetof(DrawData, normalMatrix) + column * sizeof(glm::vec3)));
+			glVertexAttribDivisor(7 + column, 1);
+		}
+		// material index
+		glEnableVertexAttribArray(10);
+		glVertexAttribIPointer(10, 1, GL_INT, sizeof(DrawData), (GLvoid*)offsetof(DrawData, materialIndex));
+		glVertexAttribDivisor(10, 1);
+		// texture array layers
+		glEnableVertexAttribArray(11);
+		glVertexAttribIPointer(11, 2, GL_INT, sizeof(DrawData), (GLvoid*)offsetof(DrawData, textureLayers));
+		glVertexAttribDivisor(11, 1);
+	}
 
 	// Initializes all the buffer objects/arrays
 	void Mesh::setupMesh() {
@@ -48,13 +304,17 @@ namespace gps {
 		glGenBuffers(1, &this->buffers.VBO);
 		glGenBuffers(1, &this->buffers.EBO);
 
-		glBindVertexArray(this->buffers.VAO);
+		GLState::bindVertexArray(this->buffers.VAO);
 		// Load data into vertex buffers
 		glBindBuffer(GL_ARRAY_BUFFER, this->buffers.VBO);
 		glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
 
+		// full detail indices first, the coarser levels after them
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->buffers.EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), &this->indices[0], GL_STATIC_DRAW);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, (this->indices.size() + this->lodIndices.size()) * sizeof(GLuint), NULL, GL_STATIC_DRAW);
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, this->indices.size() * sizeof(GLuint), this->indices.data());
+		if (!this->lodIndices.empty())
+			glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), this->lodIndices.size() * sizeof(GLuint), this->lodIndices.data());
 
 		// Set the vertex attribute pointers
 		// Vertex Positions
@@ -66,7 +326,45 @@ namespace gps {
 		// Vertex Texture Coords
 		glEnableVertexAttribArray(2);
 		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
+		// Per-instance transforms, for instanced draws
+		SetupDrawDataAttributes();
+
+		GLState::bindVertexArray(0);
+	}
+
+	void Mesh::buildLODs() {
+
+		this->lods.clear();
+		this->lodIndices.clear();
+
+		MeshLOD full = { 0, (GLuint)this->indices.size(), 0.0f };
+		this->lods.push_back(full);
+		if (this->indices.size() / 3 < LOD_MIN_TRIANGLES)
+			return;
 
-		glBindVertexArray(0);
+		glm::vec3 minimum = this->vertices[0].Position;
+		glm::vec3 maximum = minimum;
+		for (size_t i = 1; i < this->vertices.size(); i++) {
+
+			minimum = glm::min(minimum, this->vertices[i].Position);
+			maximum = glm::max(maximum, this->vertices[i].Position);
+		}
+		float size = std::max(maximum.x - minimum.x, std::max(maximum.y - minimum.y, maximum.z - minimum.z));
+		if (size <= 0.0f)
+			return;
+
+		std::vector<GLuint> clustered;
+		for (int cells = 32; cells >= 8 && this->lods.size() < MAX_LODS; cells /= 2) {
+
+			float cellSize = size / cells;
+			ClusterIndices(this->vertices, this->indices, minimum, cellSize, clustered);
+			if (clustered.empty() || clustered.size() > this->lods.back().indexCount * 3 / 4)
+				continue;
+
+			// a vertex moves at most one cell diagonal
+			MeshLOD lod = { (GLuint)(this->indices.size() + this->lodIndices.size()), (GLuint)clustered.size(), cellSize * std::sqrt(3.0f) };
+			this->lodIndices.insert(this->lodIndices.end(), clustered.begin(), clustered.end());
+			this->lods.push_back(lod);
+		}
 	}
 }
@@ -12,6 +12,7 @@
 #include <glm/glm.hpp>
 
 #include "Shader.hpp"
+#include "GLState.hpp"
 
 #include <string>
 #include <vector>
@@ -32,6 +33,12 @@ namespace gps {
         //ambientTexture, diffuseTexture, specularTexture
         std::string type;
         std::string path;
+        // resident size, after the quality tier downsample
+        int width;
+        int height;
+        // GL_TEXTURE_2D_ARRAY holding the texture (0 when it is a plain GL_TEXTURE_2D) and its layer
+        GLuint arrayId;
+        GLint layer;
     };
 
     struct Material {
@@ -41,24 +48,126 @@ namespace gps {
         glm::vec3 specular;
     };
 
+    // Object space bounds of a mesh: axis aligned box and the sphere around the box center enclosing every vertex
+    struct Bounds {
+        glm::vec3 min;
+        glm::vec3 max;
+        glm::vec3 center;
+        float radius;
+    };
+
+    // Counters of the mesh draw path, reset by the render loop every frame
+    struct DrawStats {
+        unsigned int drawCalls;
+    };
+
     struct Buffers {
         GLuint VAO;
         GLuint VBO;
         GLuint EBO;
     };
 
+    // Per-draw or per-instance record read as instanced vertex attributes (locations 3 to 11), by baseInstance + instance
+    struct DrawData {
+        glm::mat4 model;
+        glm::mat3 normalMatrix;
+        GLint materialIndex;
+        // diffuse and specular texture array layers of the draw, negative to use the layer uniforms instead
+        glm::ivec2 textureLayers;
+    };
+
+    // Index range of one level of detail, relative to the mesh's own first index, and the largest distance
+    // (object space) its surface moved from the full detail one
+    struct MeshLOD {
+        GLuint firstIndex;
+        GLuint indexCount;
+        float error;
+    };
+
+    // Layout glMultiDrawElementsIndirect reads from GL_DRAW_INDIRECT_BUFFER
+    struct DrawElementsIndirectCommand {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
     class Mesh {
 
     public:
         std::vector<Vertex> vertices;
         std::vector<GLuint> indices;
         std::vector<Texture> textures;
-
-	    Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures);
+        // Entry of the model's bindless material buffer, -1 when the mesh binds its textures
+        GLint materialIndex = -1;
+        // Id of the texture binding set, shared by meshes that bind the same textures (render queue sort key)
+        GLuint materialKey = 0;
+        // Position of the mesh inside the buffers it draws from - non zero once it shares its model's buffers
+        GLuint firstIndex = 0;
+        GLint baseVertex = 0;
+        // Computed by Model3D::ReadOBJ
+        Bounds bounds = {};
+        // Rasterized by the render queue's occlusion culler - set by Model3D::MarkOccluders
+        bool isOccluder = false;
+        // Levels of detail, [0] being all of `indices` - the coarser ones are generated with the mesh on request
+        std::vector<MeshLOD> lods;
+        // Indices of the levels past 0, stored right after `indices` in the index buffer
+        std::vector<GLuint> lodIndices;
+        // Finest level whose geometry is uploaded - levels stream in coarsest first, lods.size() while none is
+        GLuint residentLOD = 0;
+
+	    // Mesh with its full detail level only, or with the coarser levels generated too when buildLevels is set
+	    Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures, bool buildLevels = false);
+
+	    // Mesh whose levels of detail were built ahead of time (cooked models). The buffers are sized for every level
+	    // but nothing is resident until uploadLevel fills the levels in
+	    Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures,
+	        std::vector<MeshLOD> lods, std::vector<GLuint> lodIndices);
 
 	    Buffers getBuffers();
 
-	    void Draw(gps::Shader shader);
+	    // Frees the mesh's own buffers and draws from a range of buffers shared with other meshes instead
+	    void shareBuffers(Buffers shared, GLuint firstIndex, GLint baseVertex);
+
+	    void Draw(gps::Shader& shader, GLuint lod = 0);
+
+	    // Draws instanceCount copies in one call, instance i reading DrawData record baseInstance + i - needs
+	    // a shader compiled with DRAW_DATA_ATTRIBUTES and the records already in the draw data ring
+	    void DrawInstanced(gps::Shader& shader, GLsizei instanceCount, GLuint baseInstance = 0);
+
+	    // Issues the draw call alone, for callers that already bound the program and the material
+	    void drawElements(GLsizei instanceCount, GLuint baseInstance, GLuint lod = 0);
+
+	    // Binds the mesh textures to the shader's sampler units, without drawing
+	    void bindTextures(gps::Shader& shader);
+
+	    // Diffuse and specular layers of the mesh's packed textures (0 for a map that is not packed), for DrawData
+	    // records - draws batched on the same texture arrays differ only in these
+	    glm::ivec2 getTextureLayers();
+
+	    // Draws with resident texture handles - the model's material buffer must already be bound
+	    void DrawBindless(gps::Shader& shader, GLuint lod = 0);
+
+	    // Copies the geometry of one level into the mesh and its buffers - the vertices it adds starting at
+	    // firstVertex, and its indices - and makes it resident. Levels have to come coarsest first
+	    void uploadLevel(GLuint level, GLuint firstVertex, const std::vector<Vertex>& levelVertices, const std::vector<GLuint>& levelIndices);
+
+	    // Some level of detail is resident
+	    bool isResident();
+
+	    // Index count of a level of detail and its first index in the bound index buffer
+	    GLsizei getIndexCount(GLuint lod = 0);
+	    GLuint getFirstIndex(GLuint lod = 0);
+
+        // Points the DrawData attributes of the bound vertex array at the draw data ring
+        static void SetupDrawDataAttributes();
+
+        static DrawStats stats;
+
+        // Meshes with fewer triangles get no coarser levels
+        static const size_t LOD_MIN_TRIANGLES = 256;
+        static const size_t MAX_LODS = 4;
 
     private:
         /*  Render data  */
@@ -67,6 +176,9 @@ namespace gps {
 	    // Initializes all the buffer objects/arrays
 	    void setupMesh();
 
+	    // Generates the coarser levels of detail by clustering vertices on grids of 32, 16 and 8 cells
+	    // along the longest side, keeping the levels that drop at least a quarter of the triangles
+	    void buildLODs();
     };
 
 }
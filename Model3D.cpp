@@ -1,29 +1,438 @@
 #include "Model3D.hpp"
+#include "DrawDataRing.hpp"
+#include "JobSystem.hpp"
+
+#include <glm/gtc/matrix_inverse.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define GPS_HAS_SSE2 1
+#endif
 
 namespace gps {
 
+	TEXTURE_QUALITY Model3D::textureQuality = TEXTURE_QUALITY_FULL;
+	TextureLoadStats Model3D::textureStats = {};
+	bool Model3D::useTextureArrays = false;
+	bool Model3D::useBindlessTextures = false;
+	bool Model3D::useMultiDrawIndirect = false;
+	bool Model3D::useProgressiveLoading = false;
+	bool Model3D::useLODs = false;
+	std::map<std::vector<GLuint>, GLuint> Model3D::materialKeys;
+	std::unordered_map<unsigned long long, gps::Texture> Model3D::sharedTextures;
+	std::unordered_map<GLuint, int> Model3D::textureReferences;
+	std::unordered_map<GLuint64, int> Model3D::handleReferences;
+
+	// Bytes of a RGBA8 texture of the given size together with its full mip chain
+	static size_t MipChainBytes(int width, int height) {
+
+		size_t bytes = 0;
+		while (true) {
+
+			bytes += (size_t)width * height * 4;
+			if (width == 1 && height == 1)
+				break;
+			width = std::max(width / 2, 1);
+			height = std::max(height / 2, 1);
+		}
+		return bytes;
+	}
+
+	// Halves a RGBA8 image with a 2x2 box filter; dst must hold max(width/2, 1) * max(height/2, 1) pixels
+	static void DownsampleRGBA(const unsigned char* src, int width, int height, unsigned char* dst) {
+
+		int dstWidth = std::max(width / 2, 1);
+		int dstHeight = std::max(height / 2, 1);
+
+		for (int row = 0; row < dstHeight; row++) {
+
+			const unsigned char* row0 = src + (size_t)std::min(2 * row, height - 1) * width * 4;
+			const unsigned char* row1 = src + (size_t)std::min(2 * row + 1, height - 1) * width * 4;
+			unsigned char* out = dst + (size_t)row * dstWidth * 4;
+			int col = 0;
+
+#ifdef GPS_HAS_SSE2
+			// 8 source pixels -> 4 destination pixels per iteration
+			for (; 2 * (col + 4) <= width; col += 4) {
+
+				__m128i top0 = _mm_loadu_si128((const __m128i*)(row0 + col * 8));
+				__m128i top1 = _mm_loadu_si128((const __m128i*)(row0 + col * 8 + 16));
+				__m128i bottom0 = _mm_loadu_si128((const __m128i*)(row1 + col * 8));
+				__m128i bottom1 = _mm_loadu_si128((const __m128i*)(row1 + col * 8 + 16));
+
+				// vertical average, then split into even (p0 p2 ..) and odd (p1 p3 ..) pixels
+				__m128i v0 = _mm_shuffle_epi32(_mm_avg_epu8(top0, bottom0), _MM_SHUFFLE(3, 1, 2, 0));
+				__m128i v1 = _mm_shuffle_epi32(_mm_avg_epu8(top1, bottom1), _MM_SHUFFLE(3, 1, 2, 0));
+				__m128i even = _mm_unpacklo_epi64(v0, v1);
+				__m128i odd = _mm_unpackhi_epi64(v0, v1);
+
+				_mm_storeu_si128((__m128i*)(out + col * 4), _mm_avg_epu8(even, odd));
+			}
+#endif
+			// scalar tail, odd sizes and non-SSE2 targets
+			for (; col < dstWidth; col++) {
+
+				int x0 = std::min(2 * col, width - 1) * 4;
+				int x1 = std::min(2 * col + 1, width - 1) * 4;
+
+				for (int c = 0; c < 4; c++) {
+
+					out[col * 4 + c] = (unsigned char)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+				}
+			}
+		}
+	}
+
+	// Box and enclosing sphere of a mesh's vertices
+	static gps::Bounds ComputeBounds(const std::vector<gps::Vertex>& vertices) {
+
+		gps::Bounds bounds = {};
+		if (vertices.empty())
+			return bounds;
+
+		bounds.min = vertices[0].Position;
+		bounds.max = vertices[0].Position;
+		for (size_t i = 1; i < vertices.size(); i++) {
+
+			bounds.min = glm::min(bounds.min, vertices[i].Position);
+			bounds.max = glm::max(bounds.max, vertices[i].Position);
+		}
+
+		bounds.center = (bounds.min + bounds.max) * 0.5f;
+		for (size_t i = 0; i < vertices.size(); i++)
+			bounds.radius = std::max(bounds.radius, glm::length(vertices[i].Position - bounds.center));
+
+		return bounds;
+	}
+
+	// 64-bit hash of a byte buffer, mixing 8 bytes per step - used to detect identical image files
+	static unsigned long long HashBytes(const unsigned char* data, size_t size) {
+
+		unsigned long long hash = 0xcbf29ce484222325ULL ^ size;
+		size_t i = 0;
+
+		for (; i + 8 <= size; i += 8) {
+
+			unsigned long long word;
+			memcpy(&word, data + i, sizeof(word));
+			hash = (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+			hash ^= hash >> 29;
+		}
+		for (; i < size; i++) {
+
+			hash = (hash ^ data[i]) * 0x100000001b3ULL;
+		}
+		return hash ^ (hash >> 32);
+	}
+
+	static bool ReadFileBytes(const std::string& path, std::vector<unsigned char>& bytes) {
+
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if (!file)
+			return false;
+
+		bytes.resize((size_t)file.tellg());
+		file.seekg(0);
+		file.read((char*)bytes.data(), bytes.size());
+		return (bool)file;
+	}
+
+	// Whether the file at path holds exactly these bytes - confirms a content hash match before a texture is shared
+	static bool SameFileBytes(const std::string& path, const std::vector<unsigned char>& bytes) {
+
+		std::vector<unsigned char> otherBytes;
+		return ReadFileBytes(path, otherBytes) && otherBytes == bytes;
+	}
+
+	void Model3D::SetTextureQuality(TEXTURE_QUALITY quality) {
+
+		textureQuality = quality;
+	}
+
+	TEXTURE_QUALITY Model3D::GetTextureQuality() {
+
+		return textureQuality;
+	}
+
+	void Model3D::SetUseTextureArrays(bool enabled) {
+
+		useTextureArrays = enabled;
+	}
+
+	bool Model3D::GetUseTextureArrays() {
+
+		return useTextureArrays;
+	}
+
+	void Model3D::SetUseBindlessTextures(bool enabled) {
+
+#if defined (__APPLE__)
+		useBindlessTextures = false;
+#else
+		useBindlessTextures = enabled && GLEW_ARB_bindless_texture;
+#endif
+		if (enabled && !useBindlessTextures) {
+			std::cout << "ARB_bindless_texture not supported, textures are bound per draw" << std::endl;
+		}
+	}
+
+	bool Model3D::GetUseBindlessTextures() {
+
+		return useBindlessTextures;
+	}
+
+	void Model3D::SetUseMultiDrawIndirect(bool enabled) {
+
+#if defined (__APPLE__)
+		useMultiDrawIndirect = false;
+#else
+		useMultiDrawIndirect = enabled && GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance;
+#endif
+		if (enabled && !useMultiDrawIndirect) {
+			std::cout << "ARB_multi_draw_indirect not supported, meshes are drawn one call each" << std::endl;
+		}
+	}
+
+	bool Model3D::GetUseMultiDrawIndirect() {
+
+		return useMultiDrawIndirect;
+	}
+
+	TextureLoadStats Model3D::GetTextureStats() {
+
+		return textureStats;
+	}
+
+	void Model3D::ReportTextureStats() {
+
+		const double MB = 1024.0 * 1024.0;
+		std::cout << "Texture quality tier " << textureQuality << " (top " << textureQuality << " mip levels dropped)" << std::endl;
+		std::cout << "# of textures  : " << textureStats.textureCount << std::endl;
+		std::cout << "Texture VRAM   : " << textureStats.residentBytes / MB << " MB (" << textureStats.sourceBytes / MB << " MB at source resolution)" << std::endl;
+		std::cout << "Duplicates     : " << textureStats.duplicateCount << " collapsed, " << textureStats.duplicateBytes / MB << " MB VRAM saved" << std::endl;
+		std::cout << "Downsample time: " << textureStats.downsampleMs << " ms" << std::endl;
+		std::cout << "Upload time    : " << textureStats.uploadMs << " ms" << std::endl;
+	}
+
+	void Model3D::SetUseProgressiveLoading(bool enabled) {
+
+		useProgressiveLoading = enabled;
+	}
+
+	bool Model3D::GetUseProgressiveLoading() {
+
+		return useProgressiveLoading;
+	}
+
+	void Model3D::SetUseLODs(bool enabled) {
+
+		useLODs = enabled;
+	}
+
+	bool Model3D::GetUseLODs() {
+
+		return useLODs;
+	}
+
 	void Model3D::LoadModel(std::string fileName) {
 
         std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
-		ReadOBJ(fileName, basePath);
+		LoadModel(fileName, basePath);
 	}
 
     void Model3D::LoadModel(std::string fileName, std::string basePath)	{
 
+		if (useProgressiveLoading && ReadCooked(fileName))
+			return;
+
 		ReadOBJ(fileName, basePath);
+
+		if (useProgressiveLoading && !gps::CookedModel::Write(fileName + ".cooked", fileName, meshes))
+			std::cerr << "Could not write " << fileName << ".cooked" << std::endl;
 	}
 
 	// Draw each mesh from the model
-	void Model3D::Draw(gps::Shader shaderProgram) {
+	void Model3D::Draw(gps::Shader& shaderProgram) {
+
+		if (useBindlessTextures && materialBuffer != 0) {
+
+			glBindBufferBase(GL_UNIFORM_BUFFER, MATERIAL_HANDLES_BINDING, materialBuffer);
+			for (size_t i = 0; i < meshes.size(); i++)
+				if (meshes[i].isResident())
+					meshes[i].DrawBindless(shaderProgram, meshes[i].residentLOD);
+			return;
+		}
+
+		// the bindless shader falls back to the bound samplers for a negative material index
+		shaderProgram.setInt("materialIndex", -1);
+
+		for (size_t i = 0; i < meshes.size(); i++)
+			if (meshes[i].isResident())
+				meshes[i].Draw(shaderProgram, meshes[i].residentLOD);
+	}
 
-		for (int i = 0; i < meshes.size(); i++)
-			meshes[i].Draw(shaderProgram);
+	// Draws count copies of the model, one instanced draw per mesh
+	void Model3D::DrawInstanced(gps::Shader& shaderProgram, const glm::mat4* transforms, size_t count, const glm::mat4& view) {
+
+		for (size_t first = 0; first < count; first += gps::DrawDataRing::SEGMENT_RECORDS) {
+
+			size_t chunk = std::min(count - first, gps::DrawDataRing::SEGMENT_RECORDS);
+			GLuint firstRecord;
+			gps::DrawData* records = gps::DrawDataRing::Map(chunk, firstRecord);
+
+			for (size_t i = 0; i < chunk; i++) {
+
+				records[i].model = transforms[first + i];
+				records[i].normalMatrix = glm::mat3(glm::inverseTranspose(view * transforms[first + i]));
+				records[i].materialIndex = -1;
+				// every mesh reads the same records, so each one's layers come from the uniforms bindTextures sets
+				records[i].textureLayers = glm::ivec2(-1, -1);
+			}
+			gps::DrawDataRing::Unmap(chunk);
+
+			for (size_t i = 0; i < meshes.size(); i++)
+				meshes[i].DrawInstanced(shaderProgram, (GLsizei)chunk, firstRecord);
+		}
+	}
+
+	gps::Bounds Model3D::GetBounds() {
+
+		return bounds;
+	}
+
+	// Queues every mesh of the model with the given object transform instead of drawing it immediately
+	void Model3D::Submit(gps::RenderQueue& queue, gps::Shader& shaderProgram, const glm::mat4& model, const glm::mat3& normalMatrix,
+		gps::RENDER_PASS pass, gps::ImpostorRenderer* impostors, size_t instance) {
+
+		gps::LODSelector& lodSelector = queue.getLODSelector();
+		if (lodStates.size() <= instance)
+			lodStates.resize(instance + 1);
+		LODState& lodState = lodStates[instance];
+		lodState.meshLODs.resize(meshes.size(), 0);
+		lodState.cellsActive.resize(hlod.getCellCount(), false);
+
+		// object space errors grow with the largest axis scale of the transform
+		float errorScale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+
+		// a far model goes out as one billboard instead of its meshes
+		if (impostors != NULL && !impostor.empty()) {
+
+			glm::vec3 worldCenter;
+			glm::vec3 worldExtent;
+			gps::TransformBounds(bounds, model, worldCenter, worldExtent);
+			lodState.impostorActive = lodSelector.acceptsError(worldCenter, glm::length(worldExtent), impostor.getError() * errorScale, lodState.impostorActive);
+			if (lodState.impostorActive) {
+
+				impostors->add(&impostor, model);
+				lodSelector.stats.impostors++;
+				return;
+			}
+		}
+
+		GLuint transformIndex = queue.addTransform(model, normalMatrix);
+		GLuint bindlessBuffer = useBindlessTextures ? materialBuffer : 0;
+
+		// the set of the camera's cell goes first, everything after only sees the meshes it holds
+		const std::vector<GLuint>* potentiallyVisible = NULL;
+		if (!pvs.empty())
+			potentiallyVisible = pvs.query(glm::vec3(glm::inverse(model) * glm::vec4(queue.getCameraPosition(), 1.0f)));
+
+		visibleMeshes.clear();
+		if (!bvh.empty()) {
+
+			// the planes of projection * view * model are the frustum in the model's own space
+			bvh.cull(gps::Frustum::FromMatrix(queue.getViewProjection() * model), visibleMeshes);
+		}
+		else {
+
+			for (size_t i = 0; i < meshes.size(); i++)
+				visibleMeshes.push_back((GLuint)i);
+		}
+
+		if (potentiallyVisible != NULL) {
+
+			visibleMeshes.erase(std::remove_if(visibleMeshes.begin(), visibleMeshes.end(),
+				[potentiallyVisible](GLuint mesh) { return !gps::PVS::Contains(*potentiallyVisible, mesh); }), visibleMeshes.end());
+		}
+
+		// far cells go out as one proxy, their meshes are skipped below
+		for (size_t c = 0; c < hlod.getCellCount(); c++) {
+
+			gps::HLODCell& cell = hlod.getCell(c);
+			glm::vec3 worldCenter;
+			glm::vec3 worldExtent;
+			gps::TransformBounds(cell.bounds, model, worldCenter, worldExtent);
+			lodState.cellsActive[c] = lodSelector.acceptsError(worldCenter, glm::length(worldExtent), cell.error * errorScale, lodState.cellsActive[c]);
+			if (!lodState.cellsActive[c])
+				continue;
+
+			queue.submit(&hlod.getProxy(c), &shaderProgram, transformIndex, 0, worldCenter, worldExtent, pass);
+			lodSelector.stats.proxies++;
+			lodSelector.stats.replaced += (unsigned int)cell.members.size();
+		}
+
+		for (size_t i = 0; i < visibleMeshes.size(); i++) {
+
+			int cell = hlod.getMeshCell(visibleMeshes[i]);
+			if (cell >= 0 && lodState.cellsActive[cell])
+				continue;
+
+			gps::Mesh& mesh = meshes[visibleMeshes[i]];
+			if (!mesh.isResident())
+				continue;
+
+			glm::vec3 worldCenter;
+			glm::vec3 worldExtent;
+			gps::TransformBounds(mesh.bounds, model, worldCenter, worldExtent);
+
+			// a mesh still streaming in goes out with the finest level it has
+			GLuint& lod = lodState.meshLODs[visibleMeshes[i]];
+			lod = lodSelector.select(mesh, worldCenter, glm::length(worldExtent), errorScale, lod);
+			queue.submit(&mesh, &shaderProgram, transformIndex, bindlessBuffer, worldCenter, worldExtent, pass, std::max(lod, mesh.residentLOD));
+		}
+	}
+
+	size_t Model3D::MarkOccluders(float minRadius, size_t maxTriangles) {
+
+		size_t occluders = 0;
+		for (size_t i = 0; i < meshes.size(); i++) {
+
+			gps::Mesh& mesh = meshes[i];
+			mesh.isOccluder = mesh.bounds.radius >= minRadius && mesh.indices.size() / 3 <= maxTriangles;
+			if (mesh.isOccluder)
+				occluders++;
+		}
+
+		return occluders;
+	}
+
+	size_t Model3D::BuildHLOD(float cellSize) {
+
+		hlod.build(meshes, cellSize);
+		// the cells of the previous build are gone, and so is whether they stood in
+		for (size_t i = 0; i < lodStates.size(); i++)
+			lodStates[i].cellsActive.clear();
+
+		// proxies bind their atlas through the regular textures, also when the model is bindless
+		for (size_t i = 0; i < hlod.getCellCount(); i++) {
+
+			gps::Mesh& proxy = hlod.getProxy(i);
+			proxy.materialKey = FindMaterialKey(std::vector<GLuint>(1, proxy.textures[0].id));
+		}
+
+		return hlod.getCellCount();
 	}
 
 	// Does the parsing of the .obj file and fills in the data structure
 	void Model3D::ReadOBJ(std::string fileName, std::string basePath) {
 
         std::cout << "Loading : " << fileName << std::endl;
+		modelFileName = fileName;
 		tinyobj::attrib_t attrib;
 		std::vector<tinyobj::shape_t> shapes;
 		std::vector<tinyobj::material_t> materials;
@@ -46,6 +455,25 @@ namespace gps {
 		std::cout << "# of shapes    : " << shapes.size() << std::endl;
 		std::cout << "# of materials : " << materials.size() << std::endl;
 
+		TextureLoadStats statsBefore = textureStats;
+
+		// the textures of the materials in use, decoded in parallel before the shapes pick them up one by one
+		std::vector<std::string> texturePaths;
+		for (size_t s = 0; s < shapes.size(); s++) {
+
+			if (shapes[s].mesh.material_ids.empty() || shapes[s].mesh.material_ids[0] < 0 || shapes[s].mesh.material_ids[0] >= (int)materials.size())
+				continue;
+
+			const tinyobj::material_t& material = materials[shapes[s].mesh.material_ids[0]];
+			if (!material.ambient_texname.empty())
+				texturePaths.push_back(basePath + material.ambient_texname);
+			if (!material.diffuse_texname.empty())
+				texturePaths.push_back(basePath + material.diffuse_texname);
+			if (!material.specular_texname.empty())
+				texturePaths.push_back(basePath + material.specular_texname);
+		}
+		PrefetchTextures(texturePaths);
+
 		// Loop over shapes
 		for (size_t s = 0; s < shapes.size(); s++) {
 
@@ -146,39 +574,347 @@ namespace gps {
 				}
 			}
 
-			meshes.push_back(gps::Mesh(vertices, indices, textures));
+			meshes.push_back(gps::Mesh(vertices, indices, textures, useLODs || useProgressiveLoading));
+			meshes.back().bounds = ComputeBounds(vertices);
 		}
+		ClearPrefetchedTextures();
+
+		SetupMeshes(fileName, statsBefore);
+	}
+
+	// Creates the meshes of a cooked model with buffers for all their levels but no geometry yet, and starts
+	// streaming the levels in, coarsest first
+	bool Model3D::ReadCooked(std::string fileName) {
+
+		std::vector<gps::CookedMesh> cookedMeshes;
+		std::unique_ptr<gps::CookedModel> file(new gps::CookedModel());
+		if (!file->open(fileName + ".cooked", fileName, cookedMeshes))
+			return false;
+
+		std::cout << "Loading : " << fileName << ".cooked" << std::endl;
+		std::cout << "# of meshes    : " << cookedMeshes.size() << std::endl;
+		modelFileName = fileName;
+
+		TextureLoadStats statsBefore = textureStats;
+
+		std::vector<std::string> texturePaths;
+		for (size_t m = 0; m < cookedMeshes.size(); m++) {
+
+			for (size_t t = 0; t < cookedMeshes[m].textures.size(); t++)
+				texturePaths.push_back(cookedMeshes[m].textures[t].path);
+		}
+		PrefetchTextures(texturePaths);
+
+		for (size_t m = 0; m < cookedMeshes.size(); m++) {
+
+			const gps::CookedMesh& cooked = cookedMeshes[m];
+			std::vector<gps::Texture> textures;
+			for (size_t t = 0; t < cooked.textures.size(); t++)
+				textures.push_back(LoadTexture(cooked.textures[t].path, cooked.textures[t].type));
+
+			meshes.push_back(gps::Mesh(std::vector<gps::Vertex>(cooked.vertexCount), std::vector<GLuint>(cooked.indexCount), textures,
+				cooked.lods, std::vector<GLuint>(cooked.lodIndexCount)));
+			meshes.back().bounds = cooked.bounds;
+		}
+		ClearPrefetchedTextures();
+
+		SetupMeshes(fileName, statsBefore);
+
+		cookedModel = std::move(file);
+		cookedModel->startStreaming();
+		return true;
+	}
+
+	// Everything that follows the parsing of the meshes, for .obj and cooked files alike
+	void Model3D::SetupMeshes(const std::string& fileName, const TextureLoadStats& statsBefore) {
+
+		if (!pendingArrayLayers.empty()) {
+
+			BuildTextureArrays();
+		}
+
+		if (useBindlessTextures) {
+
+			BuildBindlessMaterials();
+		}
+
+		AssignMaterialKeys();
+
+		if (useMultiDrawIndirect && !meshes.empty()) {
+
+			BuildSharedBuffers();
+		}
+
+		if (meshes.size() >= BVH_MIN_MESHES) {
+
+			BuildBVH(fileName);
+		}
+
+		for (size_t i = 0; i < meshes.size(); i++) {
+
+			bounds.min = i == 0 ? meshes[i].bounds.min : glm::min(bounds.min, meshes[i].bounds.min);
+			bounds.max = i == 0 ? meshes[i].bounds.max : glm::max(bounds.max, meshes[i].bounds.max);
+		}
+		bounds.center = (bounds.min + bounds.max) * 0.5f;
+		for (size_t i = 0; i < meshes.size(); i++)
+			bounds.radius = std::max(bounds.radius, glm::length(meshes[i].bounds.center - bounds.center) + meshes[i].bounds.radius);
+
+		std::cout << "# of textures  : " << textureStats.textureCount - statsBefore.textureCount
+			<< " (" << textureStats.duplicateCount - statsBefore.duplicateCount << " duplicates collapsed, "
+			<< (textureStats.duplicateBytes - statsBefore.duplicateBytes) / (1024.0 * 1024.0) << " MB saved)" << std::endl;
+	}
+
+	void Model3D::UpdateStreaming(size_t maxBytes) {
+
+		if (!cookedModel)
+			return;
+
+		streamedChunks.clear();
+		cookedModel->takeChunks(streamedChunks, maxBytes);
+		for (size_t i = 0; i < streamedChunks.size(); i++) {
+
+			gps::CookedChunk& chunk = streamedChunks[i];
+			meshes[chunk.mesh].uploadLevel(chunk.level, chunk.firstVertex, chunk.vertices, chunk.indices);
+		}
+
+		if (cookedModel->finished())
+			cookedModel.reset();
+	}
+
+	void Model3D::FinishStreaming() {
+
+		if (!cookedModel)
+			return;
+
+		cookedModel->wait();
+		UpdateStreaming((size_t)-1);
+	}
+
+	bool Model3D::IsStreaming() {
+
+		return (bool)cookedModel;
+	}
+
+	bool Model3D::IsDrawable() {
+
+		for (size_t i = 0; i < meshes.size(); i++) {
+
+			if (!meshes[i].isResident())
+				return false;
+		}
+		return true;
+	}
+
+	// Reads, hashes and decodes the texture files on the job system's workers, ahead of the LoadTexture calls
+	// that upload them
+	void Model3D::PrefetchTextures(const std::vector<std::string>& paths) {
+
+		std::vector<std::string> pending;
+		for (size_t i = 0; i < paths.size(); i++) {
+
+			if (texturesByPath.count(paths[i]) == 0 && prefetchedFiles.count(paths[i]) == 0
+				&& std::find(pending.begin(), pending.end(), paths[i]) == pending.end())
+				pending.push_back(paths[i]);
+		}
+
+		std::vector<std::vector<unsigned char>> fileBytes(pending.size());
+		std::vector<PrefetchedFile> files(pending.size());
+		JobSystem::ParallelFor(0, pending.size(), 1, [&](size_t first, size_t end) {
+
+			for (size_t i = first; i < end; i++) {
+
+				files[i].read = ReadFileBytes(pending[i], fileBytes[i]);
+				files[i].contentHash = files[i].read ? HashBytes(fileBytes[i].data(), fileBytes[i].size()) : 0;
+			}
+		});
+
+		// every distinct image once, and none that is loaded already
+		std::vector<size_t> decodes;
+		for (size_t i = 0; i < pending.size(); i++) {
+
+			prefetchedFiles[pending[i]] = files[i];
+			if (files[i].read && texturesByContent.count(files[i].contentHash) == 0 && sharedTextures.count(files[i].contentHash) == 0
+				&& decodedImages.count(files[i].contentHash) == 0) {
+
+				decodedImages[files[i].contentHash] = DecodedImage();
+				decodes.push_back(i);
+			}
+		}
+
+		std::vector<DecodedImage> images(decodes.size());
+		JobSystem::ParallelFor(0, decodes.size(), 1, [&](size_t first, size_t end) {
+
+			for (size_t d = first; d < end; d++)
+				images[d] = DecodeImage(fileBytes[decodes[d]]);
+		});
+		for (size_t d = 0; d < decodes.size(); d++)
+			decodedImages[files[decodes[d]].contentHash] = images[d];
+	}
+
+	// Frees the prefetched images no mesh ended up using
+	void Model3D::ClearPrefetchedTextures() {
+
+		for (auto image = decodedImages.begin(); image != decodedImages.end(); image++) {
+
+			if (image->second.pixels)
+				stbi_image_free(image->second.pixels);
+		}
+		decodedImages.clear();
+		prefetchedFiles.clear();
 	}
 
 	// Retrieves a texture associated with the object - by its name and type
 	gps::Texture Model3D::LoadTexture(std::string path, std::string type) {
 
-			for (int i = 0; i < loadedTextures.size(); i++) {
+		auto byPath = texturesByPath.find(path);
+		if (byPath != texturesByPath.end()) {
+
+			//already loaded texture
+			gps::Texture loadedTexture = loadedTextures[byPath->second];
+			loadedTexture.type = type;
+			return loadedTexture;
+		}
+
+		// prefetched files come with their hash, the others are read here
+		std::vector<unsigned char> fileBytes;
+		auto prefetched = prefetchedFiles.find(path);
+		bool read = prefetched != prefetchedFiles.end() ? prefetched->second.read : ReadFileBytes(path, fileBytes);
+		if (!read) {
 
-				if (loadedTextures[i].path == path)	{
+			fprintf(stderr, "ERROR: could not load %s\n", path.c_str());
+			gps::Texture missingTexture = {};
+			missingTexture.type = type;
+			missingTexture.path = path;
 
-					//already loaded texture
-					return loadedTextures[i];
+			texturesByPath[path] = loadedTextures.size();
+			loadedTextures.push_back(missingTexture);
+			return missingTexture;
+		}
+
+		// same image exported under a different name - hash the file bytes before paying for the decode
+		unsigned long long contentHash = prefetched != prefetchedFiles.end() ? prefetched->second.contentHash
+			: HashBytes(fileBytes.data(), fileBytes.size());
+		auto byContent = texturesByContent.find(contentHash);
+		auto shared = sharedTextures.find(contentHash);
+		if (byContent != texturesByContent.end() || shared != sharedTextures.end()) {
+
+			// 64 bits can still collide - reuse only a texture read from the very same bytes
+			if (fileBytes.empty())
+				ReadFileBytes(path, fileBytes);
+
+			if (byContent != texturesByContent.end() && SameFileBytes(loadedTextures[byContent->second].path, fileBytes)) {
+
+				gps::Texture loadedTexture = loadedTextures[byContent->second];
+				texturesByPath[path] = byContent->second;
+				textureStats.duplicateCount++;
+				textureStats.duplicateBytes += MipChainBytes(loadedTexture.width, loadedTexture.height);
+
+				loadedTexture.type = type;
+				return loadedTexture;
+			}
+
+			if (shared != sharedTextures.end() && SameFileBytes(shared->second.path, fileBytes)) {
+
+				// uploaded by another model - this one holds a reference until it is destroyed
+				gps::Texture sharedTexture = shared->second;
+				if (sharedTexture.id != 0)
+					textureReferences[sharedTexture.id]++;
+				if (sharedTexture.arrayId != 0 && std::find(textureArrays.begin(), textureArrays.end(), sharedTexture.arrayId) == textureArrays.end()) {
+
+					textureReferences[sharedTexture.arrayId]++;
+					textureArrays.push_back(sharedTexture.arrayId);
 				}
+				textureStats.duplicateCount++;
+				textureStats.duplicateBytes += MipChainBytes(sharedTexture.width, sharedTexture.height);
+
+				sharedTexture.type = type;
+				sharedTexture.path = path;
+				texturesByPath[path] = loadedTextures.size();
+				texturesByContent[contentHash] = loadedTextures.size();
+				loadedTextures.push_back(sharedTexture);
+				return sharedTexture;
 			}
+		}
 
-			gps::Texture currentTexture;
-			currentTexture.id = ReadTextureFromFile(path.c_str());
-			currentTexture.type = std::string(type);
-			currentTexture.path = path;
+		DecodedImage image;
+		auto decoded = decodedImages.find(contentHash);
+		if (decoded != decodedImages.end()) {
 
-			loadedTextures.push_back(currentTexture);
+			image = decoded->second;
+			decodedImages.erase(decoded);
+		} else {
 
-			return currentTexture;
+			if (fileBytes.empty())
+				ReadFileBytes(path, fileBytes);
+			image = DecodeImage(fileBytes);
 		}
 
-	// Reads the pixel data from an image file and loads it into the video memory
-	GLuint Model3D::ReadTextureFromFile(const char* file_name) {
+		if (image.pixels) {
 
-		int x, y, n;
-		int force_channels = 4;
-		unsigned char* image_data = stbi_load(file_name, &x, &y, &n, force_channels);
+			textureStats.sourceBytes += MipChainBytes(image.sourceWidth, image.sourceHeight);
+			textureStats.downsampleMs += image.downsampleMs;
+		}
 
+		gps::Texture currentTexture = {};
+		currentTexture.id = ReadTextureFromFile(path.c_str(), image.pixels, image.width, image.height, currentTexture.width, currentTexture.height);
+		currentTexture.type = std::string(type);
+		currentTexture.path = path;
+
+		texturesByPath[path] = loadedTextures.size();
+		texturesByContent[contentHash] = loadedTextures.size();
+		loadedTextures.push_back(currentTexture);
+
+		// array layers join the shared cache once BuildTextureArrays has packed them
+		if (currentTexture.id != 0) {
+
+			textureReferences[currentTexture.id]++;
+			sharedTextures.insert(std::make_pair(contentHash, currentTexture));
+		}
+
+		return currentTexture;
+	}
+
+	// Decodes to RGBA8 and drops the top mip levels of the current quality tier before anything else touches the
+	// pixels - the smaller image is copied back over the start of the stb_image buffer, which stays the owner
+	Model3D::DecodedImage Model3D::DecodeImage(const std::vector<unsigned char>& bytes) {
+
+		DecodedImage image = {};
+		int n;
+		image.pixels = stbi_load_from_memory(bytes.data(), (int)bytes.size(), &image.sourceWidth, &image.sourceHeight, &n, 4);
+		if (!image.pixels)
+			return image;
+
+		auto downsampleStart = std::chrono::high_resolution_clock::now();
+		std::vector<unsigned char> downsampled;
+		const unsigned char* pixels = image.pixels;
+		int x = image.sourceWidth;
+		int y = image.sourceHeight;
+
+		for (int level = 0; level < textureQuality && (x > 1 || y > 1); level++) {
+
+			int nextX = std::max(x / 2, 1);
+			int nextY = std::max(y / 2, 1);
+			std::vector<unsigned char> next((size_t)nextX * nextY * 4);
+			DownsampleRGBA(pixels, x, y, next.data());
+
+			downsampled.swap(next);
+			pixels = downsampled.data();
+			x = nextX;
+			y = nextY;
+		}
+		if (!downsampled.empty())
+			memcpy(image.pixels, downsampled.data(), downsampled.size());
+
+		image.width = x;
+		image.height = y;
+		image.downsampleMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - downsampleStart).count();
+		return image;
+	}
+
+	// Loads decoded stb_image pixels (freed here) into the video memory
+	GLuint Model3D::ReadTextureFromFile(const char* file_name, unsigned char* image_data, int x, int y, int& width, int& height) {
+
+		width = height = 0;
 		if (!image_data) {
 			fprintf(stderr, "ERROR: could not load %s\n", file_name);
 			return false;
@@ -190,6 +926,9 @@ namespace gps {
 			);
 		}
 
+		textureStats.textureCount++;
+		unsigned char* pixels = image_data;
+
 		int width_in_bytes = x * 4;
 		unsigned char *top = NULL;
 		unsigned char *bottom = NULL;
@@ -198,8 +937,8 @@ namespace gps {
 
 		for (int row = 0; row < half_height; row++) {
 
-			top = image_data + row * width_in_bytes;
-			bottom = image_data + (y - row - 1) * width_in_bytes;
+			top = pixels + row * width_in_bytes;
+			bottom = pixels + (y - row - 1) * width_in_bytes;
 
 			for (int col = 0; col < width_in_bytes; col++) {
 
@@ -211,26 +950,410 @@ namespace gps {
 			}
 		}
 
+		width = x;
+		height = y;
+
+		if (useTextureArrays && !useBindlessTextures) {
+
+			// uploaded as a layer of a texture array once the whole model is read - see BuildTextureArrays
+			pendingArrayLayers[file_name].assign(pixels, pixels + (size_t)x * y * 4);
+			stbi_image_free(image_data);
+			return 0;
+		}
+
+		auto uploadStart = std::chrono::high_resolution_clock::now();
 		GLuint textureID;
 		glGenTextures(1, &textureID);
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, x, y, 0, GL_RGBA, GL_UNSIGNED_BYTE, image_data);
+		GLState::bindTexture(0, GL_TEXTURE_2D, textureID);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, x, y, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
 		glGenerateMipmap(GL_TEXTURE_2D);
 
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glBindTexture(GL_TEXTURE_2D, 0);
+		textureStats.uploadMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - uploadStart).count();
+		textureStats.residentBytes += MipChainBytes(x, y);
+
+		stbi_image_free(image_data);
 
 		return textureID;
 	}
 
+	// Packs the decoded textures into arrays and points the meshes at their layers
+	void Model3D::BuildTextureArrays() {
+
+		// every texture is RGBA8, so the size alone decides which array a texture can share
+		std::map<std::pair<int, int>, std::vector<size_t>> textureGroups;
+		for (size_t i = 0; i < loadedTextures.size(); i++) {
+
+			if (pendingArrayLayers.count(loadedTextures[i].path) > 0)
+				textureGroups[std::make_pair(loadedTextures[i].width, loadedTextures[i].height)].push_back(i);
+		}
+
+		GLint maxLayers = 256;
+		glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+
+		auto uploadStart = std::chrono::high_resolution_clock::now();
+
+		for (auto& group : textureGroups) {
+
+			int width = group.first.first;
+			int height = group.first.second;
+			std::vector<size_t>& members = group.second;
+
+			for (size_t first = 0; first < members.size(); first += maxLayers) {
+
+				GLsizei layerCount = (GLsizei)std::min(members.size() - first, (size_t)maxLayers);
+
+				GLuint arrayID;
+				glGenTextures(1, &arrayID);
+				GLState::bindTexture(0, GL_TEXTURE_2D_ARRAY, arrayID);
+				glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, width, height, layerCount, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+				for (GLsizei layer = 0; layer < layerCount; layer++) {
+
+					gps::Texture& texture = loadedTextures[members[first + layer]];
+					glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, pendingArrayLayers[texture.path].data());
+					texture.arrayId = arrayID;
+					texture.layer = layer;
+				}
+
+				glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+				glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+				glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+				glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+				glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+				textureArrays.push_back(arrayID);
+				textureReferences[arrayID]++;
+				textureStats.residentBytes += MipChainBytes(width, height) * layerCount;
+			}
+		}
+
+		textureStats.uploadMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - uploadStart).count();
+		pendingArrayLayers.clear();
+
+		for (auto byContent = texturesByContent.begin(); byContent != texturesByContent.end(); byContent++) {
+
+			const gps::Texture& texture = loadedTextures[byContent->second];
+			if (texture.arrayId != 0)
+				sharedTextures.insert(std::make_pair(byContent->first, texture));
+		}
+
+		// the meshes copied their textures before the arrays existed
+		for (size_t i = 0; i < meshes.size(); i++) {
+
+			for (size_t t = 0; t < meshes[i].textures.size(); t++) {
+
+				auto byPath = texturesByPath.find(meshes[i].textures[t].path);
+				if (byPath == texturesByPath.end())
+					continue;
+
+				meshes[i].textures[t].arrayId = loadedTextures[byPath->second].arrayId;
+				meshes[i].textures[t].layer = loadedTextures[byPath->second].layer;
+			}
+		}
+
+		std::cout << "# of tex arrays: " << textureArrays.size() << " (" << textureGroups.size() << " texture sizes)" << std::endl;
+	}
+
+	// Makes the textures resident and uploads one (diffuse, specular) handle pair per material
+	void Model3D::BuildBindlessMaterials() {
+
+#if not defined (__APPLE__)
+		std::unordered_map<GLuint, GLuint64> handlesByTexture;
+		std::map<std::pair<GLuint, GLuint>, GLint> materialsByTextures;
+		std::vector<GLuint64> materialHandles;
+
+		auto residentHandle = [&](GLuint textureID) -> GLuint64 {
+
+			// a missing map samples black, like an unbound sampler on the bind path
+			if (textureID == 0) {
+
+				if (placeholderTexture == 0) {
+
+					const unsigned char black[4] = { 0, 0, 0, 255 };
+					glGenTextures(1, &placeholderTexture);
+					GLState::bindTexture(0, GL_TEXTURE_2D, placeholderTexture);
+					glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, black);
+					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+				}
+				textureID = placeholderTexture;
+			}
+
+			auto found = handlesByTexture.find(textureID);
+			if (found != handlesByTexture.end())
+				return found->second;
+
+			// another model sharing the texture may have made its handle resident already
+			GLuint64 handle = glGetTextureHandleARB(textureID);
+			if (handleReferences[handle]++ == 0)
+				glMakeTextureHandleResidentARB(handle);
+			residentHandles.push_back(handle);
+			handlesByTexture[textureID] = handle;
+			return handle;
+		};
+
+		for (size_t i = 0; i < meshes.size(); i++) {
+
+			GLuint diffuseID = 0;
+			GLuint specularID = 0;
+			for (size_t t = 0; t < meshes[i].textures.size(); t++) {
+
+				if (meshes[i].textures[t].type == "diffuseTexture")
+					diffuseID = meshes[i].textures[t].id;
+				else if (meshes[i].textures[t].type == "specularTexture")
+					specularID = meshes[i].textures[t].id;
+			}
+
+			std::pair<GLuint, GLuint> key = std::make_pair(diffuseID, specularID);
+			auto found = materialsByTextures.find(key);
+			if (found != materialsByTextures.end()) {
+
+				meshes[i].materialIndex = found->second;
+				continue;
+			}
+
+			if (materialsByTextures.size() == MAX_BINDLESS_MATERIALS) {
+
+				// without a material buffer the whole model keeps the bind-per-draw path
+				std::cerr << "WARNING: more than " << MAX_BINDLESS_MATERIALS << " materials, textures are bound per draw" << std::endl;
+				return;
+			}
+
+			GLint materialIndex = (GLint)materialsByTextures.size();
+			materialsByTextures[key] = materialIndex;
+			meshes[i].materialIndex = materialIndex;
+
+			// std140 uvec4 per material: xy - diffuse handle, zw - specular handle
+			materialHandles.push_back(residentHandle(diffuseID));
+			materialHandles.push_back(residentHandle(specularID));
+		}
+
+		if (materialHandles.empty())
+			return;
+
+		glGenBuffers(1, &materialBuffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, materialBuffer);
+		glBufferData(GL_UNIFORM_BUFFER, materialHandles.size() * sizeof(GLuint64), materialHandles.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+		std::cout << "# of bindless materials: " << materialsByTextures.size() << " (" << residentHandles.size() << " resident textures)" << std::endl;
+#endif
+	}
+
+	// Gives every mesh the id of its texture binding set
+	void Model3D::AssignMaterialKeys() {
+
+		for (size_t i = 0; i < meshes.size(); i++) {
+
+			// what actually gets bound: the model's material buffer, the texture arrays, or the 2D textures by type
+			std::vector<GLuint> bindings;
+			if (materialBuffer != 0) {
+
+				bindings.push_back(0xFFFFFFFFu);
+				bindings.push_back(materialBuffer);
+			}
+			else {
+
+				for (size_t t = 0; t < meshes[i].textures.size(); t++) {
+
+					const gps::Texture& texture = meshes[i].textures[t];
+					bindings.push_back(texture.arrayId != 0 ? texture.arrayId : texture.id);
+				}
+			}
+
+			meshes[i].materialKey = FindMaterialKey(bindings);
+		}
+	}
+
+	GLuint Model3D::FindMaterialKey(const std::vector<GLuint>& bindings) {
+
+		auto found = materialKeys.find(bindings);
+		if (found == materialKeys.end())
+			found = materialKeys.insert(std::make_pair(bindings, (GLuint)materialKeys.size() + 1)).first;
+
+		return found->second;
+	}
+
+	// Copies the geometry of every mesh into one vertex array, so a whole model is a single indirect batch
+	void Model3D::BuildSharedBuffers() {
+
+		std::vector<gps::Vertex> vertices;
+		std::vector<GLuint> indices;
+		std::vector<GLuint> firstIndices;
+		std::vector<GLint> baseVertices;
+
+		for (size_t i = 0; i < meshes.size(); i++) {
+
+			firstIndices.push_back((GLuint)indices.size());
+			baseVertices.push_back((GLint)vertices.size());
+			vertices.insert(vertices.end(), meshes[i].vertices.begin(), meshes[i].vertices.end());
+			indices.insert(indices.end(), meshes[i].indices.begin(), meshes[i].indices.end());
+			indices.insert(indices.end(), meshes[i].lodIndices.begin(), meshes[i].lodIndices.end());
+		}
+
+		glGenVertexArrays(1, &sharedBuffers.VAO);
+		glGenBuffers(1, &sharedBuffers.VBO);
+		glGenBuffers(1, &sharedBuffers.EBO);
+
+		GLState::bindVertexArray(sharedBuffers.VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, sharedBuffers.VBO);
+		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(gps::Vertex), vertices.data(), GL_STATIC_DRAW);
+
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sharedBuffers.EBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+
+		// same layout as Mesh::setupMesh, plus the per-draw records
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(gps::Vertex), (GLvoid*)0);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(gps::Vertex), (GLvoid*)offsetof(gps::Vertex, Normal));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(gps::Vertex), (GLvoid*)offsetof(gps::Vertex, TexCoords));
+		gps::Mesh::SetupDrawDataAttributes();
+
+		GLState::bindVertexArray(0);
+
+		for (size_t i = 0; i < meshes.size(); i++) {
+
+			meshes[i].shareBuffers(sharedBuffers, firstIndices[i], baseVertices[i]);
+		}
+	}
+
+	void Model3D::BuildImpostor(gps::Shader& bakeShader, bool rebake) {
+
+		unsigned long long sourceKey = gps::Impostor::SourceKey(meshes, textureQuality);
+		std::string impostorFileName = modelFileName + ".impostor";
+		if (!rebake && impostor.load(impostorFileName, sourceKey)) {
+
+			std::cout << "Impostor       : loaded from " << impostorFileName << std::endl;
+			return;
+		}
+
+		auto bakeStart = std::chrono::high_resolution_clock::now();
+		impostor.bake(meshes, bounds, bakeShader);
+		if (impostor.empty())
+			return;
+		// the atlases are read back for the file, which also waits for the bake to finish
+		bool saved = impostor.save(impostorFileName, sourceKey);
+		double bakeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - bakeStart).count();
+
+		std::cout << "Impostor       : " << gps::Impostor::GRID * gps::Impostor::GRID << " views baked in " << bakeMs << " ms" << std::endl;
+		if (!saved)
+			std::cerr << "Could not write " << impostorFileName << std::endl;
+	}
+
+	size_t Model3D::BakePVS(float cellSize) {
+
+		std::vector<gps::Bounds> meshBounds(meshes.size());
+		for (size_t i = 0; i < meshes.size(); i++)
+			meshBounds[i] = meshes[i].bounds;
+
+		pvs.bake(meshes, bounds, cellSize);
+		std::string pvsFileName = modelFileName + ".pvs";
+		if (!pvs.save(pvsFileName, meshBounds))
+			std::cerr << "Could not write " << pvsFileName << std::endl;
+		return pvs.getCellCount();
+	}
+
+	bool Model3D::LoadPVS() {
+
+		std::vector<gps::Bounds> meshBounds(meshes.size());
+		for (size_t i = 0; i < meshes.size(); i++)
+			meshBounds[i] = meshes[i].bounds;
+
+		std::string pvsFileName = modelFileName + ".pvs";
+		if (!pvs.load(pvsFileName, meshBounds))
+			return false;
+
+		std::cout << "PVS            : " << pvs.getCellCount() << " cells, " << pvs.getSetCount() << " distinct sets in "
+			<< pvs.getCompressedBytes() << " bytes (" << pvs.getRawBytes() << " as plain bitsets), loaded from " << pvsFileName << std::endl;
+		return true;
+	}
+
+	// Loads the hierarchy saved next to the model, or builds and saves it when missing or stale
+	void Model3D::BuildBVH(const std::string& fileName) {
+
+		std::vector<gps::Bounds> bounds(meshes.size());
+		for (size_t i = 0; i < meshes.size(); i++)
+			bounds[i] = meshes[i].bounds;
+
+		std::string bvhFileName = fileName + ".bvh";
+		if (bvh.load(bvhFileName, bounds)) {
+
+			std::cout << "BVH            : " << bvh.getNodeCount() << " nodes, loaded from " << bvhFileName << std::endl;
+			return;
+		}
+
+		auto buildStart = std::chrono::high_resolution_clock::now();
+		bvh.build(bounds);
+		double buildMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - buildStart).count();
+
+		std::cout << "BVH            : " << bvh.getNodeCount() << " nodes, built in " << buildMs << " ms" << std::endl;
+		if (!bvh.save(bvhFileName))
+			std::cerr << "Could not write " << bvhFileName << std::endl;
+	}
+
+	// Drops one model's reference to a texture or texture array - the last one deletes it and forgets its content
+	void Model3D::ReleaseTexture(GLuint textureID) {
+
+		auto references = textureReferences.find(textureID);
+		if (references == textureReferences.end() || --references->second > 0)
+			return;
+
+		textureReferences.erase(references);
+		for (auto shared = sharedTextures.begin(); shared != sharedTextures.end();) {
+
+			if (shared->second.id == textureID || shared->second.arrayId == textureID)
+				shared = sharedTextures.erase(shared);
+			else
+				shared++;
+		}
+		glDeleteTextures(1, &textureID);
+	}
+
 	Model3D::~Model3D() {
 
+#if not defined (__APPLE__)
+        for (size_t i = 0; i < residentHandles.size(); i++) {
+
+            if (--handleReferences[residentHandles[i]] == 0) {
+
+                glMakeTextureHandleNonResidentARB(residentHandles[i]);
+                handleReferences.erase(residentHandles[i]);
+            }
+        }
+#endif
+
+        if (materialBuffer != 0) {
+
+            glDeleteBuffers(1, &materialBuffer);
+        }
+
+        if (placeholderTexture != 0) {
+
+            glDeleteTextures(1, &placeholderTexture);
+        }
+
         for (size_t i = 0; i < loadedTextures.size(); i++) {
 
-            glDeleteTextures(1, &loadedTextures.at(i).id);
+            ReleaseTexture(loadedTextures.at(i).id);
+        }
+
+        for (size_t i = 0; i < textureArrays.size(); i++) {
+
+            ReleaseTexture(textureArrays[i]);
+        }
+
+        if (sharedBuffers.VAO != 0) {
+
+            glDeleteBuffers(1, &sharedBuffers.VBO);
+            glDeleteBuffers(1, &sharedBuffers.EBO);
+            glDeleteVertexArrays(1, &sharedBuffers.VAO);
+            return;
         }
 
         for (size_t i = 0; i < meshes.size(); i++) {
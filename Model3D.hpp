@@ -1,42 +1,274 @@
 #ifndef Model3D_hpp
 #define Model3D_hpp
 
+#include "CookedModel.hpp"
+#include "HLOD.hpp"
+#include "Impostor.hpp"
 #include "Mesh.hpp"
+#include "PVS.hpp"
+#include "RenderQueue.hpp"
+#include "SceneBVH.hpp"
 
 #include "tiny_obj_loader.h"
 #include "stb_image.h"
 
 #include <iostream>
+#include <map>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace gps {
 
+    // Texture quality tiers - the value is the number of top mip levels dropped at load time
+    enum TEXTURE_QUALITY {TEXTURE_QUALITY_FULL, TEXTURE_QUALITY_HALF, TEXTURE_QUALITY_QUARTER, TEXTURE_QUALITY_EIGHTH};
+
+    // Texture memory and timing totals accumulated over every loaded model
+    struct TextureLoadStats {
+        int textureCount;
+        size_t sourceBytes;     // VRAM the textures would take at source resolution (with mips)
+        size_t residentBytes;   // VRAM actually allocated at the current quality tier (with mips)
+        int duplicateCount;     // differently named files collapsed onto an already loaded texture
+        size_t duplicateBytes;  // VRAM saved by collapsing them
+        double downsampleMs;
+        double uploadMs;
+    };
+
     class Model3D {
 
     public:
         ~Model3D();
 
+		// Sets the global texture quality tier used by every subsequent texture load
+		static void SetTextureQuality(TEXTURE_QUALITY quality);
+
+		static TEXTURE_QUALITY GetTextureQuality();
+
+		// Packs the textures of every subsequently loaded model into GL_TEXTURE_2D_ARRAY objects grouped by size
+		static void SetUseTextureArrays(bool enabled);
+
+		static bool GetUseTextureArrays();
+
+		// Makes textures resident and draws through 64-bit handles when ARB_bindless_texture is available,
+		// otherwise keeps the bind-per-draw path. Needs a current GL context
+		static void SetUseBindlessTextures(bool enabled);
+
+		static bool GetUseBindlessTextures();
+
+		// Merges the meshes of every subsequently loaded model into shared buffers and lets the render queue
+		// submit them with glMultiDrawElementsIndirect, when ARB_multi_draw_indirect and ARB_base_instance
+		// are available. Needs a current GL context
+		static void SetUseMultiDrawIndirect(bool enabled);
+
+		static bool GetUseMultiDrawIndirect();
+
+		// Loads models from the cooked file next to the .obj when it is up to date, showing every mesh at its
+		// coarsest level as soon as the textures are in and streaming the finer levels on a worker thread.
+		// Models loaded from the .obj write the cooked file for the next run
+		static void SetUseProgressiveLoading(bool enabled);
+
+		static bool GetUseProgressiveLoading();
+
+		// Generates the coarser levels of detail of every subsequently loaded mesh, for the render queue's LOD
+		// selector. Cooked models always carry them, progressive loading streams them first
+		static void SetUseLODs(bool enabled);
+
+		static bool GetUseLODs();
+
+		// Geometry uploaded per model and frame while streaming
+		static const size_t STREAM_UPLOAD_BUDGET = 4 * 1024 * 1024;
+
+		// Uniform buffer binding point of the MaterialHandles block
+		static const GLuint MATERIAL_HANDLES_BINDING = 1;
+		// Size of the materialHandles array in basic.frag
+		static const size_t MAX_BINDLESS_MATERIALS = 256;
+
+		static TextureLoadStats GetTextureStats();
+
+		// Prints the texture VRAM and upload time for the current quality tier
+		static void ReportTextureStats();
+
 		void LoadModel(std::string fileName);
 
 		void LoadModel(std::string fileName, std::string basePath);
 
-		void Draw(gps::Shader shaderProgram);
+		void Draw(gps::Shader& shaderProgram);
+
+		// Uploads the levels the streaming thread has read since the last call, up to maxBytes of geometry.
+		// Needs the model's context - call once per frame
+		void UpdateStreaming(size_t maxBytes = STREAM_UPLOAD_BUDGET);
+
+		// Waits for the remaining levels and uploads them, for work that needs the full geometry on the CPU
+		// (occluders, HLOD, impostor and PVS bakes)
+		void FinishStreaming();
+
+		// Levels are still streaming in
+		bool IsStreaming();
+
+		// Every mesh has at least its coarsest level resident
+		bool IsDrawable();
+
+		// Object space bounds of the whole model
+		gps::Bounds GetBounds();
+
+		// Draws count copies of the model, one instanced draw per mesh and per ring segment worth of copies.
+		// The transforms are written to the draw data ring together with their eye space normal matrices, so
+		// the shader has to be compiled with DRAW_DATA_ATTRIBUTES. Textures are bound per mesh, also when
+		// bindless materials are on
+		void DrawInstanced(gps::Shader& shaderProgram, const glm::mat4* transforms, size_t count, const glm::mat4& view);
+
+		// Models with at least this many meshes get a bounding volume hierarchy over them
+		static const size_t BVH_MIN_MESHES = 32;
+
+		// Queues every mesh of the model with the given object transform instead of drawing it immediately.
+		// Models with a hierarchy only queue the meshes it finds inside the queue's frustum, models with potentially
+		// visible sets only the meshes in the set of the camera's cell. Each mesh goes out
+		// with the level of detail the queue's selector picks; the last levels picked are kept per instance, so a
+		// model submitted several times a frame passes a distinct instance for each. With an impostor renderer, a
+		// model whose impostor error is under the threshold is handed to it as a single billboard instead
+		void Submit(gps::RenderQueue& queue, gps::Shader& shaderProgram, const glm::mat4& model, const glm::mat3& normalMatrix,
+			gps::RENDER_PASS pass = gps::PASS_OPAQUE, gps::ImpostorRenderer* impostors = NULL, size_t instance = 0);
+
+		// Designates the meshes with a bounding radius of at least minRadius and at most maxTriangles triangles as
+		// occluders - large, simple meshes hide the most for the least rasterization work. Returns their number
+		size_t MarkOccluders(float minRadius, size_t maxTriangles);
+
+		// Bakes the meshes no larger than half a cell into one proxy per grid cell of the given size (object space).
+		// Submit then draws a cell's proxy instead of its meshes once the proxy's error is under the level of
+		// detail threshold. Returns the number of proxies
+		size_t BuildHLOD(float cellSize);
+
+		// Loads the octahedral impostor saved next to the model, or bakes it with bakeShader and saves it when
+		// missing, stale or rebake is set. Needs a current context
+		void BuildImpostor(gps::Shader& bakeShader, bool rebake = false);
+
+		// Samples the potentially visible sets of a grid of cellSize cells (object space) over the model and saves
+		// them next to it. Slow - meant to be run offline. Returns the number of cells
+		size_t BakePVS(float cellSize);
+
+		// Loads the potentially visible sets saved next to the model, false when they are missing or stale
+		bool LoadPVS();
 
     private:
 		// Component meshes - group of objects
         std::vector<gps::Mesh> meshes;
 		// Associated textures
         std::vector<gps::Texture> loadedTextures;
+		// Index into loadedTextures by file path and by hash of the file contents
+		std::unordered_map<std::string, size_t> texturesByPath;
+		std::unordered_map<unsigned long long, size_t> texturesByContent;
+		// Texture files read by PrefetchTextures, and their decoded images by hash of the file contents - already
+		// reduced to the current quality tier
+		struct PrefetchedFile {
+			bool read;
+			unsigned long long contentHash;
+		};
+		struct DecodedImage {
+			unsigned char* pixels;
+			int width;
+			int height;
+			int sourceWidth;
+			int sourceHeight;
+			double downsampleMs;
+		};
+		std::unordered_map<std::string, PrefetchedFile> prefetchedFiles;
+		std::unordered_map<unsigned long long, DecodedImage> decodedImages;
+		// Texture arrays owned by the model and the decoded pixels waiting to be packed into them
+		std::vector<GLuint> textureArrays;
+		std::map<std::string, std::vector<unsigned char>> pendingArrayLayers;
+		// Bindless materials: uniform buffer of handle pairs, the resident handles and the texture used for missing maps
+		GLuint materialBuffer = 0;
+		std::vector<GLuint64> residentHandles;
+		GLuint placeholderTexture = 0;
+		// Vertex and index buffers shared by all the meshes, when they are merged for multi-draw-indirect
+		gps::Buffers sharedBuffers = {};
+		// Union of the mesh bounds
+		gps::Bounds bounds = {};
+		// Object space hierarchy over the mesh boxes, and the meshes it found visible in the last Submit
+		gps::SceneBVH bvh;
+		std::vector<GLuint> visibleMeshes;
+		// Levels of detail one instance was submitted with last, for the selector's hysteresis: the level of each
+		// mesh, and whether each HLOD cell proxy and the impostor stood in for it
+		struct LODState {
+			std::vector<GLuint> meshLODs;
+			std::vector<bool> cellsActive;
+			bool impostorActive;
+		};
+		std::vector<LODState> lodStates;
+		// Cell proxies standing in for groups of small meshes at a distance
+		gps::HLOD hlod;
+		// Billboard standing in for the whole model far away
+		gps::Impostor impostor;
+		// Visible meshes per camera cell, for static models
+		gps::PVS pvs;
+		// Path of the .obj file, the baked files are saved next to it
+		std::string modelFileName;
+		// Cooked file the levels are streaming from, and the chunks taken from it in the last update
+		std::unique_ptr<gps::CookedModel> cookedModel;
+		std::vector<gps::CookedChunk> streamedChunks;
 
 		// Does the parsing of the .obj file and fills in the data structure
 		void ReadOBJ(std::string fileName, std::string basePath);
 
+		// Reads the mesh table of the cooked file and starts streaming its geometry, false when it is missing or stale
+		bool ReadCooked(std::string fileName);
+
+		// Packs the textures, builds the shared buffers and the hierarchy, and sums up the bounds of the meshes
+		void SetupMeshes(const std::string& fileName, const TextureLoadStats& statsBefore);
+
+		// Reads, hashes and decodes the texture files on the job system's workers, ahead of the LoadTexture calls
+		// that upload them
+		void PrefetchTextures(const std::vector<std::string>& paths);
+
+		// Frees the prefetched images no mesh ended up using
+		void ClearPrefetchedTextures();
+
 		// Retrieves a texture associated with the object - by its name and type
 		gps::Texture LoadTexture(std::string path, std::string type);
 
-		// Reads the pixel data from an image file and loads it into the video memory
-		GLuint ReadTextureFromFile(const char* file_name);
+		// Decodes an image file and drops the top mip levels of the current quality tier - safe on any thread
+		static DecodedImage DecodeImage(const std::vector<unsigned char>& bytes);
+
+		// Loads decoded stb_image pixels (freed here) into the video memory
+		GLuint ReadTextureFromFile(const char* file_name, unsigned char* image_data, int x, int y, int& width, int& height);
+
+		// Packs the decoded textures into arrays and points the meshes at their layers
+		void BuildTextureArrays();
+
+		// Makes the textures resident and uploads one (diffuse, specular) handle pair per material
+		void BuildBindlessMaterials();
+
+		// Gives every mesh the id of its texture binding set
+		void AssignMaterialKeys();
+
+		// Id of a texture binding set, allocating one the first time the set is seen
+		static GLuint FindMaterialKey(const std::vector<GLuint>& bindings);
+
+		// Copies the geometry of every mesh into one vertex array, so a whole model is a single indirect batch
+		void BuildSharedBuffers();
+
+		// Loads the hierarchy saved next to the model, or builds and saves it when missing or stale
+		void BuildBVH(const std::string& fileName);
+
+		// Texture binding sets seen so far, over all models
+		static std::map<std::vector<GLuint>, GLuint> materialKeys;
+
+		// Textures uploaded so far, over all models, by hash of the file contents - identical images in different
+		// models share one texture
+		static std::unordered_map<unsigned long long, gps::Texture> sharedTextures;
+		// Models using each texture, texture array and resident handle - the last one to go frees it
+		static std::unordered_map<GLuint, int> textureReferences;
+		static std::unordered_map<GLuint64, int> handleReferences;
+		static void ReleaseTexture(GLuint textureID);
+
+		static TEXTURE_QUALITY textureQuality;
+		static bool useTextureArrays;
+		static bool useBindlessTextures;
+		static bool useMultiDrawIndirect;
+		static bool useProgressiveLoading;
+		static bool useLODs;
+		static TextureLoadStats textureStats;
     };
 }
 
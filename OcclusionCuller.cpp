@@ -0,0 +1,234 @@
+#include "OcclusionCuller.hpp"
+#include "JobSystem.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define GPS_HAS_SSE2 1
+#endif
+
+namespace gps {
+
+    // clip space w below which a vertex counts as crossing the near plane
+    static const float NEAR_W = 1e-3f;
+
+    OcclusionCuller::OcclusionCuller() {
+
+        depth.assign(WIDTH * HEIGHT, 1.0f);
+    }
+
+    void OcclusionCuller::begin(const glm::mat4& viewProjection) {
+
+        this->viewProjection = viewProjection;
+        triangles.clear();
+    }
+
+    void OcclusionCuller::addOccluder(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, const glm::mat4& model) {
+
+        glm::mat4 modelViewProjection = viewProjection * model;
+
+        for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+
+            glm::vec3 screen[3];
+            bool crossesNear = false;
+            for (int v = 0; v < 3; v++) {
+
+                glm::vec4 clip = modelViewProjection * glm::vec4(vertices[indices[i + v]].Position, 1.0f);
+                if (clip.w < NEAR_W) {
+                    crossesNear = true;
+                    break;
+                }
+                screen[v] = glm::vec3((clip.x / clip.w * 0.5f + 0.5f) * WIDTH, (clip.y / clip.w * 0.5f + 0.5f) * HEIGHT, clip.z / clip.w);
+            }
+
+            // dropping a triangle only makes the buffer less occluding, never wrong
+            if (crossesNear) {
+                continue;
+            }
+
+            triangles.push_back(screen[0]);
+            triangles.push_back(screen[1]);
+            triangles.push_back(screen[2]);
+        }
+    }
+
+    void OcclusionCuller::rasterize(bool bandJobs) {
+
+        std::fill(depth.begin(), depth.end(), 1.0f);
+        if (triangles.empty()) {
+            return;
+        }
+        if (!bandJobs) {
+            for (int band = 0; band < BANDS; band++) {
+                rasterizeBand(band);
+            }
+            return;
+        }
+
+        JobSystem::ParallelFor(0, BANDS, 1, [this](size_t first, size_t end) {
+            for (size_t band = first; band < end; band++) {
+                rasterizeBand((int)band);
+            }
+        });
+    }
+
+    void OcclusionCuller::rasterizeBand(int band) {
+
+        const int bandRows = HEIGHT / BANDS;
+        const int bandMinY = band * bandRows;
+        const int bandMaxY = bandMinY + bandRows - 1;
+
+        for (size_t t = 0; t < triangles.size(); t += 3) {
+
+            glm::vec3 a = triangles[t];
+            glm::vec3 b = triangles[t + 1];
+            glm::vec3 c = triangles[t + 2];
+
+            float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+            if (std::fabs(area) < 1e-8f) {
+                continue;
+            }
+            // occluders are two sided - wind every triangle the same way
+            if (area < 0.0f) {
+                std::swap(b, c);
+                area = -area;
+            }
+
+            int minX = std::max(0, (int)std::floor(std::min(a.x, std::min(b.x, c.x))));
+            int maxX = std::min(WIDTH - 1, (int)std::ceil(std::max(a.x, std::max(b.x, c.x))));
+            int minY = std::max(bandMinY, (int)std::floor(std::min(a.y, std::min(b.y, c.y))));
+            int maxY = std::min(bandMaxY, (int)std::ceil(std::max(a.y, std::max(b.y, c.y))));
+            if (minX > maxX || minY > maxY) {
+                continue;
+            }
+
+            // edge functions E(x, y) = A * x + B * y + C, all positive inside
+            float edgeA[3] = { a.y - b.y, b.y - c.y, c.y - a.y };
+            float edgeB[3] = { b.x - a.x, c.x - b.x, a.x - c.x };
+            float edgeC[3] = { a.x * b.y - a.y * b.x, b.x * c.y - b.y * c.x, c.x * a.y - c.y * a.x };
+
+            // depth plane z(x, y) = zA * x + zB * y + zC, from the barycentric weights of a, b and c
+            // (the edge opposite each vertex: bc for a, ca for b, ab for c)
+            float zA = (edgeA[1] * a.z + edgeA[2] * b.z + edgeA[0] * c.z) / area;
+            float zB = (edgeB[1] * a.z + edgeB[2] * b.z + edgeB[0] * c.z) / area;
+            float zC = (edgeC[1] * a.z + edgeC[2] * b.z + edgeC[0] * c.z) / area;
+            // sampled at the pixel center but stored as the plane's farthest depth over the pixel square
+            zC += 0.5f * (std::fabs(zA) + std::fabs(zB));
+
+            // 4 pixel aligned spans
+            minX &= ~3;
+
+            for (int y = minY; y <= maxY; y++) {
+
+                float py = y + 0.5f;
+                float* row = &depth[y * WIDTH];
+                int x = minX;
+
+#ifdef GPS_HAS_SSE2
+                __m128 offsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+                __m128 zero = _mm_setzero_ps();
+                for (; x <= maxX; x += 4) {
+
+                    __m128 px = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+                    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+                    for (int e = 0; e < 3; e++) {
+                        __m128 edge = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(edgeA[e])), _mm_set1_ps(edgeB[e] * py + edgeC[e]));
+                        inside = _mm_and_ps(inside, _mm_cmpge_ps(edge, zero));
+                    }
+                    if (_mm_movemask_ps(inside) == 0) {
+                        continue;
+                    }
+
+                    __m128 z = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(zA)), _mm_set1_ps(zB * py + zC));
+                    __m128 old = _mm_loadu_ps(row + x);
+                    __m128 nearer = _mm_min_ps(old, z);
+                    _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+                }
+#else
+                for (; x <= maxX; x++) {
+
+                    float px = x + 0.5f;
+                    bool inside = true;
+                    for (int e = 0; e < 3; e++) {
+                        inside = inside && edgeA[e] * px + edgeB[e] * py + edgeC[e] >= 0.0f;
+                    }
+                    if (inside) {
+                        row[x] = std::min(row[x], zA * px + zB * py + zC);
+                    }
+                }
+#endif
+            }
+        }
+    }
+
+    bool OcclusionCuller::isVisible(const glm::vec3& center, const glm::vec3& extent) {
+
+        if (triangles.empty()) {
+            return true;
+        }
+
+        float minX = INFINITY, minY = INFINITY, maxX = -INFINITY, maxY = -INFINITY;
+        float nearestZ = INFINITY;
+        for (int corner = 0; corner < 8; corner++) {
+
+            glm::vec3 offset((corner & 1) ? extent.x : -extent.x, (corner & 2) ? extent.y : -extent.y, (corner & 4) ? extent.z : -extent.z);
+            glm::vec4 clip = viewProjection * glm::vec4(center + offset, 1.0f);
+            if (clip.w < NEAR_W) {
+                return true;
+            }
+
+            float x = (clip.x / clip.w * 0.5f + 0.5f) * WIDTH;
+            float y = (clip.y / clip.w * 0.5f + 0.5f) * HEIGHT;
+            minX = std::min(minX, x);
+            maxX = std::max(maxX, x);
+            minY = std::min(minY, y);
+            maxY = std::max(maxY, y);
+            nearestZ = std::min(nearestZ, clip.z / clip.w);
+        }
+
+        if (maxX < 0.0f || minX > WIDTH || maxY < 0.0f || minY > HEIGHT) {
+            return true;
+        }
+
+        // coverage is sampled at pixel centers, so a pixel on an occluder's silhouette holds its depth even where
+        // the occluder leaves part of it open - one pixel more on each side reaches past the silhouette, keeping
+        // boxes behind that open part visible
+        int startX = std::max(0, (int)std::floor(minX) - 1);
+        int endX = std::min(WIDTH - 1, (int)std::ceil(maxX) + 1);
+        int startY = std::max(0, (int)std::floor(minY) - 1);
+        int endY = std::min(HEIGHT - 1, (int)std::ceil(maxY) + 1);
+
+        // visible as soon as one pixel of the box's screen rectangle has no occluder in front of its nearest point
+        for (int y = startY; y <= endY; y++) {
+
+            const float* row = &depth[y * WIDTH];
+            int x = startX;
+#ifdef GPS_HAS_SSE2
+            __m128 boxZ = _mm_set1_ps(nearestZ);
+            for (; x + 3 <= endX; x += 4) {
+                if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), boxZ)) != 0) {
+                    return true;
+                }
+            }
+#endif
+            for (; x <= endX; x++) {
+                if (row[x] >= nearestZ) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    size_t OcclusionCuller::getTriangleCount() {
+
+        return triangles.size() / 3;
+    }
+
+    const std::vector<float>& OcclusionCuller::getDepthBuffer() {
+
+        return depth;
+    }
+}
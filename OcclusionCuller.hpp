@@ -0,0 +1,52 @@
+#ifndef OcclusionCuller_hpp
+#define OcclusionCuller_hpp
+
+#include "Mesh.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+namespace gps {
+
+    // Software occlusion culling: occluder triangles are rasterized into a small depth buffer on the CPU and
+    // boxes are tested against it before their draws are submitted. Pure CPU code, no GL calls
+    class OcclusionCuller {
+
+    public:
+        OcclusionCuller();
+
+        // Starts a frame - clears the occluders and sets the matrix they and the tested boxes are projected with
+        void begin(const glm::mat4& viewProjection);
+
+        // Adds the triangles of a mesh placed with the given model matrix
+        void addOccluder(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, const glm::mat4& model);
+
+        // Rasterizes the occluders, BANDS horizontal bands of the buffer as separate jobs - or all on the calling
+        // thread, for callers that already run one culler per job
+        void rasterize(bool bandJobs = true);
+
+        // False when the box is entirely behind the rasterized occluders, tested over its screen rectangle grown by
+        // one pixel so partly covered silhouette pixels never hide it. Boxes crossing the near plane are visible
+        bool isVisible(const glm::vec3& center, const glm::vec3& extent);
+
+        size_t getTriangleCount();
+
+        // Nearest occluder NDC depth per pixel, row 0 at the bottom - 1 where nothing was drawn
+        const std::vector<float>& getDepthBuffer();
+
+        static const int WIDTH = 256;
+        static const int HEIGHT = 128;
+        static const int BANDS = 4;
+
+    private:
+        glm::mat4 viewProjection;
+        // three screen space vertices (x, y in pixels, z in NDC) per triangle
+        std::vector<glm::vec3> triangles;
+        std::vector<float> depth;
+
+        void rasterizeBand(int band);
+    };
+}
+
+#endif /* OcclusionCuller_hpp */
@@ -0,0 +1,389 @@
+#include "PVS.hpp"
+#include "FrustumCuller.hpp"
+#include "JobSystem.hpp"
+#include "OcclusionCuller.hpp"
+#include "SceneBVH.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+
+namespace gps {
+
+    static const char PVS_FILE_MAGIC[4] = { 'G', 'P', 'V', 'S' };
+    // 2: sets sampled out to the cell faces and corners
+    static const GLuint PVS_FILE_VERSION = 2;
+    // near plane of the sampling cameras; triangles crossing it are dropped, which only loses occlusion
+    static const float SAMPLE_NEAR = 0.05f;
+
+    PVSStats PVS::stats = {};
+
+    static void WriteVarint(std::vector<unsigned char>& out, GLuint value) {
+
+        while (value >= 0x80) {
+            out.push_back((unsigned char)((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+        out.push_back((unsigned char)value);
+    }
+
+    static GLuint ReadVarint(const std::vector<unsigned char>& in, size_t& position, size_t end) {
+
+        GLuint value = 0;
+        for (int shift = 0; position < end && shift < 32; shift += 7) {
+
+            unsigned char byte = in[position++];
+            value |= (GLuint)(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) {
+                break;
+            }
+        }
+        return value;
+    }
+
+    // Visibility of every mesh from the cells [firstCell, endCell), one occlusion buffer per worker
+    static void SampleCells(const std::vector<Mesh>& meshes, FrustumCuller boxes, const glm::vec3& origin, float cellSize,
+        const int* dimensions, float farPlane, size_t firstCell, size_t endCell, std::vector<std::vector<GLuint>>& cellBits) {
+
+        // six faces around each sample point - the 2:1 buffer gets a 90 degree vertical field of view,
+        // so neighbouring faces overlap horizontally
+        static const glm::vec3 faceDirections[6] = {
+            glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f),
+            glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f) };
+        static const glm::vec3 faceUps[6] = {
+            glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f),
+            glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f) };
+
+        glm::mat4 projection = glm::perspective(glm::radians(90.0f), (float)OcclusionCuller::WIDTH / OcclusionCuller::HEIGHT,
+            SAMPLE_NEAR, farPlane);
+        OcclusionCuller occlusion;
+        std::vector<unsigned char> inFrustum;
+        size_t words = (meshes.size() + 31) / 32;
+
+        for (size_t cell = firstCell; cell < endCell; cell++) {
+
+            std::vector<GLuint>& bits = cellBits[cell];
+            bits.assign(words, 0);
+
+            int x = (int)(cell % dimensions[0]);
+            int y = (int)(cell / dimensions[0] % dimensions[1]);
+            int z = (int)(cell / dimensions[0] / dimensions[1]);
+            glm::vec3 cellMin = origin + glm::vec3((float)x, (float)y, (float)z) * cellSize;
+            glm::vec3 cellCenter = cellMin + glm::vec3(0.5f * cellSize);
+
+            // meshes reaching into the cell are seen from some point of it, whatever the samples say
+            for (size_t i = 0; i < meshes.size(); i++) {
+
+                const Bounds& bounds = meshes[i].bounds;
+                if (bounds.max.x >= cellMin.x && bounds.min.x <= cellMin.x + cellSize && bounds.max.y >= cellMin.y
+                    && bounds.min.y <= cellMin.y + cellSize && bounds.max.z >= cellMin.z && bounds.min.z <= cellMin.z + cellSize) {
+                    bits[i / 32] |= 1u << (i % 32);
+                }
+            }
+
+            for (int sample = 0; sample < PVS::SAMPLES_PER_CELL; sample++) {
+
+                // center, then the 6 face centers, then the 8 corners
+                glm::vec3 eye = cellCenter;
+                if (sample >= 1 && sample <= 6) {
+                    int axis = (sample - 1) / 2;
+                    eye[axis] += (sample % 2 == 1 ? -0.5f : 0.5f) * cellSize;
+                } else if (sample > 6) {
+                    int corner = sample - 7;
+                    eye += 0.5f * cellSize * glm::vec3((corner & 1) ? 1.0f : -1.0f, (corner & 2) ? 1.0f : -1.0f, (corner & 4) ? 1.0f : -1.0f);
+                }
+
+                for (int face = 0; face < 6; face++) {
+
+                    glm::mat4 viewProjection = projection * glm::lookAt(eye, eye + faceDirections[face], faceUps[face]);
+                    boxes.cull(Frustum::FromMatrix(viewProjection), inFrustum);
+
+                    occlusion.begin(viewProjection);
+                    for (size_t i = 0; i < meshes.size(); i++) {
+                        occlusion.addOccluder(meshes[i].vertices, meshes[i].indices, glm::mat4(1.0f));
+                    }
+                    // the cells already run as separate jobs, the bands stay on this worker
+                    occlusion.rasterize(false);
+
+                    for (size_t i = 0; i < meshes.size(); i++) {
+
+                        if (!inFrustum[i] || (bits[i / 32] & (1u << (i % 32))) != 0) {
+                            continue;
+                        }
+                        glm::vec3 center;
+                        glm::vec3 extent;
+                        boxes.getBox(i, center, extent);
+                        if (occlusion.isVisible(center, extent)) {
+                            bits[i / 32] |= 1u << (i % 32);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    void PVS::bake(const std::vector<Mesh>& meshes, const Bounds& bounds, float cellSize) {
+
+        auto bakeStart = std::chrono::high_resolution_clock::now();
+
+        glm::vec3 size = bounds.max - bounds.min;
+        cellSize = std::max(cellSize, 1e-3f);
+        for (;;) {
+
+            for (int axis = 0; axis < 3; axis++) {
+                dimensions[axis] = std::max(1, (int)std::ceil(size[axis] / cellSize));
+            }
+            if ((size_t)dimensions[0] * dimensions[1] * dimensions[2] <= MAX_CELLS) {
+                break;
+            }
+            cellSize *= 1.25f;
+        }
+        this->cellSize = cellSize;
+        origin = bounds.min;
+        meshCount = meshes.size();
+
+        FrustumCuller boxes;
+        for (size_t i = 0; i < meshes.size(); i++) {
+            boxes.add((meshes[i].bounds.min + meshes[i].bounds.max) * 0.5f, (meshes[i].bounds.max - meshes[i].bounds.min) * 0.5f);
+        }
+        // far enough to see across the whole model from any cell
+        float farPlane = 2.0f * glm::length(size) + cellSize;
+
+        size_t cellCount = (size_t)dimensions[0] * dimensions[1] * dimensions[2];
+        std::vector<std::vector<GLuint>> cellBits(cellCount);
+        // cells cost very different amounts, small pieces keep the workers busy until the end
+        size_t grain = std::max<size_t>(1, cellCount / (JobSystem::GetWorkerCount() * 16));
+        JobSystem::ParallelFor(0, cellCount, grain, [&](size_t first, size_t end) {
+            SampleCells(meshes, boxes, origin, cellSize, dimensions, farPlane, first, end, cellBits);
+        });
+
+        compress(cellBits);
+        decodedCell = -1;
+
+        size_t visible = 0;
+        for (size_t cell = 0; cell < cellCount; cell++) {
+            for (size_t i = 0; i < meshCount; i++) {
+                visible += Contains(cellBits[cell], i) ? 1 : 0;
+            }
+        }
+        double bakeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - bakeStart).count();
+        std::cout << "PVS            : " << cellCount << " cells of " << cellSize << " (" << dimensions[0] << "x" << dimensions[1] << "x"
+            << dimensions[2] << "), " << 100.0 * visible / std::max<size_t>(1, cellCount * meshCount) << "% of " << meshCount
+            << " meshes visible on average, " << getSetCount() << " distinct sets, " << getRawBytes() << " -> " << getCompressedBytes()
+            << " bytes, baked in " << bakeMs << " ms" << std::endl;
+    }
+
+    void PVS::compress(const std::vector<std::vector<GLuint>>& cellBits) {
+
+        cellSets.resize(cellBits.size());
+        setOffsets.clear();
+        runs.clear();
+
+        std::map<std::vector<GLuint>, GLuint> sets;
+        for (size_t cell = 0; cell < cellBits.size(); cell++) {
+
+            auto found = sets.find(cellBits[cell]);
+            if (found != sets.end()) {
+                cellSets[cell] = found->second;
+                continue;
+            }
+
+            GLuint set = (GLuint)setOffsets.size();
+            sets[cellBits[cell]] = set;
+            cellSets[cell] = set;
+            setOffsets.push_back((GLuint)runs.size());
+
+            // alternating runs of hidden and visible meshes, starting with hidden
+            bool current = false;
+            GLuint run = 0;
+            for (size_t i = 0; i < meshCount; i++) {
+
+                if (Contains(cellBits[cell], i) != current) {
+                    WriteVarint(runs, run);
+                    current = !current;
+                    run = 0;
+                }
+                run++;
+            }
+            WriteVarint(runs, run);
+        }
+        setOffsets.push_back((GLuint)runs.size());
+    }
+
+    void PVS::decode(GLuint set, std::vector<GLuint>& bits) {
+
+        bits.assign((meshCount + 31) / 32, 0);
+        size_t position = setOffsets[set];
+        size_t end = setOffsets[set + 1];
+        size_t mesh = 0;
+        bool current = false;
+        while (position < end && mesh < meshCount) {
+
+            size_t run = std::min<size_t>(ReadVarint(runs, position, end), meshCount - mesh);
+            if (current) {
+                for (size_t i = mesh; i < mesh + run; i++) {
+                    bits[i / 32] |= 1u << (i % 32);
+                }
+            }
+            mesh += run;
+            current = !current;
+        }
+    }
+
+    const std::vector<GLuint>* PVS::query(const glm::vec3& point) {
+
+        if (empty()) {
+            return NULL;
+        }
+
+        int cell[3];
+        for (int axis = 0; axis < 3; axis++) {
+
+            cell[axis] = (int)std::floor((point[axis] - origin[axis]) / cellSize);
+            if (cell[axis] < 0 || cell[axis] >= dimensions[axis]) {
+                return NULL;
+            }
+        }
+
+        int index = cell[0] + dimensions[0] * (cell[1] + dimensions[1] * cell[2]);
+        if (index != decodedCell) {
+
+            decode(cellSets[index], decoded);
+            decodedCell = index;
+            decodedVisible = 0;
+            for (size_t i = 0; i < meshCount; i++) {
+                decodedVisible += Contains(decoded, i) ? 1 : 0;
+            }
+        }
+
+        stats.queries++;
+        stats.meshes += (unsigned int)meshCount;
+        stats.visible += (unsigned int)decodedVisible;
+        return &decoded;
+    }
+
+    bool PVS::Contains(const std::vector<GLuint>& set, size_t mesh) {
+
+        return (set[mesh / 32] & (1u << (mesh % 32))) != 0;
+    }
+
+    bool PVS::save(const std::string& path, const std::vector<Bounds>& meshBounds) {
+
+        std::ofstream file(path, std::ios::binary);
+        if (!file) {
+            return false;
+        }
+
+        unsigned long long hash = SceneBVH::HashBounds(meshBounds);
+        GLuint meshes = (GLuint)meshCount;
+        GLuint cellCount = (GLuint)cellSets.size();
+        GLuint setCount = (GLuint)setOffsets.size();
+        GLuint runBytes = (GLuint)runs.size();
+
+        file.write(PVS_FILE_MAGIC, sizeof(PVS_FILE_MAGIC));
+        file.write((const char*)&PVS_FILE_VERSION, sizeof(PVS_FILE_VERSION));
+        file.write((const char*)&hash, sizeof(hash));
+        file.write((const char*)&meshes, sizeof(meshes));
+        file.write((const char*)&origin, sizeof(origin));
+        file.write((const char*)&cellSize, sizeof(cellSize));
+        file.write((const char*)dimensions, sizeof(dimensions));
+        file.write((const char*)&cellCount, sizeof(cellCount));
+        file.write((const char*)&setCount, sizeof(setCount));
+        file.write((const char*)&runBytes, sizeof(runBytes));
+        file.write((const char*)cellSets.data(), cellSets.size() * sizeof(GLuint));
+        file.write((const char*)setOffsets.data(), setOffsets.size() * sizeof(GLuint));
+        file.write((const char*)runs.data(), runs.size());
+        return (bool)file;
+    }
+
+    bool PVS::load(const std::string& path, const std::vector<Bounds>& meshBounds) {
+
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            return false;
+        }
+
+        char magic[4];
+        GLuint version = 0;
+        unsigned long long hash = 0;
+        GLuint meshes = 0;
+        glm::vec3 fileOrigin;
+        float fileCellSize = 0.0f;
+        int fileDimensions[3] = { 0, 0, 0 };
+        GLuint cellCount = 0;
+        GLuint setCount = 0;
+        GLuint runBytes = 0;
+        file.read(magic, sizeof(magic));
+        file.read((char*)&version, sizeof(version));
+        file.read((char*)&hash, sizeof(hash));
+        file.read((char*)&meshes, sizeof(meshes));
+        file.read((char*)&fileOrigin, sizeof(fileOrigin));
+        file.read((char*)&fileCellSize, sizeof(fileCellSize));
+        file.read((char*)fileDimensions, sizeof(fileDimensions));
+        file.read((char*)&cellCount, sizeof(cellCount));
+        file.read((char*)&setCount, sizeof(setCount));
+        file.read((char*)&runBytes, sizeof(runBytes));
+
+        if (!file || memcmp(magic, PVS_FILE_MAGIC, sizeof(magic)) != 0 || version != PVS_FILE_VERSION
+            || meshes != meshBounds.size() || hash != SceneBVH::HashBounds(meshBounds) || fileCellSize <= 0.0f
+            || fileDimensions[0] <= 0 || fileDimensions[1] <= 0 || fileDimensions[2] <= 0
+            || cellCount != (size_t)fileDimensions[0] * fileDimensions[1] * fileDimensions[2] || cellCount > MAX_CELLS || setCount < 2) {
+            return false;
+        }
+
+        cellSets.resize(cellCount);
+        setOffsets.resize(setCount);
+        runs.resize(runBytes);
+        file.read((char*)cellSets.data(), cellSets.size() * sizeof(GLuint));
+        file.read((char*)setOffsets.data(), setOffsets.size() * sizeof(GLuint));
+        file.read((char*)runs.data(), runs.size());
+        bool valid = (bool)file && setOffsets.back() == runBytes;
+        for (size_t i = 0; valid && i < cellSets.size(); i++) {
+            valid = cellSets[i] + 1 < setCount;
+        }
+        if (!valid) {
+            cellSets.clear();
+            setOffsets.clear();
+            runs.clear();
+            return false;
+        }
+
+        meshCount = meshes;
+        origin = fileOrigin;
+        cellSize = fileCellSize;
+        std::copy(fileDimensions, fileDimensions + 3, dimensions);
+        decodedCell = -1;
+        return true;
+    }
+
+    bool PVS::empty() {
+
+        return cellSets.empty();
+    }
+
+    size_t PVS::getCellCount() {
+
+        return cellSets.size();
+    }
+
+    size_t PVS::getSetCount() {
+
+        return setOffsets.empty() ? 0 : setOffsets.size() - 1;
+    }
+
+    size_t PVS::getRawBytes() {
+
+        return cellSets.size() * ((meshCount + 31) / 32) * sizeof(GLuint);
+    }
+
+    size_t PVS::getCompressedBytes() {
+
+        return cellSets.size() * sizeof(GLuint) + setOffsets.size() * sizeof(GLuint) + runs.size();
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef PVS_hpp
+#define PVS_hpp
+
+#include "Mesh.hpp"
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Per-frame counters of the potentially visible set lookups
+    struct PVSStats {
+        unsigned int queries;           // lookups that found a cell
+        unsigned int meshes;            // meshes those cells decide on
+        unsigned int visible;           // of them, potentially visible from the cell
+    };
+
+    // Potentially visible sets of a static model: its bounds are divided into a grid of cells, and every cell
+    // stores the set of meshes visible from anywhere in it as a bitset. The sets are sampled offline with the
+    // software occlusion rasterizer - the whole model is drawn as occluders around the center, face centers and
+    // corners of each cell and every mesh box tested against it - then deduplicated and run length encoded.
+    // At runtime the set of the camera's cell drops the hidden meshes before any other culling sees them
+    class PVS {
+
+    public:
+        // Samples the sets of a grid of cellSize cells over bounds, on one thread per core
+        void bake(const std::vector<Mesh>& meshes, const Bounds& bounds, float cellSize);
+
+        // Writes the sets, tagged with a hash of the mesh boxes they were sampled for
+        bool save(const std::string& path, const std::vector<Bounds>& meshBounds);
+
+        // Reads sets baked for exactly these meshes - false when the file is missing or stale
+        bool load(const std::string& path, const std::vector<Bounds>& meshBounds);
+
+        bool empty();
+
+        // Bitset (32 meshes per word) of the cell holding the object space point, decoded the first time the
+        // cell is asked for. NULL outside the grid, where nothing is filtered
+        const std::vector<GLuint>* query(const glm::vec3& point);
+
+        static bool Contains(const std::vector<GLuint>& set, size_t mesh);
+
+        size_t getCellCount();
+        size_t getSetCount();
+        // Size of one plain bitset per cell, and of the deduplicated, run length encoded sets actually stored
+        size_t getRawBytes();
+        size_t getCompressedBytes();
+
+        static PVSStats stats;
+
+        // Grids with more cells get larger cells
+        static const size_t MAX_CELLS = 32768;
+        // Visibility is sampled at the cell center, the 6 face centers and the 8 corners, so the outer parts of
+        // the cell - where the camera crosses into the neighbours - are covered as well as its middle
+        static const int SAMPLES_PER_CELL = 15;
+
+    private:
+        glm::vec3 origin = glm::vec3(0.0f);
+        float cellSize = 0.0f;
+        int dimensions[3] = { 0, 0, 0 };
+        size_t meshCount = 0;
+        // set of every cell, start of every set in the encoded runs (one more for the end), and the runs
+        std::vector<GLuint> cellSets;
+        std::vector<GLuint> setOffsets;
+        std::vector<unsigned char> runs;
+        int decodedCell = -1;
+        std::vector<GLuint> decoded;
+        size_t decodedVisible = 0;
+
+        // Deduplicates the cell bitsets and encodes the distinct ones
+        void compress(const std::vector<std::vector<GLuint>>& cellBits);
+        void decode(GLuint set, std::vector<GLuint>& bits);
+    };
+}
+
+#endif /* PVS_hpp */
@@ -0,0 +1,441 @@
+#include "RenderQueue.hpp"
+#include "DrawDataRing.hpp"
+#include "GLState.hpp"
+#include "Model3D.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+namespace gps {
+
+    RenderQueue::~RenderQueue() {
+
+        if (indirectBuffer != 0) {
+            glDeleteBuffers(1, &indirectBuffer);
+        }
+    }
+
+    void RenderQueue::begin(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, float farPlane) {
+
+        this->view = viewMatrix;
+        cameraPosition = glm::vec3(glm::inverse(viewMatrix)[3]);
+        this->farPlane = farPlane;
+        viewProjection = projectionMatrix * viewMatrix;
+        frustum = Frustum::FromMatrix(viewProjection);
+        packets.clear();
+        culler.clear();
+        occlusion.begin(viewProjection);
+        transforms.clear();
+        stats = {};
+        gpuCuller.stats = {};
+
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        lodSelector.begin(viewMatrix, projectionMatrix, (float)viewport[3]);
+    }
+
+    GLuint RenderQueue::addTransform(const glm::mat4& model, const glm::mat3& normalMatrix) {
+
+        DrawTransform transform;
+        transform.model = model;
+        transform.normalMatrix = normalMatrix;
+        transforms.push_back(transform);
+        return (GLuint)transforms.size() - 1;
+    }
+
+    GLuint RenderQueue::shaderKey(gps::Shader* shader) {
+
+        // small dense index per program, so the shader bits of the key stay meaningful - programs past the 256th
+        // share the last index rather than spilling into the pass bits
+        for (size_t i = 0; i < shaderPrograms.size(); i++) {
+
+            if (shaderPrograms[i] == shader->shaderProgram)
+                return (GLuint)std::min(i, (size_t)0xFF);
+        }
+        shaderPrograms.push_back(shader->shaderProgram);
+        return (GLuint)std::min(shaderPrograms.size() - 1, (size_t)0xFF);
+    }
+
+    void RenderQueue::submit(gps::Mesh* mesh, gps::Shader* shader, GLuint transformIndex, GLuint materialBuffer,
+                             const glm::vec3& worldCenter, const glm::vec3& worldExtent, RENDER_PASS pass, GLuint lod) {
+
+        float viewDepth = -(view * glm::vec4(worldCenter, 1.0f)).z;
+        unsigned long long depth = (unsigned long long)(glm::clamp(viewDepth / farPlane, 0.0f, 1.0f) * 65535.0f);
+        if (pass == PASS_TRANSPARENT) {
+            depth = 65535 - depth;
+        }
+
+        DrawPacket packet;
+        packet.sortKey = ((unsigned long long)pass << 62)
+                       | ((unsigned long long)shaderKey(shader) << 54)
+                       | ((unsigned long long)(mesh->materialKey & MAX_MATERIAL_KEY) << 32)
+                       | (depth << 16)
+                       | (unsigned long long)(packets.size() & 0xFFFF);
+        packet.mesh = mesh;
+        packet.shader = shader;
+        packet.transformIndex = transformIndex;
+        packet.materialBuffer = materialBuffer;
+        packet.boundsIndex = (GLuint)culler.size();
+        packet.lod = lod;
+        packets.push_back(packet);
+        culler.add(worldCenter, worldExtent);
+
+        if (occlusionCulling && mesh->isOccluder && pass == PASS_OPAQUE) {
+            occlusion.addOccluder(mesh->vertices, mesh->indices, transforms[transformIndex].model);
+        }
+    }
+
+    void RenderQueue::cullPackets() {
+
+        size_t visibleCount = culler.cull(frustum, visible);
+        stats.culled = (unsigned int)(packets.size() - visibleCount);
+
+        if (occlusionCulling && occlusion.getTriangleCount() > 0) {
+            occludePackets();
+        }
+
+        size_t kept = 0;
+        for (size_t i = 0; i < packets.size(); i++) {
+            if (visible[i]) {
+                packets[kept++] = packets[i];
+            }
+        }
+        packets.resize(kept);
+    }
+
+    void RenderQueue::countTriangles() {
+
+        size_t triangles = 0;
+        for (size_t i = 0; i < packets.size(); i++) {
+            triangles += packets[i].mesh->getIndexCount(packets[i].lod) / 3;
+        }
+        stats.triangles = (unsigned int)triangles;
+        lodSelector.endFrame(triangles);
+    }
+
+    void RenderQueue::occludePackets() {
+
+        auto start = std::chrono::high_resolution_clock::now();
+        occlusion.rasterize();
+
+        for (size_t i = 0; i < packets.size(); i++) {
+
+            // an occluder's box is never fully behind its own triangles, no need to test it
+            if (!visible[i] || packets[i].mesh->isOccluder) {
+                continue;
+            }
+
+            glm::vec3 center;
+            glm::vec3 extent;
+            culler.getBox(i, center, extent);
+            stats.occlusionTested++;
+            if (!occlusion.isVisible(center, extent)) {
+                visible[i] = 0;
+                stats.occluded++;
+            }
+        }
+
+        stats.occlusionMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    void RenderQueue::sortPackets() {
+
+        sortBuffer.resize(packets.size());
+
+        for (int shift = 0; shift < 64; shift += 8) {
+
+            size_t counts[256] = {};
+            for (size_t i = 0; i < packets.size(); i++) {
+                counts[(packets[i].sortKey >> shift) & 0xFF]++;
+            }
+
+            // every key has the same byte here - nothing to reorder
+            if (counts[(packets[0].sortKey >> shift) & 0xFF] == packets.size()) {
+                continue;
+            }
+
+            size_t offset = 0;
+            for (int digit = 0; digit < 256; digit++) {
+                size_t count = counts[digit];
+                counts[digit] = offset;
+                offset += count;
+            }
+
+            for (size_t i = 0; i < packets.size(); i++) {
+                sortBuffer[counts[(packets[i].sortKey >> shift) & 0xFF]++] = packets[i];
+            }
+            packets.swap(sortBuffer);
+        }
+    }
+
+    void RenderQueue::flush() {
+
+        if (GPUCuller::GetUseGPUCulling()) {
+
+            if (!packets.empty()) {
+                sortPackets();
+                stats.packets = (unsigned int)packets.size();
+                drawRecords();
+            }
+            // the queued packets are not culled yet - the budget follows the triangles the GPU kept, read back late
+            stats.triangles = gpuCuller.stats.triangles;
+            lodSelector.endFrame(gpuCuller.stats.triangles);
+            // this frame's depth hides the next frame's packets
+            gpuCuller.buildDepthPyramid(viewProjection);
+            return;
+        }
+
+        cullPackets();
+        countTriangles();
+        if (packets.empty()) {
+            return;
+        }
+
+        sortPackets();
+        stats.packets = (unsigned int)packets.size();
+
+        if (Model3D::GetUseMultiDrawIndirect() || DrawDataRing::GetUsePersistentMapping()) {
+            drawRecords();
+        } else {
+            drawPackets();
+        }
+    }
+
+    void RenderQueue::drawPackets() {
+
+        gps::Shader* currentShader = NULL;
+        GLuint currentMaterial = 0xFFFFFFFFu;
+        GLuint currentTransform = 0xFFFFFFFFu;
+        GLuint currentMaterialBuffer = 0xFFFFFFFFu;
+
+        for (size_t i = 0; i < packets.size(); i++) {
+
+            DrawPacket& packet = packets[i];
+
+            if (packet.shader != currentShader) {
+                currentShader = packet.shader;
+                currentShader->useShaderProgram();
+                currentTransform = 0xFFFFFFFFu;
+                currentMaterialBuffer = 0xFFFFFFFFu;
+                stats.shaderChanges++;
+            }
+
+            if (packet.mesh->materialKey != currentMaterial) {
+                currentMaterial = packet.mesh->materialKey;
+                stats.materialChanges++;
+            }
+
+            if (packet.transformIndex != currentTransform) {
+                currentTransform = packet.transformIndex;
+                currentShader->setMat4("model", transforms[currentTransform].model);
+                currentShader->setMat3("normalMatrix", transforms[currentTransform].normalMatrix);
+                stats.transformChanges++;
+            }
+
+            if (packet.materialBuffer != currentMaterialBuffer) {
+                currentMaterialBuffer = packet.materialBuffer;
+                if (currentMaterialBuffer != 0) {
+                    glBindBufferBase(GL_UNIFORM_BUFFER, Model3D::MATERIAL_HANDLES_BINDING, currentMaterialBuffer);
+                } else {
+                    // the bindless shader falls back to the bound samplers for a negative material index
+                    currentShader->setInt("materialIndex", -1);
+                }
+            }
+
+            if (packet.materialBuffer != 0) {
+                packet.mesh->DrawBindless(*currentShader, packet.lod);
+            } else {
+                packet.mesh->Draw(*currentShader, packet.lod);
+            }
+        }
+    }
+
+    void RenderQueue::drawRecords() {
+
+        gps::Shader* currentShader = NULL;
+        GLuint currentMaterial = 0xFFFFFFFFu;
+        GLuint currentMaterialBuffer = 0xFFFFFFFFu;
+
+        for (size_t chunkStart = 0; chunkStart < packets.size(); chunkStart += DrawDataRing::SEGMENT_RECORDS) {
+
+            // one record per packet, written in sorted order in one linear pass - a packet's baseInstance is its record
+            size_t chunkEnd = std::min(packets.size(), chunkStart + DrawDataRing::SEGMENT_RECORDS);
+            GLuint firstRecord;
+            DrawData* records = DrawDataRing::Map(chunkEnd - chunkStart, firstRecord);
+            for (size_t i = chunkStart; i < chunkEnd; i++) {
+
+                const DrawTransform& transform = transforms[packets[i].transformIndex];
+                DrawData& record = records[i - chunkStart];
+                record.model = transform.model;
+                record.normalMatrix = transform.normalMatrix;
+                record.materialIndex = packets[i].materialBuffer != 0 ? packets[i].mesh->materialIndex : -1;
+                // packets sharing texture arrays share a batch and its single bindTextures - the layers go per draw
+                record.textureLayers = packets[i].mesh->getTextureLayers();
+            }
+            DrawDataRing::Unmap(chunkEnd - chunkStart);
+
+            if (Model3D::GetUseMultiDrawIndirect()) {
+                drawIndirectBatches(chunkStart, chunkEnd, firstRecord, currentShader, currentMaterialBuffer);
+                continue;
+            }
+
+            // one instanced draw of a single copy per packet, no uniform uploads in between
+            for (size_t i = chunkStart; i < chunkEnd; i++) {
+
+                DrawPacket& packet = packets[i];
+
+                if (packet.shader != currentShader) {
+                    currentShader = packet.shader;
+                    currentShader->useShaderProgram();
+                    currentMaterial = 0xFFFFFFFFu;
+                    stats.shaderChanges++;
+                }
+
+                if (packet.materialBuffer != 0) {
+                    if (packet.materialBuffer != currentMaterialBuffer) {
+                        glBindBufferBase(GL_UNIFORM_BUFFER, Model3D::MATERIAL_HANDLES_BINDING, packet.materialBuffer);
+                    }
+                } else if (packet.mesh->materialKey != currentMaterial) {
+                    // the key covers the bound arrays, not the layers - those come from the packet's record,
+                    // so the next packet on another layer of the same arrays needs no rebind
+                    packet.mesh->bindTextures(*currentShader);
+                }
+                if (packet.mesh->materialKey != currentMaterial) {
+                    stats.materialChanges++;
+                }
+                currentMaterial = packet.mesh->materialKey;
+                currentMaterialBuffer = packet.materialBuffer;
+
+                packet.mesh->drawElements(1, firstRecord + (GLuint)(i - chunkStart), packet.lod);
+            }
+        }
+    }
+
+    void RenderQueue::drawIndirectBatches(size_t chunkStart, size_t chunkEnd, GLuint firstRecord,
+                                          gps::Shader*& currentShader, GLuint& currentMaterialBuffer) {
+
+#if not defined (__APPLE__)
+        bool gpuCulling = GPUCuller::GetUseGPUCulling();
+
+        commands.resize(chunkEnd - chunkStart);
+        for (size_t i = chunkStart; i < chunkEnd; i++) {
+
+            DrawElementsIndirectCommand& command = commands[i - chunkStart];
+            command.count = (GLuint)packets[i].mesh->getIndexCount(packets[i].lod);
+            command.instanceCount = 1;
+            command.firstIndex = packets[i].mesh->getFirstIndex(packets[i].lod);
+            command.baseVertex = packets[i].mesh->baseVertex;
+            command.baseInstance = firstRecord + (GLuint)(i - chunkStart);
+        }
+
+        if (gpuCulling) {
+
+            // every command keeps its slot range; the cull shader packs the visible ones to the front of their batch
+            cullItems.resize(chunkEnd - chunkStart);
+            GLuint batch = 0;
+            size_t batchStart = chunkStart;
+            for (size_t i = chunkStart; i < chunkEnd; i++) {
+
+                if (i > chunkStart && !sameBatch(packets[batchStart], packets[i])) {
+                    batch++;
+                    batchStart = i;
+                }
+
+                CullItem& item = cullItems[i - chunkStart];
+                culler.getBox(packets[i].boundsIndex, item.center, item.extent);
+                item.batch = batch;
+                item.batchStart = (GLuint)(batchStart - chunkStart);
+                item.command = commands[i - chunkStart];
+            }
+            gpuCuller.cull(cullItems, batch + 1, frustum);
+        } else {
+
+            if (indirectBuffer == 0) {
+                glGenBuffers(1, &indirectBuffer);
+            }
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STREAM_DRAW);
+        }
+
+        size_t batchStart = chunkStart;
+        GLuint batch = 0;
+        while (batchStart < chunkEnd) {
+
+            const DrawPacket& first = packets[batchStart];
+            GLuint vertexArray = first.mesh->getBuffers().VAO;
+
+            size_t batchEnd = batchStart + 1;
+            while (batchEnd < chunkEnd && sameBatch(first, packets[batchEnd])) {
+                batchEnd++;
+            }
+
+            if (first.shader != currentShader) {
+                currentShader = first.shader;
+                currentShader->useShaderProgram();
+                stats.shaderChanges++;
+            }
+
+            if (first.materialBuffer != 0) {
+                if (first.materialBuffer != currentMaterialBuffer) {
+                    glBindBufferBase(GL_UNIFORM_BUFFER, Model3D::MATERIAL_HANDLES_BINDING, first.materialBuffer);
+                    stats.materialChanges++;
+                }
+            } else {
+                first.mesh->bindTextures(*currentShader);
+                stats.materialChanges++;
+            }
+            currentMaterialBuffer = first.materialBuffer;
+
+            GLState::bindVertexArray(vertexArray);
+            if (gpuCulling) {
+                gpuCuller.drawBatch(batch, (GLuint)(batchStart - chunkStart), (GLsizei)(batchEnd - batchStart));
+            } else {
+                glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                    (const GLvoid*)((batchStart - chunkStart) * sizeof(DrawElementsIndirectCommand)), (GLsizei)(batchEnd - batchStart), 0);
+            }
+            Mesh::stats.drawCalls++;
+            stats.batches++;
+
+            batchStart = batchEnd;
+            batch++;
+        }
+#endif
+    }
+
+    bool RenderQueue::sameBatch(const DrawPacket& a, const DrawPacket& b) {
+
+        return b.shader == a.shader
+            && b.mesh->getBuffers().VAO == a.mesh->getBuffers().VAO
+            && b.materialBuffer == a.materialBuffer
+            && (a.materialBuffer != 0 || b.mesh->materialKey == a.mesh->materialKey);
+    }
+
+    RenderQueueStats RenderQueue::getStats() {
+
+        RenderQueueStats frameStats = stats;
+        frameStats.gpuTested = gpuCuller.stats.tested;
+        frameStats.gpuVisible = gpuCuller.stats.visible;
+        frameStats.lod = lodSelector.stats;
+        return frameStats;
+    }
+
+    const glm::mat4& RenderQueue::getViewProjection() {
+
+        return viewProjection;
+    }
+
+    const glm::vec3& RenderQueue::getCameraPosition() {
+
+        return cameraPosition;
+    }
+
+    void RenderQueue::setOcclusionCulling(bool enabled) {
+
+        occlusionCulling = enabled;
+    }
+
+    LODSelector& RenderQueue::getLODSelector() {
+
+        return lodSelector;
+    }
+}
@@ -0,0 +1,139 @@
+#ifndef RenderQueue_hpp
+#define RenderQueue_hpp
+
+#include "Mesh.hpp"
+#include "FrustumCuller.hpp"
+#include "GPUCuller.hpp"
+#include "LODSelector.hpp"
+#include "OcclusionCuller.hpp"
+#include "Shader.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+namespace gps {
+
+    // Render passes, in submission order
+    enum RENDER_PASS {PASS_OPAQUE, PASS_TRANSPARENT};
+
+    // Per-frame counters of the render queue
+    struct RenderQueueStats {
+        unsigned int packets;           // drawn, after culling
+        unsigned int culled;            // outside the view frustum
+        unsigned int occlusionTested;   // inside the frustum and tested against the occluders
+        unsigned int occluded;          // of those, hidden behind them
+        double occlusionMs;             // rasterizing the occluders and testing the boxes
+        unsigned int gpuTested;         // packets tested by the cull shader instead, with GPU culling on
+        unsigned int gpuVisible;        // of those, drawn - one dispatch late
+        unsigned int triangles;         // in the drawn packets' levels of detail (after GPU culling, a few frames late)
+        LODStats lod;
+        unsigned int shaderChanges;
+        unsigned int materialChanges;
+        unsigned int transformChanges;
+        unsigned int batches;           // glMultiDrawElementsIndirect calls, 0 on the per-mesh path
+    };
+
+    // Object transform shared by all the packets of one submitted model
+    struct DrawTransform {
+        glm::mat4 model;
+        glm::mat3 normalMatrix;
+    };
+
+    // One mesh draw, with everything needed to submit it out of order.
+    // Sort key, most significant first: pass (2 bits) | shader (8) | material (22) | depth (16) | submission order (16)
+    struct DrawPacket {
+        unsigned long long sortKey;
+        gps::Mesh* mesh;
+        gps::Shader* shader;
+        GLuint transformIndex;
+        GLuint materialBuffer;      // bindless material buffer of the model, 0 on the bind-per-draw path
+        GLuint boundsIndex;         // the packet's box in the frustum culler
+        GLuint lod;                 // level of detail of the mesh to draw
+    };
+
+    class RenderQueue {
+
+    public:
+        ~RenderQueue();
+
+        // Starts a new frame - the view and projection matrices give the culling frustum, the view matrix
+        // and far plane the packets' depth
+        void begin(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, float farPlane);
+
+        // Stores an object transform and returns the index packets refer to it by
+        GLuint addTransform(const glm::mat4& model, const glm::mat3& normalMatrix);
+
+        // Queues a mesh with its world space box; the box center is used for the front-to-back
+        // (back-to-front for transparent) order
+        void submit(gps::Mesh* mesh, gps::Shader* shader, GLuint transformIndex, GLuint materialBuffer,
+                    const glm::vec3& worldCenter, const glm::vec3& worldExtent, RENDER_PASS pass = PASS_OPAQUE, GLuint lod = 0);
+
+        // Drops the packets outside the frustum, sorts the rest by key and draws them, changing only the state that differs from the previous packet.
+        // With multi-draw-indirect on, runs of packets sharing shader, vertex array and textures go out as one call.
+        // With either that or the persistently mapped ring, transforms are read from DrawData records, not uniforms.
+        // With GPU culling on, every packet is sorted and the cull shader drops the hidden ones from the batches instead
+        void flush();
+
+        RenderQueueStats getStats();
+
+        // projection * view of the frame, for callers culling in their own space before submitting
+        const glm::mat4& getViewProjection();
+
+        // World space position of the frame's camera
+        const glm::vec3& getCameraPosition();
+
+        // When on, opaque packets of occluder meshes are rasterized into a software depth buffer and the
+        // packets behind them are dropped along with those outside the frustum
+        void setOcclusionCulling(bool enabled);
+
+        // Level of detail selection for the submitted meshes, set up for the frame by begin
+        LODSelector& getLODSelector();
+
+        static const unsigned long long MAX_MATERIAL_KEY = (1ULL << 22) - 1;
+
+    private:
+        std::vector<DrawPacket> packets;
+        std::vector<DrawPacket> sortBuffer;
+        std::vector<DrawTransform> transforms;
+        std::vector<GLuint> shaderPrograms;
+        std::vector<DrawElementsIndirectCommand> commands;
+        GLuint indirectBuffer = 0;
+        glm::mat4 view;
+        glm::mat4 viewProjection;
+        glm::vec3 cameraPosition;
+        Frustum frustum;
+        FrustumCuller culler;
+        std::vector<unsigned char> visible;
+        bool occlusionCulling = false;
+        OcclusionCuller occlusion;
+        GPUCuller gpuCuller;
+        LODSelector lodSelector;
+        std::vector<CullItem> cullItems;
+        float farPlane;
+        RenderQueueStats stats;
+
+        GLuint shaderKey(gps::Shader* shader);
+        // LSD radix sort on the 64-bit keys, 8 bits per pass, skipping bytes all keys share
+        void sortPackets();
+        // Removes the packets whose box is outside the frustum or hidden by the occluders, keeping the order of the others
+        void cullPackets();
+        // Clears visible[i] for the frustum-visible packets whose box lies behind the occluders
+        void occludePackets();
+        // Counts the triangles of the packets left to draw and feeds them to the level of detail budget
+        void countTriangles();
+        // Per-mesh submission, transforms and material index through uniforms
+        void drawPackets();
+        // Writes one DrawData record per packet to the draw data ring, then draws them with glMultiDrawElementsIndirect
+        // batches or, with only the ring, one baseInstance draw per packet
+        void drawRecords();
+        // True when b can go out in the same glMultiDrawElementsIndirect call as a - bindless batches only need
+        // the same material buffer, the others the same bound textures
+        bool sameBatch(const DrawPacket& a, const DrawPacket& b);
+        // Indirect submission of the packets [chunkStart, chunkEnd), whose records start at firstRecord
+        void drawIndirectBatches(size_t chunkStart, size_t chunkEnd, GLuint firstRecord,
+                                 gps::Shader*& currentShader, GLuint& currentMaterialBuffer);
+    };
+}
+
+#endif /* RenderQueue_hpp */
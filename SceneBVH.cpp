@@ -0,0 +1,373 @@
+#include "SceneBVH.hpp"
+#include "JobSystem.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+namespace gps {
+
+    static const char BVH_FILE_MAGIC[4] = { 'G', 'B', 'V', 'H' };
+    static const GLuint BVH_FILE_VERSION = 1;
+
+    // Shared state of one build; every task writes only the nodes it allocated and its own item range
+    struct BVHBuild {
+        const std::vector<Bounds>* bounds;
+        std::vector<glm::vec3> centroids;
+        std::vector<GLuint>* items;
+        std::vector<BVHNode>* nodes;
+        std::atomic<GLuint> nodeCount;
+    };
+
+    static float SurfaceArea(const glm::vec3& min, const glm::vec3& max) {
+
+        glm::vec3 size = glm::max(max - min, glm::vec3(0.0f));
+        return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+
+    static void BuildNode(BVHBuild& build, GLuint nodeIndex, GLuint first, GLuint count) {
+
+        std::vector<GLuint>& items = *build.items;
+        const std::vector<Bounds>& bounds = *build.bounds;
+
+        BVHNode node;
+        node.min = glm::vec3(INFINITY);
+        node.max = glm::vec3(-INFINITY);
+        node.child = 0;
+        node.first = first;
+        node.count = count;
+
+        glm::vec3 centroidMin(INFINITY);
+        glm::vec3 centroidMax(-INFINITY);
+        for (GLuint i = first; i < first + count; i++) {
+            node.min = glm::min(node.min, bounds[items[i]].min);
+            node.max = glm::max(node.max, bounds[items[i]].max);
+            centroidMin = glm::min(centroidMin, build.centroids[items[i]]);
+            centroidMax = glm::max(centroidMax, build.centroids[items[i]]);
+        }
+
+        if (count <= SceneBVH::MAX_LEAF_ITEMS) {
+            (*build.nodes)[nodeIndex] = node;
+            return;
+        }
+
+        // binned SAH: bin the centroids along each axis and evaluate the split between every pair of bins
+        float bestCost = INFINITY;
+        int bestAxis = -1;
+        GLuint bestSplit = 0;
+
+        for (int axis = 0; axis < 3; axis++) {
+
+            float extent = centroidMax[axis] - centroidMin[axis];
+            if (extent <= 0.0f) {
+                continue;
+            }
+
+            GLuint binCount[SceneBVH::SAH_BINS] = {};
+            glm::vec3 binMin[SceneBVH::SAH_BINS];
+            glm::vec3 binMax[SceneBVH::SAH_BINS];
+            for (GLuint b = 0; b < SceneBVH::SAH_BINS; b++) {
+                binMin[b] = glm::vec3(INFINITY);
+                binMax[b] = glm::vec3(-INFINITY);
+            }
+
+            float scale = SceneBVH::SAH_BINS / extent;
+            for (GLuint i = first; i < first + count; i++) {
+                GLuint b = std::min(SceneBVH::SAH_BINS - 1, (GLuint)((build.centroids[items[i]][axis] - centroidMin[axis]) * scale));
+                binCount[b]++;
+                binMin[b] = glm::min(binMin[b], bounds[items[i]].min);
+                binMax[b] = glm::max(binMax[b], bounds[items[i]].max);
+            }
+
+            // right side areas and counts by sweeping from the last bin
+            float rightArea[SceneBVH::SAH_BINS];
+            GLuint rightCount[SceneBVH::SAH_BINS];
+            glm::vec3 sweepMin(INFINITY);
+            glm::vec3 sweepMax(-INFINITY);
+            GLuint sweepCount = 0;
+            for (GLuint b = SceneBVH::SAH_BINS - 1; b > 0; b--) {
+                sweepMin = glm::min(sweepMin, binMin[b]);
+                sweepMax = glm::max(sweepMax, binMax[b]);
+                sweepCount += binCount[b];
+                rightArea[b] = SurfaceArea(sweepMin, sweepMax);
+                rightCount[b] = sweepCount;
+            }
+
+            sweepMin = glm::vec3(INFINITY);
+            sweepMax = glm::vec3(-INFINITY);
+            sweepCount = 0;
+            for (GLuint split = 1; split < SceneBVH::SAH_BINS; split++) {
+                sweepMin = glm::min(sweepMin, binMin[split - 1]);
+                sweepMax = glm::max(sweepMax, binMax[split - 1]);
+                sweepCount += binCount[split - 1];
+                if (sweepCount == 0 || rightCount[split] == 0) {
+                    continue;
+                }
+
+                float cost = SurfaceArea(sweepMin, sweepMax) * sweepCount + rightArea[split] * rightCount[split];
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = split;
+                }
+            }
+        }
+
+        // every centroid in the same place - nothing to split on
+        if (bestAxis < 0) {
+            (*build.nodes)[nodeIndex] = node;
+            return;
+        }
+
+        float splitScale = SceneBVH::SAH_BINS / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+        float splitMin = centroidMin[bestAxis];
+        GLuint* middle = std::partition(&items[first], &items[first] + count, [&](GLuint item) {
+            GLuint b = std::min(SceneBVH::SAH_BINS - 1, (GLuint)((build.centroids[item][bestAxis] - splitMin) * splitScale));
+            return b < bestSplit;
+        });
+        GLuint leftCount = (GLuint)(middle - &items[first]);
+
+        node.child = build.nodeCount.fetch_add(2);
+        (*build.nodes)[nodeIndex] = node;
+
+        if (count >= SceneBVH::PARALLEL_BUILD_ITEMS) {
+            // the two children as two jobs
+            JobSystem::ParallelFor(0, 2, 1, [&](size_t side, size_t) {
+                if (side == 0) {
+                    BuildNode(build, node.child, first, leftCount);
+                } else {
+                    BuildNode(build, node.child + 1, first + leftCount, count - leftCount);
+                }
+            });
+        } else {
+            BuildNode(build, node.child, first, leftCount);
+            BuildNode(build, node.child + 1, first + leftCount, count - leftCount);
+        }
+    }
+
+    void SceneBVH::build(const std::vector<Bounds>& bounds) {
+
+        nodes.clear();
+        items.clear();
+        itemBounds.clear();
+        if (bounds.empty()) {
+            return;
+        }
+
+        BVHBuild build;
+        build.bounds = &bounds;
+        build.items = &items;
+        build.nodes = &nodes;
+        build.nodeCount = 1;
+        build.centroids.resize(bounds.size());
+        for (size_t i = 0; i < bounds.size(); i++) {
+            build.centroids[i] = (bounds[i].min + bounds[i].max) * 0.5f;
+        }
+
+        items.resize(bounds.size());
+        for (size_t i = 0; i < items.size(); i++) {
+            items[i] = (GLuint)i;
+        }
+
+        // a binary tree with n leaves at most has 2n - 1 nodes, so the vector never reallocates under the tasks
+        nodes.resize(2 * bounds.size() - 1);
+        BuildNode(build, 0, 0, (GLuint)bounds.size());
+        nodes.resize(build.nodeCount);
+
+        itemBounds.resize(items.size());
+        for (size_t i = 0; i < items.size(); i++) {
+            itemBounds[i] = bounds[items[i]];
+        }
+    }
+
+    void SceneBVH::cull(const Frustum& frustum, std::vector<GLuint>& visibleItems) {
+
+        stats = {};
+        if (nodes.empty()) {
+            return;
+        }
+
+        glm::vec3 absNormals[6];
+        for (int p = 0; p < 6; p++) {
+            absNormals[p] = glm::abs(glm::vec3(frustum.planes[p]));
+        }
+
+        // node and the mask of the planes it still straddles - children skip the planes their parent is inside of
+        GLuint stackNodes[64];
+        unsigned char stackMasks[64];
+        int stackSize = 0;
+        stackNodes[stackSize] = 0;
+        stackMasks[stackSize++] = 0x3F;
+
+        while (stackSize > 0) {
+
+            stackSize--;
+            const BVHNode& node = nodes[stackNodes[stackSize]];
+            unsigned char mask = stackMasks[stackSize];
+            stats.nodesVisited++;
+
+            glm::vec3 center = (node.min + node.max) * 0.5f;
+            glm::vec3 extent = (node.max - node.min) * 0.5f;
+            bool outside = false;
+            for (int p = 0; p < 6 && !outside; p++) {
+
+                if (!(mask & (1 << p))) {
+                    continue;
+                }
+
+                float distance = glm::dot(glm::vec3(frustum.planes[p]), center) + frustum.planes[p].w;
+                float radius = glm::dot(absNormals[p], extent);
+                if (distance + radius < 0.0f) {
+                    outside = true;
+                } else if (distance - radius >= 0.0f) {
+                    mask &= ~(1 << p);
+                }
+            }
+
+            if (outside) {
+                continue;
+            }
+
+            if (mask == 0) {
+                // entirely inside - the whole subtree is visible
+                visibleItems.insert(visibleItems.end(), items.begin() + node.first, items.begin() + node.first + node.count);
+                continue;
+            }
+
+            if (node.child != 0 && stackSize + 2 <= 64) {
+                stackNodes[stackSize] = node.child + 1;
+                stackMasks[stackSize++] = mask;
+                stackNodes[stackSize] = node.child;
+                stackMasks[stackSize++] = mask;
+                continue;
+            }
+
+            // partially visible leaf (or a stack too deep to descend) - test its boxes one by one
+            for (GLuint i = node.first; i < node.first + node.count; i++) {
+
+                glm::vec3 itemCenter = (itemBounds[i].min + itemBounds[i].max) * 0.5f;
+                glm::vec3 itemExtent = (itemBounds[i].max - itemBounds[i].min) * 0.5f;
+                bool itemOutside = false;
+                for (int p = 0; p < 6 && !itemOutside; p++) {
+                    if (mask & (1 << p)) {
+                        float distance = glm::dot(glm::vec3(frustum.planes[p]), itemCenter) + frustum.planes[p].w;
+                        itemOutside = distance + glm::dot(absNormals[p], itemExtent) < 0.0f;
+                    }
+                }
+                stats.itemsTested++;
+
+                if (!itemOutside) {
+                    visibleItems.push_back(items[i]);
+                }
+            }
+        }
+    }
+
+    bool SceneBVH::empty() {
+
+        return nodes.empty();
+    }
+
+    size_t SceneBVH::getNodeCount() {
+
+        return nodes.size();
+    }
+
+    unsigned long long SceneBVH::HashBounds(const std::vector<Bounds>& bounds) {
+
+        // FNV-1a over the box corners
+        unsigned long long hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < bounds.size(); i++) {
+            const unsigned char* bytes[2] = { (const unsigned char*)&bounds[i].min, (const unsigned char*)&bounds[i].max };
+            for (int corner = 0; corner < 2; corner++) {
+                for (size_t b = 0; b < sizeof(glm::vec3); b++) {
+                    hash = (hash ^ bytes[corner][b]) * 1099511628211ULL;
+                }
+            }
+        }
+        return hash;
+    }
+
+    bool SceneBVH::save(const std::string& path) {
+
+        std::ofstream file(path, std::ios::binary);
+        if (!file) {
+            return false;
+        }
+
+        std::vector<Bounds> bounds(itemBounds.size());
+        for (size_t i = 0; i < items.size(); i++) {
+            bounds[items[i]] = itemBounds[i];
+        }
+        unsigned long long hash = HashBounds(bounds);
+        GLuint itemCount = (GLuint)items.size();
+        GLuint nodeCount = (GLuint)nodes.size();
+
+        file.write(BVH_FILE_MAGIC, sizeof(BVH_FILE_MAGIC));
+        file.write((const char*)&BVH_FILE_VERSION, sizeof(BVH_FILE_VERSION));
+        file.write((const char*)&hash, sizeof(hash));
+        file.write((const char*)&itemCount, sizeof(itemCount));
+        file.write((const char*)&nodeCount, sizeof(nodeCount));
+        file.write((const char*)items.data(), items.size() * sizeof(GLuint));
+        file.write((const char*)nodes.data(), nodes.size() * sizeof(BVHNode));
+        return (bool)file;
+    }
+
+    bool SceneBVH::load(const std::string& path, const std::vector<Bounds>& bounds) {
+
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            return false;
+        }
+
+        char magic[4];
+        GLuint version = 0;
+        unsigned long long hash = 0;
+        GLuint itemCount = 0;
+        GLuint nodeCount = 0;
+        file.read(magic, sizeof(magic));
+        file.read((char*)&version, sizeof(version));
+        file.read((char*)&hash, sizeof(hash));
+        file.read((char*)&itemCount, sizeof(itemCount));
+        file.read((char*)&nodeCount, sizeof(nodeCount));
+
+        if (!file || memcmp(magic, BVH_FILE_MAGIC, sizeof(magic)) != 0 || version != BVH_FILE_VERSION
+            || itemCount != bounds.size() || nodeCount == 0 || nodeCount > 2 * itemCount || hash != HashBounds(bounds)) {
+            return false;
+        }
+
+        items.resize(itemCount);
+        nodes.resize(nodeCount);
+        file.read((char*)items.data(), items.size() * sizeof(GLuint));
+        file.read((char*)nodes.data(), nodes.size() * sizeof(BVHNode));
+        if (!file) {
+            nodes.clear();
+            items.clear();
+            return false;
+        }
+
+        // a corrupt node would send the traversal out of the arrays - children come after their parent
+        for (size_t n = 0; n < nodes.size(); n++) {
+            const BVHNode& node = nodes[n];
+            if ((node.child != 0 && (node.child <= n || (size_t)node.child + 1 >= nodes.size()))
+                || (size_t)node.first + node.count > itemCount) {
+                nodes.clear();
+                items.clear();
+                return false;
+            }
+        }
+
+        itemBounds.resize(itemCount);
+        for (size_t i = 0; i < items.size(); i++) {
+            if (items[i] >= itemCount) {
+                nodes.clear();
+                items.clear();
+                return false;
+            }
+            itemBounds[i] = bounds[items[i]];
+        }
+        return true;
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef SceneBVH_hpp
+#define SceneBVH_hpp
+
+#include "Mesh.hpp"
+#include "FrustumCuller.hpp"
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Node of the hierarchy; the items of its subtree are items[first, first + count)
+    struct BVHNode {
+        glm::vec3 min;
+        GLuint child;       // left child, the right one follows it - 0 for leaves (the root is never a child)
+        glm::vec3 max;
+        GLuint first;
+        GLuint count;
+    };
+
+    // Counters of the last cull call
+    struct BVHStats {
+        unsigned int nodesVisited;
+        unsigned int itemsTested;   // tested one by one in partially visible leaves
+    };
+
+    // Bounding volume hierarchy over a set of boxes, built top down with binned SAH splits; subtrees above
+    // PARALLEL_BUILD_ITEMS items are built as separate jobs
+    class SceneBVH {
+
+    public:
+        void build(const std::vector<Bounds>& bounds);
+
+        // Appends the indices of the items whose box intersects the frustum. Subtrees entirely inside are
+        // accepted and subtrees entirely outside rejected without visiting their children
+        void cull(const Frustum& frustum, std::vector<GLuint>& visibleItems);
+
+        bool empty();
+
+        size_t getNodeCount();
+
+        // Writes the hierarchy, tagged with a hash of the boxes it was built from
+        bool save(const std::string& path);
+
+        // Reads a hierarchy saved for exactly these boxes - false when the file is missing or stale
+        bool load(const std::string& path, const std::vector<Bounds>& bounds);
+
+        // FNV-1a hash of the box corners, the tag of files baked from a set of boxes
+        static unsigned long long HashBounds(const std::vector<Bounds>& bounds);
+
+        BVHStats stats;
+
+        static const GLuint MAX_LEAF_ITEMS = 4;
+        static const GLuint SAH_BINS = 16;
+        static const GLuint PARALLEL_BUILD_ITEMS = 4096;
+
+    private:
+        std::vector<BVHNode> nodes;
+        std::vector<GLuint> items;
+        // boxes in items order, for the tests in partially visible leaves
+        std::vector<Bounds> itemBounds;
+    };
+}
+
+#endif /* SceneBVH_hpp */
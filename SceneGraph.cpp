@@ -0,0 +1,142 @@
+#include "SceneGraph.hpp"
+
+#include <algorithm>
+
+namespace gps {
+
+    SceneGraph::SceneGraph() {
+
+        Node root = { -1, {}, glm::mat4(1.0f), glm::mat3(1.0f), false, false };
+        nodes.push_back(root);
+        locals.add(glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f));
+    }
+
+    int SceneGraph::createNode(int parent) {
+
+        Node node = { parent, {}, glm::mat4(1.0f), glm::mat3(1.0f), true, false };
+        nodes.push_back(node);
+        locals.add(glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f));
+        int index = (int)nodes.size() - 1;
+        markLocalChanged(index);
+        nodes[parent].children.push_back(index);
+        return index;
+    }
+
+    void SceneGraph::markLocalChanged(int node) {
+
+        nodes[node].dirty = true;
+        if (!nodes[node].localChanged) {
+            nodes[node].localChanged = true;
+            changedLocals.push_back((size_t)node);
+        }
+    }
+
+    void SceneGraph::setParent(int node, int parent) {
+
+        // a node can not go under its own subtree
+        for (int ancestor = parent; ancestor >= 0; ancestor = nodes[ancestor].parent) {
+            if (ancestor == node) {
+                return;
+            }
+        }
+
+        std::vector<int>& siblings = nodes[nodes[node].parent].children;
+        siblings.erase(std::remove(siblings.begin(), siblings.end(), node), siblings.end());
+        nodes[parent].children.push_back(node);
+        nodes[node].parent = parent;
+        nodes[node].dirty = true;
+    }
+
+    void SceneGraph::setPosition(int node, const glm::vec3& position) {
+
+        locals.setPosition(node, position);
+        markLocalChanged(node);
+    }
+
+    void SceneGraph::setRotation(int node, const glm::quat& rotation) {
+
+        locals.setRotation(node, rotation);
+        markLocalChanged(node);
+    }
+
+    void SceneGraph::setScale(int node, const glm::vec3& scale) {
+
+        locals.setScale(node, scale);
+        markLocalChanged(node);
+    }
+
+    glm::vec3 SceneGraph::getPosition(int node) {
+
+        return locals.getPosition(node);
+    }
+
+    glm::quat SceneGraph::getRotation(int node) {
+
+        return locals.getRotation(node);
+    }
+
+    glm::vec3 SceneGraph::getScale(int node) {
+
+        return locals.getScale(node);
+    }
+
+    size_t SceneGraph::getNodeCount() {
+
+        return nodes.size();
+    }
+
+    void SceneGraph::translateLocal(int node, const glm::vec3& offset) {
+
+        setPosition(node, getPosition(node) + getRotation(node) * (getScale(node) * offset));
+    }
+
+    void SceneGraph::update() {
+
+        // only the changed local matrices, in index order so the ones sharing an 8-wide batch are composed together
+        if (!changedLocals.empty()) {
+            std::sort(changedLocals.begin(), changedLocals.end());
+            locals.update(changedLocals);
+            for (size_t i = 0; i < changedLocals.size(); i++) {
+                nodes[changedLocals[i]].localChanged = false;
+            }
+            changedLocals.clear();
+        }
+
+        // the root never changes, its children start the walk
+        for (size_t i = 0; i < nodes[ROOT].children.size(); i++) {
+            updateNode(nodes[ROOT].children[i], false);
+        }
+    }
+
+    void SceneGraph::updateNode(int index, bool parentChanged) {
+
+        Node& node = nodes[index];
+        stats.nodes++;
+
+        bool changed = node.dirty || parentChanged;
+        if (changed) {
+
+            // the local normal matrix is R S^-1 = (R S)^-T, so the normal matrices chain without an inverse
+            const Node& parent = nodes[node.parent];
+            node.world = parent.world * locals.getWorldMatrix(index);
+            node.normal = parent.normal * locals.getNormalMatrix(index);
+
+            node.dirty = false;
+            stats.recomputed++;
+        }
+
+        for (size_t i = 0; i < node.children.size(); i++) {
+            updateNode(node.children[i], changed);
+        }
+    }
+
+    const glm::mat4& SceneGraph::getWorldMatrix(int node) {
+
+        return nodes[node].world;
+    }
+
+    const glm::mat3& SceneGraph::getNormalMatrix(int node) {
+
+        return nodes[node].normal;
+    }
+}
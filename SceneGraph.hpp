@@ -0,0 +1,84 @@
+#ifndef SceneGraph_hpp
+#define SceneGraph_hpp
+
+#include "TransformArray.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <vector>
+
+namespace gps {
+
+    // Counters of the scene graph updates, reset by the render loop every frame
+    struct SceneGraphStats {
+        unsigned int nodes;             // nodes visited by update
+        unsigned int recomputed;        // world (and normal) matrices rebuilt
+    };
+
+    // Hierarchy of object transforms. Every node holds a local translation, rotation and scale and caches its
+    // world matrix and world space normal matrix. Setting a local transform only flags the node; update then
+    // rebuilds the flagged nodes and everything below them, and leaves the other subtrees alone.
+    // The local transforms live in a TransformArray; update composes the changed ones in the 8-wide batches they
+    // fall in and the walk only chains them onto the parents
+    class SceneGraph {
+
+    public:
+        SceneGraph();
+
+        // Adds a node with an identity local transform under parent, returns its index
+        int createNode(int parent = ROOT);
+
+        // Moves a node under another parent, keeping its local transform - it follows the new parent from then on
+        void setParent(int node, int parent);
+
+        void setPosition(int node, const glm::vec3& position);
+        void setRotation(int node, const glm::quat& rotation);
+        void setScale(int node, const glm::vec3& scale);
+
+        glm::vec3 getPosition(int node);
+        glm::quat getRotation(int node);
+        glm::vec3 getScale(int node);
+
+        // Nodes including the root - node indices run from 0 to getNodeCount() - 1
+        size_t getNodeCount();
+
+        // Moves a node along its own rotated and scaled axes
+        void translateLocal(int node, const glm::vec3& offset);
+
+        // Rebuilds the matrices of the flagged nodes and of their subtrees
+        void update();
+
+        // Matrices of the last update
+        const glm::mat4& getWorldMatrix(int node);
+        // Inverse transpose of the world matrix's upper 3x3; mat3(view) * it is the eye space normal matrix
+        const glm::mat3& getNormalMatrix(int node);
+
+        SceneGraphStats stats = {};
+
+        static const int ROOT = 0;
+
+    private:
+        struct Node {
+            int parent;
+            std::vector<int> children;
+            glm::mat4 world;
+            glm::mat3 normal;
+            bool dirty;
+            bool localChanged;      // listed in changedLocals
+        };
+
+        std::vector<Node> nodes;
+        // local transform of node i at index i
+        TransformArray locals;
+        // nodes whose local transform changed since their matrices were last composed
+        std::vector<size_t> changedLocals;
+
+        // Flags a node and lists its local transform for the next update
+        void markLocalChanged(int node);
+
+        void updateNode(int node, bool parentChanged);
+    };
+}
+
+#endif /* SceneGraph_hpp */
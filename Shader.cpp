@@ -7,8 +7,49 @@
 //
 
 #include "Shader.hpp"
+#include "GLState.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <cstring>
 
 namespace gps {
+
+    UniformStats Shader::stats = {};
+
+    // FNV-1a hash of a uniform name
+    static unsigned int HashName(const char* name) {
+
+        unsigned int hash = 2166136261u;
+        for (; *name; name++) {
+            hash = (hash ^ (unsigned char)*name) * 16777619u;
+        }
+        return hash;
+    }
+
+    static bool IsSamplerType(GLenum type) {
+
+        switch (type) {
+            case GL_SAMPLER_1D:
+            case GL_SAMPLER_2D:
+            case GL_SAMPLER_3D:
+            case GL_SAMPLER_CUBE:
+            case GL_SAMPLER_2D_SHADOW:
+            case GL_SAMPLER_1D_ARRAY:
+            case GL_SAMPLER_2D_ARRAY:
+            case GL_SAMPLER_2D_ARRAY_SHADOW:
+            case GL_SAMPLER_CUBE_SHADOW:
+            case GL_SAMPLER_BUFFER:
+            case GL_SAMPLER_2D_MULTISAMPLE:
+            case GL_INT_SAMPLER_2D:
+            case GL_INT_SAMPLER_BUFFER:
+            case GL_UNSIGNED_INT_SAMPLER_2D:
+            case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+                return true;
+            default:
+                return false;
+        }
+    }
     std::string Shader::readShaderFile(std::string fileName) {
 
         std::ifstream shaderFile;
@@ -30,6 +71,20 @@ namespace gps {
         return shaderString;
     }
     
+    std::string Shader::insertDefines(std::string shaderString, std::string defines) {
+
+        if (defines.empty()) {
+            return shaderString;
+        }
+
+        //the #version directive has to stay the first line of the shader
+        size_t versionLineEnd = shaderString.find('\n');
+        if (shaderString.compare(0, 8, "#version") != 0 || versionLineEnd == std::string::npos) {
+            return defines + "\n" + shaderString;
+        }
+        return shaderString.substr(0, versionLineEnd + 1) + defines + "\n" + shaderString.substr(versionLineEnd + 1);
+    }
+    
     void Shader::shaderCompileLog(GLuint shaderId) {
 
         GLint success;
@@ -58,10 +113,10 @@ namespace gps {
         }
     }
     
-    void Shader::loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName) {
+    void Shader::loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName, std::string defines) {
 
         //read, parse and compile the vertex shader
-        std::string v = readShaderFile(vertexShaderFileName);
+        std::string v = insertDefines(readShaderFile(vertexShaderFileName), defines);
         const GLchar* vertexShaderString = v.c_str();
         GLuint vertexShader;
         vertexShader = glCreateShader(GL_VERTEX_SHADER);
@@ -71,7 +126,7 @@ namespace gps {
         shaderCompileLog(vertexShader);
         
         //read, parse and compile the vertex shader
-        std::string f = readShaderFile(fragmentShaderFileName);
+        std::string f = insertDefines(readShaderFile(fragmentShaderFileName), defines);
         const GLchar* fragmentShaderString = f.c_str();
         GLuint fragmentShader;
         fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
@@ -89,11 +144,174 @@ namespace gps {
         glDeleteShader(fragmentShader);
         //check linking info
         shaderLinkLog(this->shaderProgram);
+
+        reflectUniforms();
+    }
+
+    void Shader::loadComputeShader(std::string computeShaderFileName, std::string defines) {
+
+#if not defined (__APPLE__)
+        std::string c = insertDefines(readShaderFile(computeShaderFileName), defines);
+        const GLchar* computeShaderString = c.c_str();
+        GLuint computeShader = glCreateShader(GL_COMPUTE_SHADER);
+        glShaderSource(computeShader, 1, &computeShaderString, NULL);
+        glCompileShader(computeShader);
+        shaderCompileLog(computeShader);
+
+        this->shaderProgram = glCreateProgram();
+        glAttachShader(this->shaderProgram, computeShader);
+        glLinkProgram(this->shaderProgram);
+        glDeleteShader(computeShader);
+        shaderLinkLog(this->shaderProgram);
+
+        reflectUniforms();
+#endif
+    }
+
+    void Shader::reflectUniforms() {
+
+        uniforms.clear();
+        uniformsByName.clear();
+
+        GLint uniformCount = 0;
+        glGetProgramiv(this->shaderProgram, GL_ACTIVE_UNIFORMS, &uniformCount);
+
+        GLint nextSamplerUnit = 0;
+        for (GLint i = 0; i < uniformCount; i++) {
+
+            GLchar name[256];
+            GLsizei nameLength = 0;
+            UniformInfo uniform = {};
+            glGetActiveUniform(this->shaderProgram, (GLuint)i, sizeof(name), &nameLength, &uniform.size, &uniform.type, name);
+
+            //members of uniform blocks have no location of their own
+            uniform.location = glGetUniformLocation(this->shaderProgram, name);
+            if (uniform.location < 0) {
+                continue;
+            }
+
+            //arrays are reported as "name[0]", look them up by their plain name
+            uniform.name = name;
+            if (uniform.name.size() > 3 && uniform.name.compare(uniform.name.size() - 3, 3, "[0]") == 0) {
+                uniform.name.erase(uniform.name.size() - 3);
+            }
+
+            uniform.samplerUnit = -1;
+            if (IsSamplerType(uniform.type)) {
+                //every sampler gets a unit of its own once, so samplers of different types never share one
+                uniform.samplerUnit = nextSamplerUnit++;
+                glProgramUniform1i(this->shaderProgram, uniform.location, uniform.samplerUnit);
+            }
+
+            unsigned int hash = HashName(uniform.name.c_str());
+            if (uniformsByName.count(hash) > 0) {
+                std::cout << "Uniform name hash collision: " << uniform.name << std::endl;
+                continue;
+            }
+            uniformsByName[hash] = uniforms.size();
+            uniforms.push_back(uniform);
+        }
+    }
+
+    UniformInfo* Shader::findUniform(const char* name) {
+
+        auto found = uniformsByName.find(HashName(name));
+        if (found == uniformsByName.end() || uniforms[found->second].name != name) {
+            return NULL;
+        }
+        return &uniforms[found->second];
+    }
+
+    const UniformInfo* Shader::findUniform(const char* name) const {
+
+        auto found = uniformsByName.find(HashName(name));
+        if (found == uniformsByName.end() || uniforms[found->second].name != name) {
+            return NULL;
+        }
+        return &uniforms[found->second];
+    }
+
+    bool Shader::updateShadow(UniformInfo* uniform, const void* data, size_t size) {
+
+        if (uniform->uploaded && memcmp(uniform->value, data, size) == 0) {
+            stats.skipped++;
+            return false;
+        }
+
+        memcpy(uniform->value, data, size);
+        uniform->uploaded = true;
+        stats.uploads++;
+        return true;
+    }
+
+    void Shader::setInt(const char* name, GLint value) {
+
+        UniformInfo* uniform = findUniform(name);
+        if (uniform && updateShadow(uniform, &value, sizeof(value))) {
+            glProgramUniform1i(this->shaderProgram, uniform->location, value);
+        }
+    }
+
+    void Shader::setBool(const char* name, bool value) {
+
+        setInt(name, value ? 1 : 0);
+    }
+
+    void Shader::setFloat(const char* name, GLfloat value) {
+
+        UniformInfo* uniform = findUniform(name);
+        if (uniform && updateShadow(uniform, &value, sizeof(value))) {
+            glProgramUniform1f(this->shaderProgram, uniform->location, value);
+        }
+    }
+
+    void Shader::setVec3(const char* name, const glm::vec3& value) {
+
+        UniformInfo* uniform = findUniform(name);
+        if (uniform && updateShadow(uniform, glm::value_ptr(value), sizeof(glm::vec3))) {
+            glProgramUniform3fv(this->shaderProgram, uniform->location, 1, glm::value_ptr(value));
+        }
+    }
+
+    void Shader::setMat3(const char* name, const glm::mat3& value) {
+
+        UniformInfo* uniform = findUniform(name);
+        if (uniform && updateShadow(uniform, glm::value_ptr(value), sizeof(glm::mat3))) {
+            glProgramUniformMatrix3fv(this->shaderProgram, uniform->location, 1, GL_FALSE, glm::value_ptr(value));
+        }
+    }
+
+    void Shader::setMat4(const char* name, const glm::mat4& value) {
+
+        UniformInfo* uniform = findUniform(name);
+        if (uniform && updateShadow(uniform, glm::value_ptr(value), sizeof(glm::mat4))) {
+            glProgramUniformMatrix4fv(this->shaderProgram, uniform->location, 1, GL_FALSE, glm::value_ptr(value));
+        }
+    }
+
+    GLint Shader::getSamplerUnit(const char* name) const {
+
+        const UniformInfo* uniform = findUniform(name);
+        return uniform ? uniform->samplerUnit : -1;
+    }
+
+    GLint Shader::getUniformLocation(const char* name) const {
+
+        const UniformInfo* uniform = findUniform(name);
+        return uniform ? uniform->location : -1;
+    }
+
+    void Shader::bindUniformBlock(const char* blockName, GLuint bindingPoint) {
+
+        GLuint blockIndex = glGetUniformBlockIndex(this->shaderProgram, blockName);
+        if (blockIndex != GL_INVALID_INDEX) {
+            glUniformBlockBinding(this->shaderProgram, blockIndex, bindingPoint);
+        }
     }
     
     void Shader::useShaderProgram() {
 
-        glUseProgram(this->shaderProgram);
+        GLState::useProgram(this->shaderProgram);
     }
 
 }
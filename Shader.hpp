@@ -17,24 +17,78 @@
     #include <GL/glew.h>
 #endif
 
+#include <glm/glm.hpp>
+
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 
 namespace gps {
-    
+
+    // Active uniform of a linked program together with a shadow copy of the last value uploaded to it
+    struct UniformInfo {
+        std::string name;
+        GLint location;
+        GLenum type;
+        GLint size;
+        GLint samplerUnit;          // texture unit assigned at link time, -1 for non-sampler uniforms
+        bool uploaded;
+        unsigned char value[64];    // large enough for a mat4
+    };
+
+    // Uniform uploads issued and skipped as redundant, reset by the render loop every frame
+    struct UniformStats {
+        unsigned int uploads;
+        unsigned int skipped;
+    };
+
     class Shader {
 
     public:
         GLuint shaderProgram;
-        void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName);
+        // defines - optional "#define ..." lines inserted right after the #version line of both stages
+        void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName, std::string defines = "");
+        // Single stage compute program - needs OpenGL 4.3, never available on Apple
+        void loadComputeShader(std::string computeShaderFileName, std::string defines = "");
         void useShaderProgram();
+
+        // Typed setters - the value goes to the driver only when it differs from the last one sent to this program.
+        // Uniforms the program does not use are ignored
+        void setInt(const char* name, GLint value);
+        void setBool(const char* name, bool value);
+        void setFloat(const char* name, GLfloat value);
+        void setVec3(const char* name, const glm::vec3& value);
+        void setMat3(const char* name, const glm::mat3& value);
+        void setMat4(const char* name, const glm::mat4& value);
+
+        // Texture unit assigned to a sampler at link time, -1 when the program has no active sampler of that name
+        GLint getSamplerUnit(const char* name) const;
+        // Location of an active uniform, -1 when the program has none of that name
+        GLint getUniformLocation(const char* name) const;
+        // Connects a uniform block to a buffer binding point, if the program uses the block
+        void bindUniformBlock(const char* blockName, GLuint bindingPoint);
+
+        static UniformStats stats;
     
     private:
+        // Reflected active uniforms, indexed by the hash of their name
+        std::vector<UniformInfo> uniforms;
+        std::unordered_map<unsigned int, size_t> uniformsByName;
+
         std::string readShaderFile(std::string fileName);
+        std::string insertDefines(std::string shaderString, std::string defines);
         void shaderCompileLog(GLuint shaderId);
         void shaderLinkLog(GLuint shaderProgramId);
+        // Reads the active uniforms of the linked program and assigns a texture unit to every sampler
+        void reflectUniforms();
+        UniformInfo* findUniform(const char* name);
+        const UniformInfo* findUniform(const char* name) const;
+        // Updates the shadow copy, returns false when the value is unchanged
+        bool updateShadow(UniformInfo* uniform, const void* data, size_t size);
     };
     
 }
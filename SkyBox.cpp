@@ -21,38 +21,32 @@ namespace gps {
         InitSkyBox();
     }
     
-    void SkyBox::Draw(gps::Shader shader, glm::mat4 viewMatrix, glm::mat4 projectionMatrix)
+    void SkyBox::Draw(gps::Shader& shader)
     {
         shader.useShaderProgram();
         
-        //set the view and projection matrices
-        glm::mat4 transformedView = glm::mat4(glm::mat3(viewMatrix));
-        glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(transformedView));
-        glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projectionMatrix));
+        GLState::depthFunc(GL_LEQUAL);
         
-        glDepthFunc(GL_LEQUAL);
-        
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glUniform1i(glGetUniformLocation(shader.shaderProgram, "skybox"), 0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+        GLState::bindVertexArray(skyboxVAO);
+        // -1 when the program has no skybox sampler, which GLState would pass on as an invalid GL_TEXTURE0 + unit
+        GLint unit = shader.getSamplerUnit("skybox");
+        if (unit >= 0)
+            GLState::bindTexture(unit, GL_TEXTURE_CUBE_MAP, cubemapTexture);
         glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
         
-        glDepthFunc(GL_LESS);
+        GLState::depthFunc(GL_LESS);
     }
     
     GLuint SkyBox::LoadSkyBoxTextures(std::vector<const GLchar*> skyBoxFaces)
     {
         GLuint textureID;
         glGenTextures(1, &textureID);
-        glActiveTexture(GL_TEXTURE0);
         
         int width,height, n;
         unsigned char* image;
         int force_channels = 3;
         
-        glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+        GLState::bindTexture(0, GL_TEXTURE_CUBE_MAP, textureID);
         for(GLuint i = 0; i < skyBoxFaces.size(); i++)
         {
             image = stbi_load(skyBoxFaces[i], &width, &height, &n, force_channels);
@@ -70,7 +64,6 @@ namespace gps {
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
         
         return textureID;
     }
@@ -124,14 +117,14 @@ namespace gps {
         glGenVertexArrays(1, &(this->skyboxVAO));
         glGenBuffers(1, &skyboxVBO);
         
-        glBindVertexArray(skyboxVAO);
+        GLState::bindVertexArray(skyboxVAO);
         glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
         
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
         
-        glBindVertexArray(0);
+        GLState::bindVertexArray(0);
     }
     
     GLuint SkyBox::GetTextureId()
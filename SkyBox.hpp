@@ -11,6 +11,7 @@
 
 
 #include "Shader.hpp"
+#include "GLState.hpp"
 #include "stb_image.h"
 
 #include <glm/glm.hpp>
@@ -25,7 +26,8 @@ namespace gps {
     public:
         SkyBox();
         void Load(std::vector<const GLchar*> cubeMapFaces);
-        void Draw(gps::Shader shader, glm::mat4 viewMatrix, glm::mat4 projectionMatrix);
+        // view and projection come from the FrameData uniform block
+        void Draw(gps::Shader& shader);
         GLuint GetTextureId();
     private:
         GLuint skyboxVAO;
@@ -0,0 +1,185 @@
+#include "TransformArray.hpp"
+#include "AVXKernels.hpp"
+#include "JobSystem.hpp"
+
+#include <algorithm>
+
+namespace gps {
+
+    void TransformArray::clear() {
+
+        positionX.clear();
+        positionY.clear();
+        positionZ.clear();
+        rotationX.clear();
+        rotationY.clear();
+        rotationZ.clear();
+        rotationW.clear();
+        scaleX.clear();
+        scaleY.clear();
+        scaleZ.clear();
+        world.clear();
+        normal.clear();
+    }
+
+    size_t TransformArray::add(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale) {
+
+        positionX.push_back(position.x);
+        positionY.push_back(position.y);
+        positionZ.push_back(position.z);
+        rotationX.push_back(rotation.x);
+        rotationY.push_back(rotation.y);
+        rotationZ.push_back(rotation.z);
+        rotationW.push_back(rotation.w);
+        scaleX.push_back(scale.x);
+        scaleY.push_back(scale.y);
+        scaleZ.push_back(scale.z);
+        world.push_back(glm::mat4(1.0f));
+        normal.push_back(glm::mat3(1.0f));
+        return world.size() - 1;
+    }
+
+    size_t TransformArray::size() {
+
+        return world.size();
+    }
+
+    void TransformArray::setPosition(size_t i, const glm::vec3& position) {
+
+        positionX[i] = position.x;
+        positionY[i] = position.y;
+        positionZ[i] = position.z;
+    }
+
+    void TransformArray::setRotation(size_t i, const glm::quat& rotation) {
+
+        rotationX[i] = rotation.x;
+        rotationY[i] = rotation.y;
+        rotationZ[i] = rotation.z;
+        rotationW[i] = rotation.w;
+    }
+
+    void TransformArray::setScale(size_t i, const glm::vec3& scale) {
+
+        scaleX[i] = scale.x;
+        scaleY[i] = scale.y;
+        scaleZ[i] = scale.z;
+    }
+
+    glm::vec3 TransformArray::getPosition(size_t i) {
+
+        return glm::vec3(positionX[i], positionY[i], positionZ[i]);
+    }
+
+    glm::quat TransformArray::getRotation(size_t i) {
+
+        return glm::quat(rotationW[i], rotationX[i], rotationY[i], rotationZ[i]);
+    }
+
+    glm::vec3 TransformArray::getScale(size_t i) {
+
+        return glm::vec3(scaleX[i], scaleY[i], scaleZ[i]);
+    }
+
+    const glm::mat4& TransformArray::getWorldMatrix(size_t i) {
+
+        return world[i];
+    }
+
+    const glm::mat3& TransformArray::getNormalMatrix(size_t i) {
+
+        return normal[i];
+    }
+
+    TRANSFORM_PATH TransformArray::GetBestPath() {
+
+#if defined(GPS_HAS_AVX_KERNELS)
+        if (CpuHasAVX()) {
+            return TRANSFORM_AVX;
+        }
+#endif
+        return TRANSFORM_SCALAR;
+    }
+
+    const char* TransformArray::GetPathName(TRANSFORM_PATH path) {
+
+        switch (path) {
+            case TRANSFORM_AVX:
+                return "AVX";
+            default:
+                return "scalar";
+        }
+    }
+
+    void TransformArray::update() {
+
+        update(GetBestPath());
+    }
+
+    void TransformArray::update(TRANSFORM_PATH path) {
+
+        // split in whole batches of 8, so only the very last piece has a scalar tail
+        size_t count = size();
+        JobSystem::ParallelFor(0, (count + 7) / 8, UPDATE_GRAIN / 8, [this, path, count](size_t first, size_t end) {
+            updateRange(path, first * 8, std::min(count, end * 8));
+        });
+    }
+
+    void TransformArray::update(const std::vector<size_t>& indices) {
+
+        TRANSFORM_PATH path = GetBestPath();
+        size_t count = size();
+        // batches before this one are composed already
+        size_t composed = 0;
+        for (size_t k = 0; k < indices.size(); k++) {
+
+            size_t first = indices[k] / 8 * 8;
+            if (first < composed) {
+                continue;
+            }
+            updateRange(path, first, std::min(count, first + 8));
+            composed = first + 8;
+        }
+    }
+
+    void TransformArray::updateRange(TRANSFORM_PATH path, size_t first, size_t end) {
+
+        // rotation columns of a unit quaternion (x, y, z, w):
+        // c0 = (1 - 2(yy + zz), 2(xy + wz), 2(xz - wy))
+        // c1 = (2(xy - wz), 1 - 2(xx + zz), 2(yz + wx))
+        // c2 = (2(xz + wy), 2(yz - wx), 1 - 2(xx + yy))
+        // world = [c0 sx, c1 sy, c2 sz, position], normal = [c0 / sx, c1 / sy, c2 / sz]
+
+#if defined(GPS_HAS_AVX_KERNELS)
+        if (path == TRANSFORM_AVX) {
+
+            const float* transforms[10] = { positionX.data(), positionY.data(), positionZ.data(),
+                rotationX.data(), rotationY.data(), rotationZ.data(), rotationW.data(), scaleX.data(), scaleY.data(), scaleZ.data() };
+            first = ComposeTransformsAVX(transforms, (float*)world.data(), (float*)normal.data(), first, end);
+        }
+#endif
+
+        // the remainder, or everything on the scalar path
+        updateScalar(first, end);
+    }
+
+    void TransformArray::updateScalar(size_t first, size_t end) {
+
+        for (size_t i = first; i < end; i++) {
+
+            float x = rotationX[i], y = rotationY[i], z = rotationZ[i], w = rotationW[i];
+            glm::vec3 c0(1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + w * z), 2.0f * (x * z - w * y));
+            glm::vec3 c1(2.0f * (x * y - w * z), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + w * x));
+            glm::vec3 c2(2.0f * (x * z + w * y), 2.0f * (y * z - w * x), 1.0f - 2.0f * (x * x + y * y));
+
+            glm::mat4& matrix = world[i];
+            matrix[0] = glm::vec4(c0 * scaleX[i], 0.0f);
+            matrix[1] = glm::vec4(c1 * scaleY[i], 0.0f);
+            matrix[2] = glm::vec4(c2 * scaleZ[i], 0.0f);
+            matrix[3] = glm::vec4(positionX[i], positionY[i], positionZ[i], 1.0f);
+
+            normal[i] = glm::mat3(c0 * (scaleX[i] != 0.0f ? 1.0f / scaleX[i] : 0.0f), c1 * (scaleY[i] != 0.0f ? 1.0f / scaleY[i] : 0.0f),
+                c2 * (scaleZ[i] != 0.0f ? 1.0f / scaleZ[i] : 0.0f));
+        }
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef TransformArray_hpp
+#define TransformArray_hpp
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <vector>
+
+namespace gps {
+
+    // Instruction sets the matrices can be composed with - 1 or 8 transforms per step
+    enum TRANSFORM_PATH {TRANSFORM_SCALAR, TRANSFORM_AVX};
+
+    // Flat translation / rotation / scale transforms stored as structure of arrays (one array per component),
+    // so update composes the world matrices and their normal matrices 8 at a time with AVX.
+    // Rotations must be unit quaternions - the normal matrix is built as R * S^-1 instead of through an inverse
+    class TransformArray {
+
+    public:
+        void clear();
+
+        // Appends a transform, returns its index
+        size_t add(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale);
+
+        size_t size();
+
+        void setPosition(size_t i, const glm::vec3& position);
+        void setRotation(size_t i, const glm::quat& rotation);
+        void setScale(size_t i, const glm::vec3& scale);
+
+        glm::vec3 getPosition(size_t i);
+        glm::quat getRotation(size_t i);
+        glm::vec3 getScale(size_t i);
+
+        // Rebuilds every world and normal matrix, spread over the job system's workers
+        void update();
+
+        void update(TRANSFORM_PATH path);
+
+        // Rebuilds the matrices of the listed transforms only (ascending indices), on the calling thread - each
+        // one goes with the 8-wide batch it falls in, so neighbours changed together share a step
+        void update(const std::vector<size_t>& indices);
+
+        // Matrices of the last update
+        const glm::mat4& getWorldMatrix(size_t i);
+        // Inverse transpose of the world matrix's upper 3x3
+        const glm::mat3& getNormalMatrix(size_t i);
+
+        // Widest path compiled in that the CPU runs - AVX is checked at run time
+        static TRANSFORM_PATH GetBestPath();
+
+        static const char* GetPathName(TRANSFORM_PATH path);
+
+    private:
+        std::vector<float> positionX, positionY, positionZ;
+        std::vector<float> rotationX, rotationY, rotationZ, rotationW;
+        std::vector<float> scaleX, scaleY, scaleZ;
+
+        std::vector<glm::mat4> world;
+        std::vector<glm::mat3> normal;
+
+        // Transforms per job
+        static const size_t UPDATE_GRAIN = 4096;
+
+        // Composes the transforms [first, end), 8 at a time on the AVX path
+        void updateRange(TRANSFORM_PATH path, size_t first, size_t end);
+
+        // Composes the transforms [first, end) one at a time
+        void updateScalar(size_t first, size_t end);
+    };
+}
+
+#endif /* TransformArray_hpp */
@@ -2,7 +2,7 @@
 
 namespace gps {
 
-    void Window::Create(int width, int height, const char *title) {
+    void Window::Create(int width, int height, const char *title, bool visible) {
         if (!glfwInit()) {
             throw std::runtime_error("Could not start GLFW3!");
         }
@@ -22,6 +22,9 @@ namespace gps {
         //for antialising
         glfwWindowHint(GLFW_SAMPLES, 4);
 
+        // hidden windows still get a full context, for offline work such as baking
+        glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
+
         this->window = glfwCreateWindow(width, height, title, NULL, NULL);
         if (!this->window) {
             throw std::runtime_error("Could not create GLFW3 window!");
@@ -24,7 +24,7 @@ namespace gps {
     class Window {
 
     public:
-        void Create(int width=800, int height=600, const char *title="OpenGL Project");
+        void Create(int width=800, int height=600, const char *title="OpenGL Project", bool visible=true);
         void Delete();
 
         GLFWwindow* getWindow();
@@ -18,7 +18,22 @@
 #include "Camera.hpp"
 #include "Model3D.hpp"
 #include "SkyBox.hpp"
+#include "GLState.hpp"
+#include "RenderQueue.hpp"
+#include "FrameData.hpp"
+#include "DrawDataRing.hpp"
+#include "FrustumCuller.hpp"
+#include "SceneBVH.hpp"
+#include "DynamicAABBTree.hpp"
+#include "SceneGraph.hpp"
+#include "TransformArray.hpp"
+#include "JobSystem.hpp"
+#include "FrameSnapshot.hpp"
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
 
 // window
 gps::Window myWindow;
@@ -26,22 +41,15 @@ int glWindowWidth = 900;
 int glWindowHeight = 700;
 
 // matrices
-glm::mat4 model;
 glm::mat4 view;
 glm::mat4 projection;
-glm::mat3 normalMatrix;
 
 // light parameters
 glm::vec3 lightDir;
 glm::vec3 lightColor;
 
-// shader uniform locations
-GLint modelLoc;
-GLint viewLoc;
-GLint projectionLoc;
-GLint normalMatrixLoc;
-GLint lightDirLoc;
-GLint lightColorLoc;
+// per-frame uniform buffer shared by every program
+gps::FrameUniformBuffer frameUniforms;
 
 // camera
 gps::Camera myCamera(
@@ -56,23 +64,53 @@ GLboolean pressedKeys[1024];
 gps::Model3D teapot;
 GLfloat angle;
 gps::Model3D character;
-glm::mat4 characterModel;
-
 gps::Model3D streetlight;
-glm::mat4 streetlightModel;
-
 gps::Model3D boat;
-glm::mat4 boatModel;
+// object transforms, one scene graph node per model
+gps::SceneGraph sceneGraph;
+int teapotNode;
+int characterNode;
+int streetlightNode;
+int boatNode;
+// the street light rides on the boat instead of standing at the origin
+bool isLampOnBoat = false;
+// every model of the scene, for the work done on all of them
+gps::Model3D* sceneModels[] = { &teapot, &character, &streetlight, &boat };
+// load milestones, measured from the start of model loading
+std::chrono::high_resolution_clock::time_point modelLoadStart;
+// frame pipeline: 0 simulates and draws every frame on the main thread in turn, 2 or 3 hands frame snapshots
+// through that many slots to a render thread owning the context
+size_t renderThreadSlots = 0;
+gps::FrameSnapshotQueue snapshotQueue;
+gps::FrameSnapshot sequentialSnapshot;
+unsigned long long simulatedFrames = 0;
+std::chrono::high_resolution_clock::time_point lastPollTime;
+// render side: the last presented frame and the viewport size applied to the context
+std::chrono::high_resolution_clock::time_point lastSwapTime;
+int viewportWidth = 0;
+int viewportHeight = 0;
+bool isFirstMeaningfulFrameReported = false;
+bool isFullDetailReported = false;
+// moving objects, culled and queried through a dynamic tree
+enum DYNAMIC_OBJECT {DYNAMIC_CHARACTER, DYNAMIC_BOAT};
+gps::DynamicAABBTree dynamicObjects;
+int characterProxy;
+int boatProxy;
+std::vector<int> visibleDynamicObjects;
 // shaders
 gps::Shader myBasicShader;
-
-//rotation
-glm::mat4 characterTranslation = glm::mat4(1.0f);
-glm::mat4 characterRotation = glm::mat4(1.0f);
-glm::mat4 characterScale = glm::mat4(1.0f);
+gps::RenderQueue renderQueue;
+// far models drawn as octahedral impostor billboards
+gps::ImpostorRenderer impostorRenderer;
+gps::Shader impostorBakeShader;
+bool isImpostorRenderingActive = false;
+// scene meshes rasterized by the occlusion culler: large enough to hide something, cheap enough to rasterize
+const float OCCLUDER_MIN_RADIUS = 5.0f;
+const size_t OCCLUDER_MAX_TRIANGLES = 4096;
 
 
 GLenum polygonMode = GL_FILL;  // Initial mode is solid
+bool isSmoothShadingActive = false;
 
 //skybox
 gps::SkyBox mySkyBox;
@@ -89,6 +127,76 @@ std::vector<const GLchar*> faces;
  //prezentare
  bool isPresentationActive = false;
  float presentationTime = 0.0f;
+ //statistici
+ bool isFrameStatsActive = false;
+ bool isF1KeyProcessed = false;
+ double frameStatsStartTime = 0.0;
+ int frameStatsFrames = 0;
+ struct FrameStats {
+     unsigned int drawCalls;
+     unsigned int textureBinds;
+     unsigned int uniformUploads;
+     unsigned int uniformsSkipped;
+     unsigned int stateCallsIssued;
+     unsigned int stateCallsFiltered;
+     unsigned int packets;
+     unsigned int culled;
+     unsigned int shaderChanges;
+     unsigned int materialChanges;
+     unsigned int transformChanges;
+     unsigned int batches;
+     unsigned int ringRecords;
+     unsigned int ringWaits;
+     double ringStallMs;
+     unsigned int treeMoves;
+     unsigned int treeReinserts;
+     unsigned int treeRotations;
+     unsigned int treeNodesVisited;
+     double treeUpdateMs;
+     double treeQueryMs;
+     unsigned int occlusionTested;
+     unsigned int occluded;
+     double occlusionMs;
+     unsigned int gpuTested;
+     unsigned int gpuVisible;
+     unsigned int triangles;
+     unsigned int lodSelections;
+     unsigned int lodCoarse;
+     unsigned int lodSwitches;
+     unsigned int hlodProxies;
+     unsigned int hlodReplaced;
+     unsigned int impostors;
+     unsigned int pvsMeshes;
+     unsigned int pvsVisible;
+     unsigned int sceneGraphNodes;
+     unsigned int sceneGraphRecomputed;
+     double frameMs;
+     double latencyMs;
+ };
+ FrameStats frameStatsTotal = {};
+ double lastSubmitMs = 0.0;
+ double frameStatsSubmitMs = 0.0;
+ //benchmark bindless
+ bool isBindlessBenchmarkActive = false;
+ const int BENCHMARK_WARMUP_FRAMES = 30;
+ const int BENCHMARK_FRAMES = 300;
+ int benchmarkFrame = 0;
+ double benchmarkSubmitMs[2] = { 0.0, 0.0 };
+ //benchmark instancing
+ bool isInstancingBenchmarkActive = false;
+ const int INSTANCING_WARMUP_FRAMES = 5;
+ const int INSTANCING_FRAMES = 20;
+ //benchmark render thread
+ bool isRenderThreadBenchmarkActive = false;
+ const int RENDER_THREAD_WARMUP_FRAMES = 60;
+ const int RENDER_THREAD_FRAMES = 600;
+ struct FrameTimingTotals {
+     int frames;
+     double frameMs;
+     double latencyMs;
+     double maxLatencyMs;
+ };
+ FrameTimingTotals renderThreadTiming = {};
  //umbre
  
 void togglePresentationMode() {
@@ -126,13 +234,11 @@ GLenum glCheckError_(const char *file, int line)
 void windowResizeCallback(GLFWwindow* window, int width, int height) {
     fprintf(stdout, "Window resized! New width: %d , and height: %d\n", width, height);
 
-    glViewport(0, 0, width, height);
+    // renderScene sets the viewport, on the thread that owns the context
+    glWindowWidth = width;
+    glWindowHeight = height;
 
     projection = glm::perspective(glm::radians(45.0f), (float)width / (float)height, 0.1f, 1000.0f);
-
-    myBasicShader.useShaderProgram();
-    projectionLoc = glGetUniformLocation(myBasicShader.shaderProgram, "projection");
-    glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
 }
 
 
@@ -182,8 +288,6 @@ void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
 
     myCamera.rotate(pitch, yaw);
     view = myCamera.getViewMatrix();
-    myBasicShader.useShaderProgram();
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
 }
 
 void processMovement() {
@@ -218,46 +322,49 @@ void processMovement() {
 
     if (pressedKeys[GLFW_KEY_Q]) {
         angle -= 1.0f;
-        model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0, 1, 0));
+        sceneGraph.setRotation(teapotNode, glm::angleAxis(glm::radians(angle), glm::vec3(0, 1, 0)));
     }
 
     if (pressedKeys[GLFW_KEY_E]) {
         angle += 1.0f;
-        model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0, 1, 0));
+        sceneGraph.setRotation(teapotNode, glm::angleAxis(glm::radians(angle), glm::vec3(0, 1, 0)));
     }
     if (pressedKeys[GLFW_KEY_UP]) {
-        characterModel = glm::translate(characterModel, glm::vec3(0.0f, 0.0f, 0.1f));
+        sceneGraph.translateLocal(characterNode, glm::vec3(0.0f, 0.0f, 0.1f));
     }
 
     if (pressedKeys[GLFW_KEY_DOWN]) {
-        characterModel = glm::translate(characterModel, glm::vec3(0.0f, 0.0f, -0.1f));
+        sceneGraph.translateLocal(characterNode, glm::vec3(0.0f, 0.0f, -0.1f));
     }
 
     if (pressedKeys[GLFW_KEY_LEFT]) {
-        characterModel = glm::translate(characterModel, glm::vec3(-0.1f, 0.0f, 0.0f));
+        sceneGraph.translateLocal(characterNode, glm::vec3(-0.1f, 0.0f, 0.0f));
     }
 
     if (pressedKeys[GLFW_KEY_RIGHT]) {
-        characterModel = glm::translate(characterModel, glm::vec3(0.1f, 0.0f, 0.0f));
+        sceneGraph.translateLocal(characterNode, glm::vec3(0.1f, 0.0f, 0.0f));
     }
     if (pressedKeys[GLFW_KEY_N]) {
-        characterModel = glm::translate(characterModel, glm::vec3(0.0f, 0.1f, 0.0f));
+        sceneGraph.translateLocal(characterNode, glm::vec3(0.0f, 0.1f, 0.0f));
     }
     if (pressedKeys[GLFW_KEY_M]) {
-        characterModel = glm::translate(characterModel, glm::vec3(0.0f, -0.1f, 0.0f));
+        sceneGraph.translateLocal(characterNode, glm::vec3(0.0f, -0.1f, 0.0f));
     }
     if (pressedKeys[GLFW_KEY_B]) {
+        // back to the origin, facing the new angle
         angle -= 1.0f;
-        characterModel = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0, 1, 0));
+        sceneGraph.setPosition(characterNode, glm::vec3(0.0f));
+        sceneGraph.setScale(characterNode, glm::vec3(1.0f));
+        sceneGraph.setRotation(characterNode, glm::angleAxis(glm::radians(angle), glm::vec3(0, 1, 0)));
     }
     // Scaling with 'K' and 'L' keys
     const float scaleSpeed = 0.01f;
     if (pressedKeys[GLFW_KEY_K]) {
-        characterModel = glm::scale(characterModel, glm::vec3(1.0f - scaleSpeed));
+        sceneGraph.setScale(characterNode, sceneGraph.getScale(characterNode) * (1.0f - scaleSpeed));
     }
 
     if (pressedKeys[GLFW_KEY_L]) {
-        characterModel = glm::scale(characterModel, glm::vec3(1.0f + scaleSpeed));
+        sceneGraph.setScale(characterNode, sceneGraph.getScale(characterNode) * (1.0f + scaleSpeed));
     }
     if (pressedKeys[GLFW_KEY_1]) {
         polygonMode = GL_FILL;  // Solid mode
@@ -271,16 +378,8 @@ void processMovement() {
         polygonMode = GL_POINT;  // Point mode
     }
 
-    if (pressedKeys[GLFW_KEY_4]) {
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);  // Smooth shading
-        glEnable(GL_POLYGON_SMOOTH);
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    }
-    else {
-        glDisable(GL_POLYGON_SMOOTH);
-        glDisable(GL_BLEND);
-    }
+    // Smooth shading while '4' is held, applied in renderScene
+    isSmoothShadingActive = pressedKeys[GLFW_KEY_4];
     // Toggle punctiform light with 'Z' key
     if (pressedKeys[GLFW_KEY_Z] && !isZKeyProcessed) {
         isPunctiformLightActive = !isPunctiformLightActive; 
@@ -301,18 +400,23 @@ void processMovement() {
     if (pressedKeys[GLFW_KEY_SPACE]) {
         togglePresentationMode();
     }
+    // Toggle the per-frame statistics report with 'F1'
+    if (pressedKeys[GLFW_KEY_F1] && !isF1KeyProcessed) {
+        isFrameStatsActive = !isFrameStatsActive;
+        isF1KeyProcessed = true;
+    }
+    if (!pressedKeys[GLFW_KEY_F1]) {
+        isF1KeyProcessed = false;
+    }
     
     
     view = myCamera.getViewMatrix();
-    myBasicShader.useShaderProgram();
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    normalMatrix = glm::mat3(glm::inverseTranspose(view * characterModel));
 }
 
 
 
-void initOpenGLWindow() {
-    myWindow.Create(1024, 768, "OpenGL Project Core");
+void initOpenGLWindow(bool visible) {
+    myWindow.Create(1024, 768, "OpenGL Project Core", visible);
 }
 
 void setWindowCallbacks() {
@@ -323,11 +427,13 @@ void setWindowCallbacks() {
 
 void initOpenGLState() {
 	glClearColor(0.7f, 0.7f, 0.7f, 1.0f);
-	glViewport(0, 0, myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height);
-    glEnable(GL_FRAMEBUFFER_SRGB);
-	glEnable(GL_DEPTH_TEST); // enable depth-testing
-	glDepthFunc(GL_LESS); // depth-testing interprets a smaller value as "closer"
-	glEnable(GL_CULL_FACE); // cull face
+    glWindowWidth = viewportWidth = myWindow.getWindowDimensions().width;
+    glWindowHeight = viewportHeight = myWindow.getWindowDimensions().height;
+	glViewport(0, 0, viewportWidth, viewportHeight);
+    gps::GLState::enable(GL_FRAMEBUFFER_SRGB);
+	gps::GLState::enable(GL_DEPTH_TEST); // enable depth-testing
+	gps::GLState::depthFunc(GL_LESS); // depth-testing interprets a smaller value as "closer"
+	gps::GLState::enable(GL_CULL_FACE); // cull face
 	glCullFace(GL_BACK); // cull back face
 	glFrontFace(GL_CCW); // GL_CCW for counter clock-wise
 }
@@ -338,136 +444,203 @@ void initModels() {
     character.LoadModel("models/catModel/catfinalmodel4.obj");
     streetlight.LoadModel("models/Felinar/lamp_sp_01.obj");
     boat.LoadModel("models/peaceful/boat.obj");
+
+    teapotNode = sceneGraph.createNode();
+    characterNode = sceneGraph.createNode();
+    boatNode = sceneGraph.createNode();
+    streetlightNode = sceneGraph.createNode(isLampOnBoat ? boatNode : gps::SceneGraph::ROOT);
+    sceneGraph.update();
+
+    // both start at the origin; updateDynamicObjects moves them every frame
+    glm::vec3 center;
+    glm::vec3 extent;
+    gps::TransformBounds(character.GetBounds(), glm::mat4(1.0f), center, extent);
+    characterProxy = dynamicObjects.createProxy(center - extent, center + extent, DYNAMIC_CHARACTER);
+    gps::TransformBounds(boat.GetBounds(), glm::mat4(1.0f), center, extent);
+    boatProxy = dynamicObjects.createProxy(center - extent, center + extent, DYNAMIC_BOAT);
+}
+
+// Uploads the levels of detail streamed in since the last frame
+void updateModelStreaming() {
+    for (gps::Model3D* sceneModel : sceneModels) {
+        sceneModel->UpdateStreaming();
+    }
+}
+
+// Waits for every model to be streamed in completely
+void finishModelStreaming() {
+    for (gps::Model3D* sceneModel : sceneModels) {
+        sceneModel->FinishStreaming();
+    }
+}
+
+bool isSceneDrawable() {
+    for (gps::Model3D* sceneModel : sceneModels) {
+        if (!sceneModel->IsDrawable()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Prints, once each, the time to the first frame that showed every model (at whatever level was resident)
+// and the time until the last level of detail arrived
+void reportLoadTimes(bool frameWasDrawable) {
+    double loadMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - modelLoadStart).count();
+    if (!isFirstMeaningfulFrameReported && frameWasDrawable) {
+        printf("Time to first meaningful frame: %.1f ms\n", loadMs);
+        isFirstMeaningfulFrameReported = true;
+    }
+    if (isFirstMeaningfulFrameReported && !isFullDetailReported) {
+        for (gps::Model3D* sceneModel : sceneModels) {
+            if (sceneModel->IsStreaming()) {
+                return;
+            }
+        }
+        printf("Time to full detail: %.1f ms\n", loadMs);
+        isFullDetailReported = true;
+    }
+}
+
+// Moves the dynamic tree proxies to the world boxes of the character and the boat in the frame
+void updateDynamicObjects(const gps::FrameSnapshot& snapshot) {
+    glm::vec3 center;
+    glm::vec3 extent;
+    gps::TransformBounds(character.GetBounds(), snapshot.worldMatrices[characterNode], center, extent);
+    dynamicObjects.moveProxy(characterProxy, center - extent, center + extent);
+    gps::TransformBounds(boat.GetBounds(), snapshot.worldMatrices[boatNode], center, extent);
+    dynamicObjects.moveProxy(boatProxy, center - extent, center + extent);
 }
 
 void initShaders() {
+    std::string defines;
+    if (gps::Model3D::GetUseBindlessTextures()) {
+        defines += "#define BINDLESS_TEXTURES\n";
+    }
+    if (gps::Model3D::GetUseMultiDrawIndirect() || gps::DrawDataRing::GetUsePersistentMapping()) {
+        defines += "#define DRAW_DATA_ATTRIBUTES\n";
+    }
 	myBasicShader.loadShader(
         "shaders/basic.vert",
-        "shaders/basic.frag");
+        "shaders/basic.frag",
+        defines);
     skyboxShader.loadShader("shaders/skyboxShader.vert", "shaders/skyboxShader.frag");
     skyboxShader.useShaderProgram();
 }
 
 void initUniforms() {
 	myBasicShader.useShaderProgram();
-    characterModel = glm::mat4(1.0f);
-    streetlightModel = glm::mat4(1.0f);
-    boatModel = glm::mat4(1.0f);
-    // create model matrix for teapot
-    model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
-	modelLoc = glGetUniformLocation(myBasicShader.shaderProgram, "model");
+    // the other nodes start at the identity
+    sceneGraph.setRotation(teapotNode, glm::angleAxis(glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f)));
 
 	// get view matrix for current camera
 	view = myCamera.getViewMatrix();
-	viewLoc = glGetUniformLocation(myBasicShader.shaderProgram, "view");
-	// send view matrix to shader
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-
-    // compute normal matrix for teapot
-    normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
-	normalMatrixLoc = glGetUniformLocation(myBasicShader.shaderProgram, "normalMatrix");
 
 	// create projection matrix
 	projection = glm::perspective(glm::radians(45.0f),
                                (float)myWindow.getWindowDimensions().width / (float)myWindow.getWindowDimensions().height,
                                0.1f, 1000.0f);
-	projectionLoc = glGetUniformLocation(myBasicShader.shaderProgram, "projection");
-	// send projection matrix to shader
-	glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));	
 
 	//set the light direction (direction towards the light)
 	lightDir = glm::vec3(0.0f, 1.0f, 1.0f);
-	lightDirLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lightDir");
-	// send light dir to shader
-	glUniform3fv(lightDirLoc, 1, glm::value_ptr(lightDir));
 
 	//set light color
 	lightColor = glm::vec3(1.0f, 1.0f, 1.0f); //white light
-	lightColorLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lightColor");
-	// send light color to shader
-	glUniform3fv(lightColorLoc, 1, glm::value_ptr(lightColor));
-}
-
-void renderTeapot(gps::Shader shader) {
-    // select active shader program
-    shader.useShaderProgram();
-
-    //send teapot model matrix data to shader
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
 
-    //send teapot normal matrix data to shader
-    glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+    // view, projection and lighting reach the shaders through the FrameData block, uploaded once per frame
+    myBasicShader.bindUniformBlock("FrameData", gps::FrameUniformBuffer::FRAME_DATA_BINDING);
+    skyboxShader.bindUniformBlock("FrameData", gps::FrameUniformBuffer::FRAME_DATA_BINDING);
 
-    // draw teapot
-    teapot.Draw(shader);
+    myBasicShader.bindUniformBlock("MaterialHandles", gps::Model3D::MATERIAL_HANDLES_BINDING);
 }
-void renderCharacter(gps::Shader shader) {
-    // select active shader program
-    shader.useShaderProgram();
 
-    //send teapot model matrix data to shader
-   // glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(characterModel));
-    //send teapot normal matrix data to shader
-   //glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-    glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(glm::mat3(glm::inverseTranspose(view * characterModel))));
-    // draw teapot
-    character.Draw(shader);
-
- 
+// Collects the camera and lighting state of the frame in the layout of the FrameData block
+gps::FrameData getFrameData() {
+    gps::FrameData data = {};
+    data.view = view;
+    data.projection = projection;
+    data.skyboxView = glm::mat4(glm::mat3(view));
+    data.lightDir = lightDir;
+    data.lightColor = lightColor;
+    // the point light follows the character
+    data.lightPos = glm::vec3(sceneGraph.getWorldMatrix(characterNode)[3]);
+    data.isLightActive = isPunctiformLightActive;
+    data.isFogActive = isFogActive;
+    data.useTextureArrays = gps::Model3D::GetUseTextureArrays();
+    return data;
 }
-void renderStreetLight(gps::Shader shader) {
-    // select active shader program
-    shader.useShaderProgram();
-
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(streetlightModel));
-   
-   glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
- 
-    streetlight.Draw(shader);
-
 
+// Eye space normal matrix of a scene graph node in the frame; the graph caches it in world space so camera moves dirty nothing
+glm::mat3 getEyeNormalMatrix(const gps::FrameSnapshot& snapshot, int node) {
+    return glm::mat3(snapshot.frameData.view) * snapshot.normalMatrices[node];
 }
-void renderBoat(gps::Shader shader) {
-    // select active shader program
-    shader.useShaderProgram();
-
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(boatModel));
-    
-    glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-   
-    boat.Draw(shader);
-
 
+// Queues the meshes of every scene object; the queue orders and draws them in renderScene
+void submitScene(gps::Shader& shader, const gps::FrameSnapshot& snapshot) {
+    const glm::mat4& frameView = snapshot.frameData.view;
+    const glm::mat4& frameProjection = snapshot.frameData.projection;
+    renderQueue.begin(frameView, frameProjection, 1000.0f);
+    impostorRenderer.begin();
+    gps::ImpostorRenderer* impostors = isImpostorRenderingActive ? &impostorRenderer : NULL;
+
+    // teapot
+    teapot.Submit(renderQueue, shader, snapshot.worldMatrices[teapotNode], getEyeNormalMatrix(snapshot, teapotNode));
+    // street light
+    streetlight.Submit(renderQueue, shader, snapshot.worldMatrices[streetlightNode], getEyeNormalMatrix(snapshot, streetlightNode),
+        gps::PASS_OPAQUE, impostors);
+
+    // moving objects inside the frustum
+    updateDynamicObjects(snapshot);
+    visibleDynamicObjects.clear();
+    dynamicObjects.queryFrustum(gps::Frustum::FromMatrix(frameProjection * frameView), visibleDynamicObjects);
+    for (int object : visibleDynamicObjects) {
+        if (object == DYNAMIC_CHARACTER) {
+            character.Submit(renderQueue, shader, snapshot.worldMatrices[characterNode], getEyeNormalMatrix(snapshot, characterNode),
+                gps::PASS_OPAQUE, impostors);
+        } else if (object == DYNAMIC_BOAT) {
+            boat.Submit(renderQueue, shader, snapshot.worldMatrices[boatNode], getEyeNormalMatrix(snapshot, boatNode),
+                gps::PASS_OPAQUE, impostors);
+        }
+    }
 }
 glm::vec3 getCharacterModelPosition() {
    
-    return glm::vec3(characterModel[3]);
+    return glm::vec3(sceneGraph.getWorldMatrix(characterNode)[3]);
 }
 glm::vec3 getStreetlightPosition() {
-    return glm::vec3(streetlightModel[3]);
+    return glm::vec3(sceneGraph.getWorldMatrix(streetlightNode)[3]);
 }
-void renderScene() {
+void renderScene(const gps::FrameSnapshot& snapshot) {
+    // the window size the simulation saw
+    if (snapshot.framebufferWidth != viewportWidth || snapshot.framebufferHeight != viewportHeight) {
+        viewportWidth = snapshot.framebufferWidth;
+        viewportHeight = snapshot.framebufferHeight;
+        glViewport(0, 0, viewportWidth, viewportHeight);
+    }
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    GLint lightPos=glGetUniformLocation(myBasicShader.shaderProgram, "lightPos");
 	//render the scene
+    if (snapshot.isSmoothShadingActive) {
+        gps::GLState::polygonMode(GL_FILL);  // Smooth shading
+        gps::GLState::enable(GL_POLYGON_SMOOTH);
+        gps::GLState::enable(GL_BLEND);
+        gps::GLState::blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    }
+    else {
+        gps::GLState::disable(GL_POLYGON_SMOOTH);
+        gps::GLState::disable(GL_BLEND);
+    }
      // Set the polygon mode
-    glPolygonMode(GL_FRONT_AND_BACK, polygonMode); 
-    //point light
-    glm::vec3 streetlightPos = getCharacterModelPosition();
-    GLint lightActiveLoc = glGetUniformLocation(myBasicShader.shaderProgram, "isLightActive");
-    glUniform1i(lightActiveLoc, isPunctiformLightActive ? 1 : 0);
-    glUniform3fv(lightPos, 1, glm::value_ptr(streetlightPos));
-    //fog
-    GLint fogActiveLoc = glGetUniformLocation(myBasicShader.shaderProgram, "isFogActive");
-    glUniform1i(fogActiveLoc, isFogActive ? 1 : 0);
+    gps::GLState::polygonMode(snapshot.polygonMode);
+    //camera, point light and fog
+    frameUniforms.update(snapshot.frameData);
 
 	
-	renderTeapot(myBasicShader);
-    renderCharacter(myBasicShader);
-    renderStreetLight(myBasicShader);
-    renderBoat(myBasicShader);
-    mySkyBox.Draw(skyboxShader, view, projection);
+    auto submitStart = std::chrono::high_resolution_clock::now();
+    submitScene(myBasicShader, snapshot);
+    renderQueue.flush();
+    impostorRenderer.draw(snapshot.frameData.view);
+    lastSubmitMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - submitStart).count();
+    mySkyBox.Draw(skyboxShader);
 
 }
 void presentation() {
@@ -485,7 +658,7 @@ void presentation() {
 
         glm::vec3 boatPosition = glm::vec3(radius * sin(presentationTime) + offsetX, 0.0f, radius * cos(presentationTime) + offsetZ);
 
-        boatModel = glm::translate(glm::mat4(1.0f), boatPosition);
+        sceneGraph.setPosition(boatNode, boatPosition);
 
         glm::vec3 cameraOffset = glm::vec3(0.0f, 3.0f, 10.0f);
         glm::vec3 cameraPos = boatPosition + cameraOffset;
@@ -507,6 +680,622 @@ void presentation() {
 
 
 
+// Advances the simulation by one frame - input, presentation and transforms - and copies out what drawing it needs
+void simulateFrame(gps::FrameSnapshot& snapshot) {
+    processMovement();
+    presentation();
+    // object transforms moved since the last frame
+    sceneGraph.update();
+
+    snapshot.frame = simulatedFrames++;
+    snapshot.inputTime = lastPollTime;
+    //camera, point light and fog
+    snapshot.frameData = getFrameData();
+    size_t nodeCount = sceneGraph.getNodeCount();
+    snapshot.worldMatrices.resize(nodeCount);
+    snapshot.normalMatrices.resize(nodeCount);
+    for (size_t node = 0; node < nodeCount; node++) {
+        snapshot.worldMatrices[node] = sceneGraph.getWorldMatrix((int)node);
+        snapshot.normalMatrices[node] = sceneGraph.getNormalMatrix((int)node);
+    }
+    snapshot.sceneGraphStats = sceneGraph.stats;
+    sceneGraph.stats = {};
+    snapshot.framebufferWidth = glWindowWidth;
+    snapshot.framebufferHeight = glWindowHeight;
+    snapshot.polygonMode = polygonMode;
+    snapshot.isSmoothShadingActive = isSmoothShadingActive;
+    snapshot.isFrameStatsActive = isFrameStatsActive;
+}
+
+// Time between presents and from the input poll of the frame to its present
+void recordFrameTiming(const gps::FrameSnapshot& snapshot) {
+    auto now = std::chrono::high_resolution_clock::now();
+    double frameMs = std::chrono::duration<double, std::milli>(now - lastSwapTime).count();
+    double latencyMs = std::chrono::duration<double, std::milli>(now - snapshot.inputTime).count();
+    lastSwapTime = now;
+
+    frameStatsTotal.frameMs += frameMs;
+    frameStatsTotal.latencyMs += latencyMs;
+    renderThreadTiming.frames++;
+    renderThreadTiming.frameMs += frameMs;
+    renderThreadTiming.latencyMs += latencyMs;
+    renderThreadTiming.maxLatencyMs = std::max(renderThreadTiming.maxLatencyMs, latencyMs);
+}
+
+void reportFrameStats(const gps::FrameSnapshot& snapshot);
+void runBindlessBenchmark();
+
+// Draws and presents a simulated frame, on whichever thread owns the context
+void drawFrame(const gps::FrameSnapshot& snapshot) {
+    updateModelStreaming();
+    bool frameIsDrawable = isSceneDrawable();
+    renderScene(snapshot);
+    gps::DrawDataRing::EndFrame();
+    glfwSwapBuffers(myWindow.getWindow());
+    recordFrameTiming(snapshot);
+    reportFrameStats(snapshot);
+    if (isBindlessBenchmarkActive) {
+        runBindlessBenchmark();
+    }
+    reportLoadTimes(frameIsDrawable);
+
+    glCheckError();
+}
+
+void pollEvents() {
+    glfwPollEvents();
+    lastPollTime = std::chrono::high_resolution_clock::now();
+}
+
+// Simulates and draws every frame in turn on the main thread, for frameLimit frames or, with 0, until the window closes
+void runSequentialLoop(int frameLimit) {
+    for (int frame = 0; !glfwWindowShouldClose(myWindow.getWindow()) && (frameLimit == 0 || frame < frameLimit); frame++) {
+        simulateFrame(sequentialSnapshot);
+        drawFrame(sequentialSnapshot);
+        pollEvents();
+    }
+}
+
+// Simulates on the main thread, where GLFW wants its events, while a render thread that owns the context draws and
+// presents the snapshots - frame N + 1 is simulated while frame N is submitted and the swap waits for vsync
+void runThreadedLoop(size_t slots, int frameLimit) {
+    snapshotQueue.init(slots);
+    glfwMakeContextCurrent(NULL);
+    std::thread renderThread([]() {
+        // culling on this thread spreads its own jobs, apart from the simulation's on worker 0
+        gps::JobSystem::RegisterThread();
+        glfwMakeContextCurrent(myWindow.getWindow());
+        for (gps::FrameSnapshot* snapshot = snapshotQueue.beginRead(); snapshot != NULL; snapshot = snapshotQueue.beginRead()) {
+            drawFrame(*snapshot);
+            snapshotQueue.endRead();
+        }
+        glfwMakeContextCurrent(NULL);
+        gps::JobSystem::UnregisterThread();
+    });
+
+    for (int frame = 0; !glfwWindowShouldClose(myWindow.getWindow()) && (frameLimit == 0 || frame < frameLimit); frame++) {
+        simulateFrame(snapshotQueue.beginWrite());
+        snapshotQueue.endWrite();
+        pollEvents();
+    }
+
+    snapshotQueue.close();
+    renderThread.join();
+    glfwMakeContextCurrent(myWindow.getWindow());
+}
+
+// Runs the presentation on the main thread alone and then with double and triple buffered render threads,
+// and prints the frame time and the input to present latency of each
+void runRenderThreadBenchmark() {
+    const char* modeNames[] = { "single thread", "render thread, 2 slots", "render thread, 3 slots" };
+    const size_t modeSlots[] = { 0, 2, 3 };
+
+    isPresentationActive = true;
+    lastPollTime = lastSwapTime = std::chrono::high_resolution_clock::now();
+    for (int mode = 0; mode < 3; mode++) {
+        for (int phase = 0; phase < 2; phase++) {
+            renderThreadTiming = {};
+            int frames = phase == 0 ? RENDER_THREAD_WARMUP_FRAMES : RENDER_THREAD_FRAMES;
+            if (modeSlots[mode] == 0) {
+                runSequentialLoop(frames);
+            } else {
+                runThreadedLoop(modeSlots[mode], frames);
+            }
+        }
+        int frames = std::max(1, renderThreadTiming.frames);
+        printf("%-22s: %.2f ms/frame (%.1f fps), input to present latency %.2f ms average, %.2f ms worst\n", modeNames[mode],
+            renderThreadTiming.frameMs / frames, 1000.0 * frames / renderThreadTiming.frameMs, renderThreadTiming.latencyMs / frames,
+            renderThreadTiming.maxLatencyMs);
+    }
+}
+
+// Accumulates the draw counters of the frame and prints their per-frame average once a second
+void reportFrameStats(const gps::FrameSnapshot& snapshot) {
+    frameStatsFrames++;
+    frameStatsTotal.drawCalls += gps::Mesh::stats.drawCalls;
+    frameStatsTotal.textureBinds += gps::GLState::stats.textureBinds;
+    frameStatsTotal.stateCallsIssued += gps::GLState::stats.issued;
+    frameStatsTotal.stateCallsFiltered += gps::GLState::stats.filtered;
+    frameStatsTotal.uniformUploads += gps::Shader::stats.uploads;
+    frameStatsTotal.uniformsSkipped += gps::Shader::stats.skipped;
+    gps::RenderQueueStats queueStats = renderQueue.getStats();
+    frameStatsTotal.packets += queueStats.packets;
+    frameStatsTotal.culled += queueStats.culled;
+    frameStatsTotal.shaderChanges += queueStats.shaderChanges;
+    frameStatsTotal.materialChanges += queueStats.materialChanges;
+    frameStatsTotal.transformChanges += queueStats.transformChanges;
+    frameStatsTotal.batches += queueStats.batches;
+    frameStatsTotal.occlusionTested += queueStats.occlusionTested;
+    frameStatsTotal.occluded += queueStats.occluded;
+    frameStatsTotal.occlusionMs += queueStats.occlusionMs;
+    frameStatsTotal.gpuTested += queueStats.gpuTested;
+    frameStatsTotal.gpuVisible += queueStats.gpuVisible;
+    frameStatsTotal.triangles += queueStats.triangles;
+    frameStatsTotal.lodSelections += queueStats.lod.selections;
+    frameStatsTotal.lodCoarse += queueStats.lod.coarse;
+    frameStatsTotal.lodSwitches += queueStats.lod.switches;
+    frameStatsTotal.hlodProxies += queueStats.lod.proxies;
+    frameStatsTotal.hlodReplaced += queueStats.lod.replaced;
+    frameStatsTotal.impostors += queueStats.lod.impostors;
+    frameStatsTotal.pvsMeshes += gps::PVS::stats.meshes;
+    frameStatsTotal.pvsVisible += gps::PVS::stats.visible;
+    gps::PVS::stats = {};
+    frameStatsTotal.sceneGraphNodes += snapshot.sceneGraphStats.nodes;
+    frameStatsTotal.sceneGraphRecomputed += snapshot.sceneGraphStats.recomputed;
+    frameStatsTotal.ringRecords += gps::DrawDataRing::stats.records;
+    frameStatsTotal.ringWaits += gps::DrawDataRing::stats.waits;
+    frameStatsTotal.ringStallMs += gps::DrawDataRing::stats.stallMs;
+    gps::DrawDataRing::stats = {};
+    frameStatsTotal.treeMoves += dynamicObjects.stats.moves;
+    frameStatsTotal.treeReinserts += dynamicObjects.stats.reinserts;
+    frameStatsTotal.treeRotations += dynamicObjects.stats.rotations;
+    frameStatsTotal.treeNodesVisited += dynamicObjects.stats.nodesVisited;
+    frameStatsTotal.treeUpdateMs += dynamicObjects.stats.updateMs;
+    frameStatsTotal.treeQueryMs += dynamicObjects.stats.queryMs;
+    dynamicObjects.stats = {};
+    gps::Mesh::stats = {};
+    gps::Shader::stats = {};
+    gps::GLState::stats = {};
+    frameStatsSubmitMs += lastSubmitMs;
+
+    double now = glfwGetTime();
+    if (now - frameStatsStartTime < 1.0) {
+        return;
+    }
+
+    if (snapshot.isFrameStatsActive) {
+        double frames = (double)frameStatsFrames;
+        gps::FrameQueueStats queueWaits = snapshotQueue.getStats();
+        printf("%.1f fps | submit: %.3f ms | draw calls/frame: %.1f | texture binds/frame: %.1f | uniform uploads/frame: %.1f (%.1f skipped)"
+            " | state calls/frame: %.1f (%.1f filtered)"
+            " | queue: %.1f packets (%.1f culled), %.1f indirect batches, %.1f shader / %.1f material / %.1f transform changes"
+            " | draw data ring: %.1f records/frame, %.2f fence waits/frame, %.3f ms stalled/frame"
+            " | dynamic tree: %.1f moves (%.2f reinserts, %.2f rotations), %.1f nodes visited, %.4f ms update, %.4f ms query"
+            " | occlusion: %.1f%% of %.1f tested draws rejected, %.3f ms"
+            " | gpu culling: %.1f of %.1f draws visible"
+            " | lod: %.0f triangles, %.1f of %.1f meshes coarse, %.2f switches, %.2f px threshold"
+            " | hlod: %.1f proxies for %.1f meshes"
+            " | impostors: %.1f billboards"
+            " | pvs: %.1f of %.1f meshes potentially visible"
+            " | scene graph: %.1f of %.1f matrices recomputed"
+            " | frame: %.2f ms, %.2f ms input latency, waits: %.3f ms simulation / %.3f ms render thread\n",
+            frames / (now - frameStatsStartTime), frameStatsSubmitMs / frames, frameStatsTotal.drawCalls / frames, frameStatsTotal.textureBinds / frames,
+            frameStatsTotal.uniformUploads / frames, frameStatsTotal.uniformsSkipped / frames,
+            frameStatsTotal.stateCallsIssued / frames, frameStatsTotal.stateCallsFiltered / frames,
+            frameStatsTotal.packets / frames, frameStatsTotal.culled / frames, frameStatsTotal.batches / frames, frameStatsTotal.shaderChanges / frames,
+            frameStatsTotal.materialChanges / frames, frameStatsTotal.transformChanges / frames,
+            frameStatsTotal.ringRecords / frames, frameStatsTotal.ringWaits / frames, frameStatsTotal.ringStallMs / frames,
+            frameStatsTotal.treeMoves / frames, frameStatsTotal.treeReinserts / frames, frameStatsTotal.treeRotations / frames,
+            frameStatsTotal.treeNodesVisited / frames, frameStatsTotal.treeUpdateMs / frames, frameStatsTotal.treeQueryMs / frames,
+            frameStatsTotal.occlusionTested > 0 ? 100.0 * frameStatsTotal.occluded / frameStatsTotal.occlusionTested : 0.0,
+            frameStatsTotal.occlusionTested / frames, frameStatsTotal.occlusionMs / frames,
+            frameStatsTotal.gpuVisible / frames, frameStatsTotal.gpuTested / frames,
+            frameStatsTotal.triangles / frames, frameStatsTotal.lodCoarse / frames, frameStatsTotal.lodSelections / frames,
+            frameStatsTotal.lodSwitches / frames, renderQueue.getLODSelector().getPixelError(),
+            frameStatsTotal.hlodProxies / frames, frameStatsTotal.hlodReplaced / frames,
+            frameStatsTotal.impostors / frames,
+            frameStatsTotal.pvsVisible / frames, frameStatsTotal.pvsMeshes / frames,
+            frameStatsTotal.sceneGraphRecomputed / frames, frameStatsTotal.sceneGraphNodes / frames,
+            frameStatsTotal.frameMs / frames, frameStatsTotal.latencyMs / frames, queueWaits.writerWaitMs / frames,
+            queueWaits.readerWaitMs / frames);
+
+        // workers (and the render thread, past them) that ran jobs in this window, with the share of the window they spent in them
+        double windowMs = 1000.0 * (now - frameStatsStartTime);
+        for (unsigned int worker = 0; worker < gps::JobSystem::GetSlotCount(); worker++) {
+            gps::JobWorkerStats jobStats = gps::JobSystem::GetWorkerStats(worker);
+            if (jobStats.jobs > 0) {
+                printf("  job worker %u: %.1f%% busy, %u jobs (%u stolen)\n", worker, 100.0 * jobStats.busyMs / windowMs, jobStats.jobs,
+                    jobStats.steals);
+            }
+        }
+    }
+    gps::JobSystem::ResetStats();
+    snapshotQueue.resetStats();
+
+    frameStatsStartTime = now;
+    frameStatsFrames = 0;
+    frameStatsTotal = {};
+    frameStatsSubmitMs = 0.0;
+}
+
+// Times the scene submission for BENCHMARK_FRAMES frames on the bindless path, then on the bind-per-draw path
+void runBindlessBenchmark() {
+    if (benchmarkFrame == 0 && !gps::Model3D::GetUseBindlessTextures()) {
+        std::cout << "Bindless benchmark: no bindless path to compare against" << std::endl;
+        glfwSetWindowShouldClose(myWindow.getWindow(), GL_TRUE);
+        return;
+    }
+
+    int phase = benchmarkFrame / (BENCHMARK_WARMUP_FRAMES + BENCHMARK_FRAMES);
+    int phaseFrame = benchmarkFrame % (BENCHMARK_WARMUP_FRAMES + BENCHMARK_FRAMES);
+    benchmarkFrame++;
+
+    if (phaseFrame >= BENCHMARK_WARMUP_FRAMES) {
+        benchmarkSubmitMs[phase] += lastSubmitMs;
+    }
+
+    if (phaseFrame == BENCHMARK_WARMUP_FRAMES + BENCHMARK_FRAMES - 1) {
+        if (phase == 0) {
+            gps::Model3D::SetUseBindlessTextures(false);
+            return;
+        }
+
+        printf("CPU submission, bindless     : %.3f ms/frame\n", benchmarkSubmitMs[0] / BENCHMARK_FRAMES);
+        printf("CPU submission, bind per draw: %.3f ms/frame\n", benchmarkSubmitMs[1] / BENCHMARK_FRAMES);
+        glfwSetWindowShouldClose(myWindow.getWindow(), GL_TRUE);
+    }
+}
+
+// Loads an instancing benchmark shader, reading the same FrameData as the scene
+void initBenchmarkShader(gps::Shader& shader, std::string defines) {
+    shader.loadShader("shaders/basic.vert", "shaders/basic.frag", defines);
+    shader.bindUniformBlock("FrameData", gps::FrameUniformBuffer::FRAME_DATA_BINDING);
+}
+
+// Draws a grid of 1k, 10k and 100k streetlights one Draw call per copy and with one DrawInstanced call,
+// prints the CPU submission and whole frame time of both, then exits
+void runInstancingBenchmark() {
+    gps::Shader perCopyShader;
+    gps::Shader instancedShader;
+    initBenchmarkShader(perCopyShader, "");
+    initBenchmarkShader(instancedShader, "#define DRAW_DATA_ATTRIBUTES\n");
+
+    gps::FrameData frameData = getFrameData();
+    frameData.isLightActive = false;
+    frameData.isFogActive = false;
+    frameUniforms.update(frameData);
+
+    const size_t instanceCounts[] = { 1000, 10000, 100000 };
+    printf("%9s | %-30s | %-30s\n", "instances", "per-copy Draw (cpu / frame ms)", "DrawInstanced (cpu / frame ms)");
+
+    for (size_t count : instanceCounts) {
+        // square grid around the origin, 2 units apart
+        std::vector<glm::mat4> transforms(count);
+        int side = (int)ceil(sqrt((double)count));
+        for (size_t i = 0; i < count; i++) {
+            glm::vec3 position(2.0f * (float)((int)i % side - side / 2), 0.0f, -2.0f * (float)((int)i / side));
+            transforms[i] = glm::scale(glm::translate(glm::mat4(1.0f), position), glm::vec3(0.2f));
+        }
+
+        double cpuMs[2] = { 0.0, 0.0 };
+        double frameMs[2] = { 0.0, 0.0 };
+        for (int instanced = 0; instanced < 2; instanced++) {
+            for (int frame = 0; frame < INSTANCING_WARMUP_FRAMES + INSTANCING_FRAMES; frame++) {
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+                auto start = std::chrono::high_resolution_clock::now();
+                if (instanced) {
+                    streetlight.DrawInstanced(instancedShader, transforms.data(), transforms.size(), view);
+                } else {
+                    for (size_t i = 0; i < count; i++) {
+                        perCopyShader.setMat4("model", transforms[i]);
+                        perCopyShader.setMat3("normalMatrix", glm::mat3(glm::inverseTranspose(view * transforms[i])));
+                        streetlight.Draw(perCopyShader);
+                    }
+                }
+                gps::DrawDataRing::EndFrame();
+                auto submitted = std::chrono::high_resolution_clock::now();
+                glFinish();
+                auto finished = std::chrono::high_resolution_clock::now();
+
+                if (frame >= INSTANCING_WARMUP_FRAMES) {
+                    cpuMs[instanced] += std::chrono::duration<double, std::milli>(submitted - start).count();
+                    frameMs[instanced] += std::chrono::duration<double, std::milli>(finished - start).count();
+                }
+
+                glfwPollEvents();
+                glfwSwapBuffers(myWindow.getWindow());
+            }
+        }
+
+        printf("%9zu | %13.3f / %-14.3f | %13.3f / %-14.3f\n", count,
+            cpuMs[0] / INSTANCING_FRAMES, frameMs[0] / INSTANCING_FRAMES,
+            cpuMs[1] / INSTANCING_FRAMES, frameMs[1] / INSTANCING_FRAMES);
+    }
+}
+
+// Rasterizes a 4 x 4 quad 10 units in front of the camera and checks which boxes the occlusion culler hides:
+// one behind the quad, one in front of it, one across its silhouette and one sliver just outside it that
+// shares the silhouette's partly covered pixels. Returns false when any of them comes out wrong
+bool runOcclusionTest() {
+    glm::mat4 testView = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 testProjection = glm::perspective(glm::radians(45.0f),
+        (float)gps::OcclusionCuller::WIDTH / gps::OcclusionCuller::HEIGHT, 0.1f, 1000.0f);
+
+    std::vector<gps::Vertex> quad(4);
+    quad[0].Position = glm::vec3(-2.0f, -2.0f, -10.0f);
+    quad[1].Position = glm::vec3(2.0f, -2.0f, -10.0f);
+    quad[2].Position = glm::vec3(2.0f, 2.0f, -10.0f);
+    quad[3].Position = glm::vec3(-2.0f, 2.0f, -10.0f);
+    std::vector<GLuint> quadIndices = { 0, 1, 2, 0, 2, 3 };
+
+    gps::OcclusionCuller occlusion;
+    occlusion.begin(testProjection * testView);
+    occlusion.addOccluder(quad, quadIndices, glm::mat4(1.0f));
+    occlusion.rasterize();
+
+    // at 20 units the quad's right silhouette lies at x = 4
+    struct OcclusionCase {
+        const char* name;
+        glm::vec3 center;
+        glm::vec3 extent;
+        bool expectVisible;
+    };
+    const OcclusionCase cases[] = {
+        { "box behind the quad", glm::vec3(0.0f, 0.0f, -20.0f), glm::vec3(0.5f), false },
+        { "box in front of the quad", glm::vec3(0.0f, 0.0f, -5.0f), glm::vec3(0.5f), true },
+        { "box behind the quad's edge", glm::vec3(4.0f, 0.0f, -20.0f), glm::vec3(0.5f), true },
+        { "sliver just past the edge", glm::vec3(4.01f, 0.0f, -20.0f), glm::vec3(0.002f), true },
+    };
+
+    bool passed = true;
+    for (const OcclusionCase& test : cases) {
+        bool visible = occlusion.isVisible(test.center, test.extent);
+        printf("%-28s: %-7s (expected %s) %s\n", test.name, visible ? "visible" : "hidden",
+            test.expectVisible ? "visible" : "hidden", visible == test.expectVisible ? "ok" : "FAILED");
+        passed = passed && visible == test.expectVisible;
+    }
+    return passed;
+}
+
+// Culls a million random boxes against a 45 degree frustum on every compiled path and prints the throughput
+void runCullingBenchmark() {
+    const size_t BOX_COUNT = 1000000;
+    const int ITERATIONS = 20;
+
+    std::mt19937 random(12345);
+    std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+    std::uniform_real_distribution<float> size(0.5f, 5.0f);
+
+    gps::FrustumCuller culler;
+    for (size_t i = 0; i < BOX_COUNT; i++) {
+        culler.add(glm::vec3(position(random), position(random), position(random)), glm::vec3(size(random), size(random), size(random)));
+    }
+
+    glm::mat4 benchmarkView = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 benchmarkProjection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 1000.0f);
+    gps::Frustum frustum = gps::Frustum::FromMatrix(benchmarkProjection * benchmarkView);
+
+    std::vector<unsigned char> visible;
+    for (int path = gps::CULL_SCALAR; path <= gps::FrustumCuller::GetBestPath(); path++) {
+        size_t visibleCount = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < ITERATIONS; i++) {
+            visibleCount = culler.cull(frustum, visible, (gps::CULL_PATH)path);
+        }
+        double us = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+
+        printf("%-6s: %8.1f boxes/us (%zu of %zu visible)\n", gps::FrustumCuller::GetPathName((gps::CULL_PATH)path),
+            BOX_COUNT * (double)ITERATIONS / us, visibleCount, BOX_COUNT);
+    }
+}
+
+// Composes world and normal matrices for 10k, 100k and 1M random transforms, one glm::mat4 at a time through
+// glm::inverseTranspose as the scene did, then from the structure of arrays on every compiled path
+void runTransformBenchmark() {
+    const size_t transformCounts[] = { 10000, 100000, 1000000 };
+    const int ITERATIONS = 10;
+
+    std::mt19937 random(12345);
+    std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+    std::uniform_real_distribution<float> axis(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> size(0.5f, 5.0f);
+
+    printf("%10s | %12s", "transforms", "glm");
+    for (int path = gps::TRANSFORM_SCALAR; path <= gps::TransformArray::GetBestPath(); path++) {
+        printf(" | %12s", gps::TransformArray::GetPathName((gps::TRANSFORM_PATH)path));
+    }
+    printf("   (transforms/us)\n");
+
+    for (size_t count : transformCounts) {
+
+        std::vector<glm::vec3> positions(count), scales(count);
+        std::vector<glm::quat> rotations(count);
+        gps::TransformArray transforms;
+        for (size_t i = 0; i < count; i++) {
+            positions[i] = glm::vec3(position(random), position(random), position(random));
+            rotations[i] = glm::angleAxis(glm::radians(position(random)), glm::normalize(glm::vec3(axis(random), axis(random), 1.0f)));
+            scales[i] = glm::vec3(size(random), size(random), size(random));
+            transforms.add(positions[i], rotations[i], scales[i]);
+        }
+
+        std::vector<glm::mat4> world(count);
+        std::vector<glm::mat3> normal(count);
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int iteration = 0; iteration < ITERATIONS; iteration++) {
+            for (size_t i = 0; i < count; i++) {
+                world[i] = glm::scale(glm::translate(glm::mat4(1.0f), positions[i]) * glm::mat4_cast(rotations[i]), scales[i]);
+                normal[i] = glm::mat3(glm::inverseTranspose(world[i]));
+            }
+        }
+        double us = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+        printf("%10zu | %12.1f", count, count * (double)ITERATIONS / us);
+
+        // every path must agree with glm on every matrix, translation column included
+        float errors[gps::TRANSFORM_AVX + 1] = {};
+        for (int path = gps::TRANSFORM_SCALAR; path <= gps::TransformArray::GetBestPath(); path++) {
+            start = std::chrono::high_resolution_clock::now();
+            for (int iteration = 0; iteration < ITERATIONS; iteration++) {
+                transforms.update((gps::TRANSFORM_PATH)path);
+            }
+            us = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+            printf(" | %12.1f", count * (double)ITERATIONS / us);
+
+            for (size_t i = 0; i < count; i++) {
+                for (int c = 0; c < 4; c++) {
+                    errors[path] = std::max(errors[path], glm::length(world[i][c] - transforms.getWorldMatrix(i)[c]));
+                }
+                for (int c = 0; c < 3; c++) {
+                    errors[path] = std::max(errors[path], glm::length(normal[i][c] - transforms.getNormalMatrix(i)[c]));
+                }
+            }
+        }
+
+        printf("   (max difference");
+        for (int path = gps::TRANSFORM_SCALAR; path <= gps::TransformArray::GetBestPath(); path++) {
+            printf(" %s %.2g", gps::TransformArray::GetPathName((gps::TRANSFORM_PATH)path), errors[path]);
+        }
+        printf(")\n");
+    }
+}
+
+// Runs one task graph of transform updates (1M), frustum culling (1M boxes) and a hierarchy build (100k boxes) on 1 to N
+// workers and prints the time per run, the speedup over one worker and how busy every worker was
+void runJobBenchmark() {
+    const size_t TRANSFORM_COUNT = 1000000;
+    const size_t BOX_COUNT = 1000000;
+    const size_t BVH_COUNT = 100000;
+    const int ITERATIONS = 10;
+
+    std::mt19937 random(12345);
+    std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+    std::uniform_real_distribution<float> size(0.5f, 5.0f);
+
+    gps::TransformArray transforms;
+    for (size_t i = 0; i < TRANSFORM_COUNT; i++) {
+        transforms.add(glm::vec3(position(random), position(random), position(random)),
+            glm::angleAxis(glm::radians(position(random)), glm::vec3(0.0f, 1.0f, 0.0f)), glm::vec3(size(random)));
+    }
+    gps::FrustumCuller culler;
+    for (size_t i = 0; i < BOX_COUNT; i++) {
+        culler.add(glm::vec3(position(random), position(random), position(random)), glm::vec3(size(random), size(random), size(random)));
+    }
+    std::vector<gps::Bounds> bounds(BVH_COUNT);
+    for (size_t i = 0; i < BVH_COUNT; i++) {
+        glm::vec3 center(position(random), position(random), position(random));
+        glm::vec3 extent(size(random), size(random), size(random));
+        bounds[i].min = center - extent;
+        bounds[i].max = center + extent;
+        bounds[i].center = center;
+        bounds[i].radius = glm::length(extent);
+    }
+
+    glm::mat4 benchmarkView = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 benchmarkProjection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 1000.0f);
+    gps::Frustum frustum = gps::Frustum::FromMatrix(benchmarkProjection * benchmarkView);
+
+    std::vector<unsigned char> visible;
+    gps::SceneBVH bvh;
+    size_t visibleCount = 0;
+    gps::TaskGraph graph;
+    int updateTask = graph.add([&]() { transforms.update(); });
+    int cullTask = graph.add([&]() { visibleCount = culler.cull(frustum, visible); });
+    int buildTask = graph.add([&]() { bvh.build(bounds); });
+    // stands in for work that needs all three, like filling the render queue
+    int gatherTask = graph.add([&]() { visibleCount += transforms.size() > 0 ? 1 : 0; });
+    graph.precede(updateTask, gatherTask);
+    graph.precede(cullTask, gatherTask);
+    graph.precede(buildTask, gatherTask);
+
+    unsigned int maxWorkers = std::max(1u, std::thread::hardware_concurrency());
+    double singleMs = 0.0;
+    printf("%7s | %10s | %7s | utilization per worker\n", "workers", "ms/run", "speedup");
+    for (unsigned int workers = 1; workers <= maxWorkers; workers++) {
+
+        gps::JobSystem::Init(workers);
+        gps::JobSystem::Run(graph);
+        gps::JobSystem::ResetStats();
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int iteration = 0; iteration < ITERATIONS; iteration++) {
+            gps::JobSystem::Run(graph);
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        if (workers == 1) {
+            singleMs = ms;
+        }
+
+        printf("%7u | %10.2f | %6.2fx |", workers, ms / ITERATIONS, singleMs / ms);
+        for (unsigned int worker = 0; worker < workers; worker++) {
+            gps::JobWorkerStats jobStats = gps::JobSystem::GetWorkerStats(worker);
+            printf(" %3.0f%%", 100.0 * jobStats.busyMs / ms);
+        }
+        printf("\n");
+    }
+    gps::JobSystem::Shutdown();
+}
+
+// Builds hierarchies over 1k, 10k and 100k random boxes and compares their traversal with brute force SIMD culling
+// for a camera turning around the origin
+void runBVHBenchmark() {
+    const size_t instanceCounts[] = { 1000, 10000, 100000 };
+    const int DIRECTIONS = 16;
+    const int ITERATIONS = 50;
+
+    glm::mat4 benchmarkProjection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 1000.0f);
+    printf("%9s | %8s | %8s | %-22s | %-22s\n", "instances", "build ms", "nodes", "brute force us (boxes)", "BVH us (nodes visited)");
+
+    for (size_t count : instanceCounts) {
+        std::mt19937 random(12345);
+        std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+        std::uniform_real_distribution<float> size(0.5f, 5.0f);
+
+        std::vector<gps::Bounds> bounds(count);
+        gps::FrustumCuller culler;
+        for (size_t i = 0; i < count; i++) {
+            glm::vec3 center(position(random), position(random), position(random));
+            glm::vec3 extent(size(random), size(random), size(random));
+            bounds[i].min = center - extent;
+            bounds[i].max = center + extent;
+            culler.add(center, extent);
+        }
+
+        gps::SceneBVH bvh;
+        auto buildStart = std::chrono::high_resolution_clock::now();
+        bvh.build(bounds);
+        double buildMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - buildStart).count();
+
+        double bruteForceUs = 0.0;
+        double bvhUs = 0.0;
+        unsigned int nodesVisited = 0;
+        std::vector<unsigned char> visible;
+        std::vector<GLuint> visibleItems;
+        for (int direction = 0; direction < DIRECTIONS; direction++) {
+            float yaw = glm::radians(360.0f * direction / DIRECTIONS);
+            glm::mat4 benchmarkView = glm::lookAt(glm::vec3(0.0f), glm::vec3(sin(yaw), 0.0f, -cos(yaw)), glm::vec3(0.0f, 1.0f, 0.0f));
+            gps::Frustum frustum = gps::Frustum::FromMatrix(benchmarkProjection * benchmarkView);
+
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int i = 0; i < ITERATIONS; i++) {
+                culler.cull(frustum, visible);
+            }
+            auto middle = std::chrono::high_resolution_clock::now();
+            for (int i = 0; i < ITERATIONS; i++) {
+                visibleItems.clear();
+                bvh.cull(frustum, visibleItems);
+            }
+            auto end = std::chrono::high_resolution_clock::now();
+
+            bruteForceUs += std::chrono::duration<double, std::micro>(middle - start).count();
+            bvhUs += std::chrono::duration<double, std::micro>(end - middle).count();
+            nodesVisited += bvh.stats.nodesVisited;
+        }
+
+        printf("%9zu | %8.2f | %8zu | %10.2f (%9zu) | %10.2f (%9.0f)\n", count, buildMs, bvh.getNodeCount(),
+            bruteForceUs / (DIRECTIONS * ITERATIONS), count, bvhUs / (DIRECTIONS * ITERATIONS), nodesVisited / (double)DIRECTIONS);
+    }
+}
+
 void initSkyBox() {
     faces.push_back("skybox/greenhaze_rt.tga");  // Right
     faces.push_back("skybox/greenhaze_lf.tga");  // Left
@@ -528,33 +1317,211 @@ void cleanup() {
 
 int main(int argc, const char * argv[]) {
 
+    bool requestBindless = false;
+    bool requestMultiDraw = false;
+    bool requestPersistentRing = false;
+    bool requestOcclusionCulling = false;
+    bool requestGPUCulling = false;
+    float hlodCellSize = 0.0f;
+    bool requestImpostors = false;
+    bool isImpostorBakeActive = false;
+    bool requestPVS = false;
+    float pvsBakeCellSize = 0.0f;
+    unsigned int jobWorkers = 0;
+
+    for (int i = 1; i < argc; i++) {
+        // --texture-quality <0..3>: number of top mip levels dropped from every texture
+        if (std::string(argv[i]) == "--texture-quality" && i + 1 < argc) {
+            gps::Model3D::SetTextureQuality((gps::TEXTURE_QUALITY)std::max(0, std::min(3, atoi(argv[++i]))));
+        }
+        // --texture-arrays: pack same-size material textures into GL_TEXTURE_2D_ARRAY objects
+        if (std::string(argv[i]) == "--texture-arrays") {
+            gps::Model3D::SetUseTextureArrays(true);
+        }
+        // --bindless: resident texture handles instead of per-draw binds, when the driver supports them
+        if (std::string(argv[i]) == "--bindless") {
+            requestBindless = true;
+        }
+        // --bench-bindless: compare the CPU submission time of the bindless and bind-per-draw paths, then exit
+        if (std::string(argv[i]) == "--bench-bindless") {
+            requestBindless = true;
+            isBindlessBenchmarkActive = true;
+        }
+        // --bench-instancing: compare per-copy Draw calls with DrawInstanced for up to 100k streetlights, then exit
+        if (std::string(argv[i]) == "--bench-instancing") {
+            isInstancingBenchmarkActive = true;
+        }
+        // --persistent-ring: write per-draw transforms into a persistently mapped, fenced triple-buffered ring
+        if (std::string(argv[i]) == "--persistent-ring") {
+            requestPersistentRing = true;
+        }
+        // --test-occlusion: check the occlusion culler against a quad occluder on the CPU, then exit (non-zero on failure)
+        if (std::string(argv[i]) == "--test-occlusion") {
+            return runOcclusionTest() ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        // --bench-culling: measure frustum culling throughput on the scalar and SIMD paths, then exit
+        if (std::string(argv[i]) == "--bench-culling") {
+            runCullingBenchmark();
+            return EXIT_SUCCESS;
+        }
+        // --bench-transforms: compare per-object glm matrix composition with the SoA scalar and AVX paths at 10k to 1M transforms, then exit
+        if (std::string(argv[i]) == "--bench-transforms") {
+            runTransformBenchmark();
+            return EXIT_SUCCESS;
+        }
+        // --bench-jobs: run transform, culling and hierarchy jobs on 1 to N workers and print the scaling, then exit
+        if (std::string(argv[i]) == "--bench-jobs") {
+            runJobBenchmark();
+            return EXIT_SUCCESS;
+        }
+        // --jobs <workers>: size of the job system, including the main thread (default: one per hardware thread)
+        if (std::string(argv[i]) == "--jobs" && i + 1 < argc) {
+            jobWorkers = (unsigned int)std::max(1, atoi(argv[++i]));
+        }
+        // --bench-bvh: compare hierarchy traversal with brute force culling at 1k, 10k and 100k instances, then exit
+        if (std::string(argv[i]) == "--bench-bvh") {
+            runBVHBenchmark();
+            return EXIT_SUCCESS;
+        }
+        // --multi-draw: submit the render queue with one glMultiDrawElementsIndirect per batch, when the driver supports it
+        if (std::string(argv[i]) == "--multi-draw") {
+            requestMultiDraw = true;
+        }
+        // --occlusion-culling: drop the draws hidden behind the large scene meshes, tested on a CPU rasterized depth buffer
+        if (std::string(argv[i]) == "--occlusion-culling") {
+            requestOcclusionCulling = true;
+        }
+        // --lod-error <pixels>: draw the coarsest generated level of detail whose error stays under this many pixels
+        if (std::string(argv[i]) == "--lod-error" && i + 1 < argc) {
+            renderQueue.getLODSelector().setEnabled(true);
+            renderQueue.getLODSelector().setPixelError((float)atof(argv[++i]));
+        }
+        // --triangle-budget <triangles>: raise the level of detail error threshold while frames draw more triangles
+        if (std::string(argv[i]) == "--triangle-budget" && i + 1 < argc) {
+            renderQueue.getLODSelector().setEnabled(true);
+            renderQueue.getLODSelector().setTriangleBudget((size_t)std::max(0, atoi(argv[++i])));
+        }
+        // --hlod <cell size>: bake the small scene meshes into one proxy per cell, drawn instead of them at a distance
+        if (std::string(argv[i]) == "--hlod" && i + 1 < argc) {
+            hlodCellSize = (float)atof(argv[++i]);
+        }
+        // --impostors: draw the street light, the boat and the cat as octahedral impostor billboards at a distance
+        if (std::string(argv[i]) == "--impostors") {
+            requestImpostors = true;
+        }
+        // --bake-impostors: rebake and save the impostors of those models in a hidden window, then exit
+        if (std::string(argv[i]) == "--bake-impostors") {
+            isImpostorBakeActive = true;
+        }
+        // --pvs: filter the scene meshes by the potentially visible set of the camera's cell, baked with --bake-pvs
+        if (std::string(argv[i]) == "--pvs") {
+            requestPVS = true;
+        }
+        // --bake-pvs <cell size>: sample the potentially visible sets of the scene in a hidden window, save them and exit
+        if (std::string(argv[i]) == "--bake-pvs" && i + 1 < argc) {
+            pvsBakeCellSize = (float)atof(argv[++i]);
+        }
+        // --attach-lamp: parent the street light to the boat so it follows the boat in the presentation
+        if (std::string(argv[i]) == "--attach-lamp") {
+            isLampOnBoat = true;
+        }
+        // --progressive-loading: load cooked models coarsest level first and stream the finer levels while drawing
+        if (std::string(argv[i]) == "--progressive-loading") {
+            gps::Model3D::SetUseProgressiveLoading(true);
+        }
+        // --gpu-culling: frustum and Hi-Z cull the multi-draw batches in a compute shader (implies --multi-draw)
+        if (std::string(argv[i]) == "--gpu-culling") {
+            requestMultiDraw = true;
+            requestGPUCulling = true;
+        }
+        // --render-thread <2|3>: draw on a render thread fed by 2 (double buffered) or 3 (triple buffered) simulation snapshots
+        if (std::string(argv[i]) == "--render-thread" && i + 1 < argc) {
+            renderThreadSlots = (size_t)std::min(3, std::max(2, atoi(argv[++i])));
+        }
+        // --bench-render-thread: run the presentation single threaded and with 2 and 3 render thread slots, print frame time and latency, then exit
+        if (std::string(argv[i]) == "--bench-render-thread") {
+            isRenderThreadBenchmarkActive = true;
+        }
+    }
+
+    // model loading, the bakes and large culling passes spread over these
+    gps::JobSystem::Init(jobWorkers);
+
     try {
-        initOpenGLWindow();
+        initOpenGLWindow(!isImpostorBakeActive && pvsBakeCellSize <= 0.0f);
     } catch (const std::exception& e) {
         std::cerr << e.what() << std::endl;
         return EXIT_FAILURE;
     }
+    gps::Model3D::SetUseBindlessTextures(requestBindless);
+    gps::Model3D::SetUseMultiDrawIndirect(requestMultiDraw);
+    gps::GPUCuller::SetUseGPUCulling(requestGPUCulling);
+    gps::DrawDataRing::SetUsePersistentMapping(requestPersistentRing);
+    // the HLOD proxies merge the coarsest levels of their members
+    gps::Model3D::SetUseLODs(renderQueue.getLODSelector().isEnabled() || hlodCellSize > 0.0f);
 
     initOpenGLState();
+    modelLoadStart = std::chrono::high_resolution_clock::now();
 	initModels();
+    gps::Model3D::ReportTextureStats();
+    // these read the full geometry back on the CPU
+    if (hlodCellSize > 0.0f || pvsBakeCellSize > 0.0f || requestOcclusionCulling || requestImpostors || isImpostorBakeActive
+        || isInstancingBenchmarkActive) {
+        finishModelStreaming();
+    }
+    if (hlodCellSize > 0.0f) {
+        teapot.BuildHLOD(hlodCellSize);
+    }
+    if (pvsBakeCellSize > 0.0f) {
+        teapot.BakePVS(pvsBakeCellSize);
+        cleanup();
+        return EXIT_SUCCESS;
+    }
+    if (requestPVS && !teapot.LoadPVS()) {
+        std::cerr << "No potentially visible sets for the scene, bake them with --bake-pvs <cell size>" << std::endl;
+    }
+    if (requestImpostors || isImpostorBakeActive) {
+        impostorBakeShader.loadShader("shaders/impostorBake.vert", "shaders/impostorBake.frag");
+        streetlight.BuildImpostor(impostorBakeShader, isImpostorBakeActive);
+        boat.BuildImpostor(impostorBakeShader, isImpostorBakeActive);
+        character.BuildImpostor(impostorBakeShader, isImpostorBakeActive);
+        if (isImpostorBakeActive) {
+            cleanup();
+            return EXIT_SUCCESS;
+        }
+        impostorRenderer.init();
+        impostorRenderer.getShader().bindUniformBlock("FrameData", gps::FrameUniformBuffer::FRAME_DATA_BINDING);
+        isImpostorRenderingActive = true;
+    }
+    if (requestOcclusionCulling) {
+        renderQueue.setOcclusionCulling(true);
+        std::cout << "Occlusion culling: " << teapot.MarkOccluders(OCCLUDER_MIN_RADIUS, OCCLUDER_MAX_TRIANGLES) << " occluder meshes" << std::endl;
+    }
 	initShaders();
 	initUniforms();
     initSkyBox();
     setWindowCallbacks();
-    
 
-	glCheckError();
-	// application loop
-	while (!glfwWindowShouldClose(myWindow.getWindow())) {
-        processMovement();
-        presentation();
-	    renderScene();
+    if (isInstancingBenchmarkActive) {
+        runInstancingBenchmark();
+        cleanup();
+        return EXIT_SUCCESS;
+    }
 
-		glfwPollEvents();
-		glfwSwapBuffers(myWindow.getWindow());
+    if (isRenderThreadBenchmarkActive) {
+        runRenderThreadBenchmark();
+        cleanup();
+        return EXIT_SUCCESS;
+    }
 
-		glCheckError();
-	}
+	glCheckError();
+	// application loop
+    lastPollTime = lastSwapTime = std::chrono::high_resolution_clock::now();
+    if (renderThreadSlots > 0) {
+        runThreadedLoop(renderThreadSlots, 0);
+    } else {
+        runSequentialLoop(0);
+    }
 
 	cleanup();
 
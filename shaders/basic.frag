@@ -1,4 +1,7 @@
 #version 410 core
+#ifdef BINDLESS_TEXTURES
+#extension GL_ARB_bindless_texture : require
+#endif
 
 in vec3 fPosition;
 in vec3 fNormal;
@@ -7,17 +10,53 @@ in vec2 fTexCoords;
 out vec4 fColor;
 
 //matrices
+#ifdef DRAW_DATA_ATTRIBUTES
+// per-draw transforms, passed on by the vertex shader
+flat in mat4 fModel;
+flat in mat3 fNormalMatrix;
+#define model fModel
+#define normalMatrix fNormalMatrix
+#else
 uniform mat4 model;
-uniform mat4 view;
 uniform mat3 normalMatrix;
-//lighting
-uniform vec3 lightDir;
-uniform vec3 lightColor;
-uniform vec3 lightPos;  // Punctiform light position
-uniform bool isLightActive;
+#endif
+// camera and lighting data of the frame, shared by every program (gps::FrameData)
+layout(std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 skyboxView;
+    vec3 lightDir;
+    vec3 lightColor;
+    vec3 lightPos;
+    bool isLightActive;
+    bool isFogActive;
+    bool useTextureArrays;
+};
 // textures
 uniform sampler2D diffuseTexture;
 uniform sampler2D specularTexture;
+// textures packed into arrays, selected by layer
+uniform sampler2DArray diffuseTextureArray;
+uniform sampler2DArray specularTextureArray;
+uniform int diffuseTextureLayer;
+uniform int specularTextureLayer;
+#ifdef DRAW_DATA_ATTRIBUTES
+// per-draw layers (x - diffuse, y - specular), negative when the layer uniforms apply
+flat in ivec2 fTextureLayers;
+#endif
+#ifdef BINDLESS_TEXTURES
+// resident texture handles of the model's materials: xy - diffuse, zw - specular
+layout(std140) uniform MaterialHandles {
+    uvec4 materialHandles[256];
+};
+// negative when the mesh binds its textures instead
+#ifdef DRAW_DATA_ATTRIBUTES
+flat in int fMaterialIndex;
+#define materialIndex fMaterialIndex
+#else
+uniform int materialIndex;
+#endif
+#endif
 
 //components
 vec3 ambient;
@@ -26,7 +65,6 @@ vec3 diffuse;
 vec3 specular;
 float specularStrength = 0.5f;
 //fog 
-uniform bool isFogActive;
 uniform float fogDensity=0.1f; // density of the fog
 uniform vec3 fogColor=vec3(0.6f, 0.6f, 0.61f);    // color of the fog
 //shadow
@@ -92,6 +130,42 @@ void computePunctiformLight()
     float specCoeff = pow(max(dot(normalEye, halfVector), 0.0f), 32);
     specular = specularStrength * specCoeff * lightColor;
 }
+vec3 sampleDiffuse()
+{
+#ifdef BINDLESS_TEXTURES
+    if (materialIndex >= 0) {
+        return texture(sampler2D(materialHandles[materialIndex].xy), fTexCoords).rgb;
+    }
+#endif
+    if (useTextureArrays) {
+        int layer = diffuseTextureLayer;
+#ifdef DRAW_DATA_ATTRIBUTES
+        if (fTextureLayers.x >= 0) {
+            layer = fTextureLayers.x;
+        }
+#endif
+        return texture(diffuseTextureArray, vec3(fTexCoords, layer)).rgb;
+    }
+    return texture(diffuseTexture, fTexCoords).rgb;
+}
+vec3 sampleSpecular()
+{
+#ifdef BINDLESS_TEXTURES
+    if (materialIndex >= 0) {
+        return texture(sampler2D(materialHandles[materialIndex].zw), fTexCoords).rgb;
+    }
+#endif
+    if (useTextureArrays) {
+        int layer = specularTextureLayer;
+#ifdef DRAW_DATA_ATTRIBUTES
+        if (fTextureLayers.y >= 0) {
+            layer = fTextureLayers.y;
+        }
+#endif
+        return texture(specularTextureArray, vec3(fTexCoords, layer)).rgb;
+    }
+    return texture(specularTexture, fTexCoords).rgb;
+}
 void computeFog(vec3 color){
     vec4 fPosEye = view * model * vec4(fPosition, 1.0f);
     float distance = length(fPosEye.xyz);
@@ -127,8 +201,8 @@ void main()
 
 
     // Compute final vertex color
-    vec3 textureColor = texture(diffuseTexture, fTexCoords).rgb;
-    vec3 color = min((ambient + diffuse) * textureColor + specular * texture(specularTexture, fTexCoords).rgb, 1.0f);
+    vec3 textureColor = sampleDiffuse();
+    vec3 color = min((ambient + diffuse) * textureColor + specular * sampleSpecular(), 1.0f);
     
     // Activate fog
     if (isFogActive) {
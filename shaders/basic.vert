@@ -8,9 +8,34 @@ out vec3 fPosition;
 out vec3 fNormal;
 out vec2 fTexCoords;
 
+#ifdef DRAW_DATA_ATTRIBUTES
+// per-draw record (render queue) or per-instance record (instanced draws), selected by the instance index
+layout(location=3) in mat4 vModel;
+layout(location=7) in mat3 vNormalMatrix;
+layout(location=10) in int vMaterialIndex;
+layout(location=11) in ivec2 vTextureLayers;
+
+flat out mat4 fModel;
+flat out mat3 fNormalMatrix;
+flat out int fMaterialIndex;
+flat out ivec2 fTextureLayers;
+
+#define model vModel
+#else
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#endif
+// camera and lighting data of the frame, shared by every program (gps::FrameData)
+layout(std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 skyboxView;
+    vec3 lightDir;
+    vec3 lightColor;
+    vec3 lightPos;
+    bool isLightActive;
+    bool isFogActive;
+    bool useTextureArrays;
+};
 
 void main() 
 {
@@ -18,4 +43,10 @@ void main()
 	fPosition = vPosition;
 	fNormal = vNormal;
 	fTexCoords = vTexCoords;
+#ifdef DRAW_DATA_ATTRIBUTES
+	fModel = vModel;
+	fNormalMatrix = vNormalMatrix;
+	fMaterialIndex = vMaterialIndex;
+	fTextureLayers = vTextureLayers;
+#endif
 }
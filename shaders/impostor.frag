@@ -0,0 +1,115 @@
+#version 410 core
+
+in vec3 fWorldPosition;
+in vec3 fObjectPosition;
+flat in vec3 fObjectViewDirection;
+flat in vec3 fWorldViewDirection;
+flat in float fScale;
+
+out vec4 fColor;
+
+uniform mat4 model;
+uniform float impostorRadius;
+// frames baked by gps::Impostor, GRID x GRID of them
+uniform sampler2D albedoAtlas;
+uniform sampler2D normalDepthAtlas;
+const int GRID = 8;
+// camera and lighting data of the frame, shared by every program (gps::FrameData)
+layout(std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 skyboxView;
+    vec3 lightDir;
+    vec3 lightColor;
+    vec3 lightPos;
+    bool isLightActive;
+    bool isFogActive;
+    bool useTextureArrays;
+};
+
+float ambientStrength = 0.2f;
+//fog
+uniform float fogDensity=0.1f;
+uniform vec3 fogColor=vec3(0.6f, 0.6f, 0.61f);
+
+// same mapping as gps::Impostor::EncodeDirection / DecodeDirection
+vec2 encodeDirection(vec3 direction)
+{
+    vec3 n = direction / (abs(direction.x) + abs(direction.y) + abs(direction.z));
+    vec2 p = n.xz;
+    if (n.y < 0.0f) {
+        p = (1.0f - abs(p.yx)) * vec2(p.x >= 0.0f ? 1.0f : -1.0f, p.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return p * 0.5f + 0.5f;
+}
+vec3 decodeDirection(vec2 uv)
+{
+    vec2 p = uv * 2.0f - 1.0f;
+    vec3 n = vec3(p.x, 1.0f - abs(p.x) - abs(p.y), p.y);
+    if (n.y < 0.0f) {
+        n.xz = (1.0f - abs(n.zx)) * vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.z >= 0.0f ? 1.0f : -1.0f);
+    }
+    return normalize(n);
+}
+
+// Samples one frame at the billboard point reprojected onto that frame's image plane
+void sampleFrame(ivec2 frame, float weight, inout vec4 albedo, inout vec4 normalDepth)
+{
+    vec3 direction = decodeDirection((vec2(frame) + 0.5f) / float(GRID));
+    // basis of the bake camera (glm::lookAt towards the center)
+    vec3 forward = -direction;
+    vec3 up = abs(direction.y) > 0.999f ? vec3(0.0f, 0.0f, 1.0f) : vec3(0.0f, 1.0f, 0.0f);
+    vec3 s = normalize(cross(forward, up));
+    vec3 u = cross(s, forward);
+
+    vec2 frameUV = vec2(dot(fObjectPosition, s), dot(fObjectPosition, u)) / impostorRadius * 0.5f + 0.5f;
+    if (any(lessThan(frameUV, vec2(0.0f))) || any(greaterThan(frameUV, vec2(1.0f)))) {
+        return;
+    }
+    vec2 atlasUV = (vec2(frame) + frameUV) / float(GRID);
+    albedo += weight * texture(albedoAtlas, atlasUV);
+    normalDepth += weight * texture(normalDepthAtlas, atlasUV);
+}
+
+void main()
+{
+    // the four frames around the view direction, weighted bilinearly
+    vec2 grid = encodeDirection(fObjectViewDirection) * float(GRID) - 0.5f;
+    ivec2 base = ivec2(floor(grid));
+    vec2 f = grid - vec2(base);
+
+    vec4 albedo = vec4(0.0f);
+    vec4 normalDepth = vec4(0.0f);
+    for (int i = 0; i < 4; i++) {
+        ivec2 offset = ivec2(i & 1, i >> 1);
+        ivec2 frame = clamp(base + offset, ivec2(0), ivec2(GRID - 1));
+        float weight = (offset.x == 1 ? f.x : 1.0f - f.x) * (offset.y == 1 ? f.y : 1.0f - f.y);
+        sampleFrame(frame, weight, albedo, normalDepth);
+    }
+
+    if (albedo.a < 0.5f) {
+        discard;
+    }
+    albedo.rgb /= albedo.a;
+    normalDepth /= albedo.a;
+
+    // push the fragment from the quad to the baked surface, so impostors intersect the scene correctly
+    float depth = (normalDepth.a * 2.0f - 1.0f) * impostorRadius * fScale;
+    vec4 positionEye = view * vec4(fWorldPosition + fWorldViewDirection * depth, 1.0f);
+    vec4 positionClip = projection * positionEye;
+    gl_FragDepth = positionClip.z / positionClip.w * 0.5f + 0.5f;
+
+    // ambient and diffuse of basic.frag; the impostor bakes no specular map
+    vec3 normalObject = normalDepth.xyz * 2.0f - 1.0f;
+    vec3 normalEye = normalize(mat3(view) * normalize(mat3(model) * normalObject));
+    vec3 lightDirN = isLightActive ? normalize(lightPos - positionEye.xyz) : normalize(vec3(view * vec4(lightDir, 0.0f)));
+    vec3 ambient = ambientStrength * lightColor;
+    vec3 diffuse = max(dot(normalEye, lightDirN), 0.0f) * lightColor;
+    vec3 color = min((ambient + diffuse) * albedo.rgb, 1.0f);
+
+    if (isFogActive) {
+        float fogFactor = clamp(1.0 - exp(-pow((length(positionEye.xyz) * fogDensity), 2)), 0.0, 1.0);
+        color = mix(fogColor, color, fogFactor);
+    }
+    fColor = vec4(color, 1.0f);
+}
@@ -0,0 +1,44 @@
+#version 410 core
+
+// camera facing quad around the impostor's bounding sphere, corners from gl_VertexID (triangle strip)
+out vec3 fWorldPosition;
+out vec3 fObjectPosition;
+flat out vec3 fObjectViewDirection;
+flat out vec3 fWorldViewDirection;
+flat out float fScale;
+
+uniform mat4 model;
+uniform mat4 inverseModel;
+uniform vec3 cameraPosition;
+uniform vec3 impostorCenter;
+uniform float impostorRadius;
+// camera and lighting data of the frame, shared by every program (gps::FrameData)
+layout(std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 skyboxView;
+    vec3 lightDir;
+    vec3 lightColor;
+    vec3 lightPos;
+    bool isLightActive;
+    bool isFogActive;
+    bool useTextureArrays;
+};
+
+void main()
+{
+    vec2 corner = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1)) * 2.0f - 1.0f;
+
+    vec3 worldCenter = vec3(model * vec4(impostorCenter, 1.0f));
+    fScale = max(length(model[0].xyz), max(length(model[1].xyz), length(model[2].xyz)));
+    vec3 right = vec3(view[0][0], view[1][0], view[2][0]);
+    vec3 up = vec3(view[0][1], view[1][1], view[2][1]);
+
+    fWorldPosition = worldCenter + (right * corner.x + up * corner.y) * impostorRadius * fScale;
+    fObjectPosition = vec3(inverseModel * vec4(fWorldPosition, 1.0f)) - impostorCenter;
+    // one view direction for the whole quad, so every fragment blends the same frames
+    fWorldViewDirection = normalize(cameraPosition - worldCenter);
+    fObjectViewDirection = normalize(mat3(inverseModel) * fWorldViewDirection);
+
+    gl_Position = projection * view * vec4(fWorldPosition, 1.0f);
+}
@@ -0,0 +1,30 @@
+#version 410 core
+
+in vec3 fPosition;
+in vec3 fNormal;
+in vec2 fTexCoords;
+
+// albedo and object space normal + depth along the frame direction, one atlas each
+layout(location=0) out vec4 fAlbedo;
+layout(location=1) out vec4 fNormalDepth;
+
+uniform sampler2D diffuseTexture;
+uniform sampler2DArray diffuseTextureArray;
+uniform int diffuseTextureLayer;
+uniform bool useTextureArrays;
+
+// bounding sphere the frame is fitted to, and the direction from its center towards the frame camera
+uniform vec3 impostorCenter;
+uniform float impostorRadius;
+uniform vec3 bakeDirection;
+
+void main()
+{
+    vec3 albedo = useTextureArrays ? texture(diffuseTextureArray, vec3(fTexCoords, diffuseTextureLayer)).rgb
+        : texture(diffuseTexture, fTexCoords).rgb;
+    fAlbedo = vec4(albedo, 1.0f);
+
+    // depth in [0, 1], 1 at the side of the sphere facing the camera
+    float depth = dot(fPosition - impostorCenter, bakeDirection) / impostorRadius * 0.5f + 0.5f;
+    fNormalDepth = vec4(normalize(fNormal) * 0.5f + 0.5f, clamp(depth, 0.0f, 1.0f));
+}
@@ -0,0 +1,21 @@
+#version 410 core
+
+layout(location=0) in vec3 vPosition;
+layout(location=1) in vec3 vNormal;
+layout(location=2) in vec2 vTexCoords;
+
+out vec3 fPosition;
+out vec3 fNormal;
+out vec2 fTexCoords;
+
+// orthographic camera of the octahedral frame being baked, in the model's own space
+uniform mat4 bakeView;
+uniform mat4 bakeProjection;
+
+void main()
+{
+    gl_Position = bakeProjection * bakeView * vec4(vPosition, 1.0f);
+    fPosition = vPosition;
+    fNormal = vNormal;
+    fTexCoords = vTexCoords;
+}
@@ -3,13 +3,22 @@
 layout (location = 0) in vec3 vertexPosition;
 out vec3 textureCoordinates;
 
-uniform mat4 projection;
-uniform mat4 view;
-uniform mat4 model;
+// camera and lighting data of the frame, shared by every program (gps::FrameData)
+layout(std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 skyboxView;
+    vec3 lightDir;
+    vec3 lightColor;
+    vec3 lightPos;
+    bool isLightActive;
+    bool isFogActive;
+    bool useTextureArrays;
+};
 
 void main()
 {
-    vec4 tempPos = projection * view * vec4(vertexPosition, 1.0);
+    vec4 tempPos = projection * skyboxView * vec4(vertexPosition, 1.0);
     gl_Position = tempPos.xyww;
     textureCoordinates = vertexPosition;
 }